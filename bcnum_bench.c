@@ -0,0 +1,610 @@
+/* Source File: bcnum_bench.c */
+
+/*
+ * Copyright 2011 David F. May
+ *
+ * This software is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; version
+ * 2 of the License only.  See the file Copying at the top of
+ * the distribution for more information.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ * You can contact me at dmay at cnm dot edu.
+ */
+
+/*
+ * bcnum_bench
+ *
+ * Benchmarks for the number.c engine.  Each operation is timed over a range of operand sizes and scales, and every case is
+ * written as one CSV line (the default) or one JSON object: the calls made, the mean, median and 99th percentile latency,
+ * and the throughput.  Keep the output of a run and compare it with the next one when the engine changes.
+ *
+ * With --check N it times nothing, and instead runs N random cases small enough for 128 bit integers through the
+ * bcnum_ctx_* functions and compares each result with the same sum, difference, product, quotient or comparison worked
+ * out exactly, including bc's truncation, scale and sign rules.  Those are too short for the limb, recursive multiply
+ * and Newton division paths, so it then runs N/10 products and quotients of operands up to 400 digits long twice: once
+ * on the digit loops, and once with the thresholds lowered so that the long paths take over.  It exits with 1 if any
+ * case differs.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <getopt.h>
+#include "number.h"
+
+typedef enum {
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_CMP,
+  OP_STR2NUM,
+  OP_NUM2STR,
+  NUM_OPS
+} bench_op;
+
+static const char *op_name[NUM_OPS] = {"add", "sub", "multiply", "divide", "compare", "str2num", "num2str"};
+
+/* The integer digits of the operands, and the scales, that get timed. */
+static const int sizes[] = {2, 8, 18, 40, 100, 300, 1000, 3000, 0};
+static const int scales[] = {0, 2, 10, 40, -1};
+
+#define MAX_SAMPLES 2000                /* timed batches per case, at most */
+#define MIN_SAMPLES 5
+#define BATCH_NS 20000.0                /* a batch runs at least this long, so the clock doesn't show */
+#define OUT_SIZE 20000
+
+static const char *usg =
+  "Usage: bcnum_bench [--csv | --json] [--op NAME] [--time SECONDS] [--seed N]\n"
+  "       bcnum_bench --check N [--seed N]\n"
+  "\n"
+  "  --csv          write one CSV line per case (the default)\n"
+  "  --json         write the cases as a JSON array\n"
+  "  --op NAME      time only NAME: add, sub, multiply, divide, compare, str2num or num2str\n"
+  "  --time SECONDS how long to spend on each case (default 0.2)\n"
+  "  --seed N       seed the operands (default 1)\n"
+  "  --check N      compare N random results against a 128 bit integer reference, and\n"
+  "                 N/10 long products and quotients against the digit loops\n"
+  "  --help         print this message\n";
+
+static bcnum_ctx ctx;
+static char out[OUT_SIZE];
+static bc_num num;
+
+/*
+ * now_ns
+ *
+ * This function returns a monotonic time in nanoseconds.
+ */
+static double now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+/*
+ * rand_digits
+ *
+ * This function writes a random number with LEN integer digits and SCALE decimal places into BUF, with a sign if NEG.
+ */
+static void rand_digits (char *buf, int len, int scale, int neg)
+{
+  int i;
+
+  if (neg)
+    *buf++ = '-';
+  for (i = 0; i < len; i++)
+    *buf++ = (char) ('0' + (i == 0 ? 1 + rand () % 9 : rand () % 10));
+  if (scale > 0) {
+    *buf++ = '.';
+    for (i = 0; i < scale; i++)
+      *buf++ = (char) ('0' + rand () % 10);
+  }
+  *buf = '\0';
+}
+
+/*
+ * run_op
+ *
+ * This function makes N calls of OP on A and B.
+ */
+static void run_op (bench_op op, const char *a, const char *b, int scale, long n)
+{
+  char *s;
+
+  for (; n > 0; n--) {
+    switch (op) {
+      case OP_ADD:
+        (int) bcnum_ctx_add (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_SUB:
+        (int) bcnum_ctx_sub (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_MUL:
+        (int) bcnum_ctx_multiply (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_DIV:
+        (int) bcnum_ctx_divide (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_CMP:
+        (int) bcnum_ctx_compare (&ctx, a, b, scale);
+        break;
+      case OP_STR2NUM:
+        bc_str2num (&num, (char *) a, scale);
+        break;
+      case OP_NUM2STR:
+        s = bc_num2str (num);
+        free (s);
+        break;
+      default:
+        break;
+    }
+  }
+}
+
+static int cmp_double (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+
+  return x < y ? -1 : x > y;
+}
+
+/*
+ * bench_case
+ *
+ * This function times OP on operands of DIGITS integer digits at SCALE for about BUDGET nanoseconds, and writes the result.
+ * Divisors have half the digits of the dividend, so the quotient is long too.
+ */
+static void bench_case (bench_op op, int digits, int scale, double budget, int json, int *first)
+{
+  static double lat[MAX_SAMPLES];
+  char *a, *b;
+  double t0, t, total;
+  long batch, calls;
+  int samples;
+
+  a = malloc ((size_t) (digits + scale + 3));
+  b = malloc ((size_t) (digits + scale + 3));
+  if (a == 0 || b == 0) {
+    printf ("\n***Error in bench_case(), line %d: Out of memory.\n", __LINE__);
+    exit (1);
+  }
+  rand_digits (a, digits, scale, rand () % 2);
+  rand_digits (b, op == OP_DIV ? MAX (digits / 2, 1) : digits, scale, rand () % 2);
+  if (op == OP_CMP)
+    /* equal up to the last digit, the slow case */
+    memcpy (b, a, strlen (a) - 1);
+  bc_str2num (&num, a, scale);
+
+  /* size a batch so it outlasts the clock, then time batches */
+  for (batch = 1;; batch *= 2) {
+    t0 = now_ns ();
+    run_op (op, a, b, scale, batch);
+    if (now_ns () - t0 >= BATCH_NS)
+      break;
+  }
+  total = 0;
+  calls = 0;
+  for (samples = 0; samples < MAX_SAMPLES && (samples < MIN_SAMPLES || total < budget); samples++) {
+    t0 = now_ns ();
+    run_op (op, a, b, scale, batch);
+    t = now_ns () - t0;
+    lat[samples] = t / (double) batch;
+    total += t;
+    calls += batch;
+  }
+  qsort (lat, (size_t) samples, sizeof (double), cmp_double);
+
+  if (json)
+    printf ("%s\n  {\"op\": \"%s\", \"digits\": %d, \"scale\": %d, \"calls\": %ld, \"ns_per_op\": %.1f, "
+            "\"p50_ns\": %.1f, \"p99_ns\": %.1f, \"ops_per_sec\": %.0f}",
+            *first ? "" : ",", op_name[op], digits, scale, calls, total / (double) calls,
+            lat[samples / 2], lat[(samples * 99) / 100], (double) calls * 1e9 / total);
+  else
+    printf ("%s,%d,%d,%ld,%.1f,%.1f,%.1f,%.0f\n", op_name[op], digits, scale, calls, total / (double) calls,
+            lat[samples / 2], lat[(samples * 99) / 100], (double) calls * 1e9 / total);
+  fflush (stdout);
+  *first = 0;
+  free (a);
+  free (b);
+}
+
+/*
+ * The 128 bit reference.  A number is a sign and a magnitude of digits at some scale, the way bc_str2num() leaves it:
+ * the fraction is truncated to the scale of the call, and a negative number keeps its sign even if what is left is 0.
+ */
+typedef struct _ref_num {
+  int neg;
+  __int128 mag;
+  int scale;
+} ref_num;
+
+static __int128 pow10_128 (int n)
+{
+  __int128 p = 1;
+
+  while (n-- > 0)
+    p *= 10;
+  return p;
+}
+
+/*
+ * ref_rand
+ *
+ * This function makes a random operand of up to 18 digits, writes it into BUF as a string (sometimes with a + sign,
+ * leading zeros or trailing zeros), and sets R to what bc makes of it at SCALE.
+ */
+static void ref_rand (char *buf, ref_num *r, int scale)
+{
+  int len, frac, i, d, lead = 1, counted = 0;
+  char *p = buf;
+
+  len = rand () % 13;
+  frac = rand () % 7;
+  r->neg = rand () % 3 == 0;
+  r->mag = 0;
+  r->scale = MIN (frac, scale);
+  if (r->neg)
+    *p++ = '-';
+  else if (rand () % 8 == 0)
+    *p++ = '+';
+  for (i = 0; i < len; i++) {
+    d = rand () % (i == 0 ? 20 : 10) % 10;
+    *p++ = (char) ('0' + d);
+    r->mag = r->mag * 10 + d;
+    lead = lead && d == 0;
+    counted += !lead;
+  }
+  if (frac > 0 || rand () % 4 == 0)
+    *p++ = '.';
+  for (i = 0; i < frac; i++) {
+    d = rand () % 4 ? rand () % 10 : 0;
+    *p++ = (char) ('0' + d);
+    if (i < r->scale)
+      r->mag = r->mag * 10 + d;
+  }
+  *p = '\0';
+  if (counted + frac == 0)
+    /* no digits once the leading zeros go: bc makes it a positive zero */
+    r->neg = 0;
+}
+
+/*
+ * ref_add
+ *
+ * This function sets R to A + B the way bc_add() does it: like signs add and keep A's sign, unlike signs subtract and
+ * take the larger one's, and equal magnitudes give a positive zero.
+ */
+static void ref_add (const ref_num *a, const ref_num *b, int scale, ref_num *r)
+{
+  __int128 x, y;
+
+  r->scale = MAX (scale, MAX (a->scale, b->scale));
+  x = a->mag * pow10_128 (r->scale - a->scale);
+  y = b->mag * pow10_128 (r->scale - b->scale);
+  if (a->neg == b->neg) {
+    r->mag = x + y;
+    r->neg = a->neg;
+  }
+  else if (x == y) {
+    r->mag = 0;
+    r->neg = 0;
+  }
+  else if (x > y) {
+    r->mag = x - y;
+    r->neg = a->neg;
+  }
+  else {
+    r->mag = y - x;
+    r->neg = b->neg;
+  }
+}
+
+/*
+ * ref_op
+ *
+ * This function works out OP on A and B at SCALE into R.  Returns 1 if there is no result (division by zero).
+ */
+static int ref_op (bench_op op, const ref_num *a, const ref_num *b, int scale, ref_num *r)
+{
+  ref_num nb;
+  int full, e;
+
+  switch (op) {
+    case OP_ADD:
+      ref_add (a, b, scale, r);
+      break;
+    case OP_SUB:
+      nb = *b;
+      nb.neg = !nb.neg;
+      ref_add (a, &nb, scale, r);
+      break;
+    case OP_MUL:
+      full = a->scale + b->scale;
+      r->scale = MIN (full, MAX (scale, MAX (a->scale, b->scale)));
+      r->mag = a->mag * b->mag / pow10_128 (full - r->scale);
+      r->neg = r->mag != 0 && a->neg != b->neg;
+      break;
+    case OP_DIV:
+      if (b->mag == 0)
+        return 1;
+      r->scale = scale;
+      e = scale + b->scale - a->scale;
+      if (e >= 0)
+        r->mag = a->mag * pow10_128 (e) / b->mag;
+      else
+        r->mag = a->mag / (b->mag * pow10_128 (-e));
+      r->neg = r->mag != 0 && a->neg != b->neg;
+      break;
+    default:
+      return 1;
+  }
+  return 0;
+}
+
+/*
+ * ref_compare
+ *
+ * This function compares A and B the way bc_compare() does: by sign first, even for zeros, then by magnitude.
+ */
+static int ref_compare (const ref_num *a, const ref_num *b)
+{
+  __int128 x, y;
+  int s = MAX (a->scale, b->scale);
+
+  if (a->neg != b->neg)
+    return a->neg ? -1 : 1;
+  x = a->mag * pow10_128 (s - a->scale);
+  y = b->mag * pow10_128 (s - b->scale);
+  if (x == y)
+    return 0;
+  return (x > y) != a->neg ? 1 : -1;
+}
+
+/*
+ * ref_str
+ *
+ * This function formats R the way bc_out_num() prints it: the sign, then "0" for zero, or the integer part (left out when
+ * it is 0) and the fraction to the full scale.
+ */
+static void ref_str (const ref_num *r, char *buf)
+{
+  char digits[64];
+  __int128 m = r->mag;
+  int n = 0, i;
+
+  if (r->neg)
+    *buf++ = '-';
+  if (m == 0) {
+    strcpy (buf, "0");
+    return;
+  }
+  for (; m != 0; m /= 10)
+    digits[n++] = (char) ('0' + (int) (m % 10));
+  for (i = n - 1; i >= r->scale; i--)
+    *buf++ = digits[i];
+  if (r->scale > 0) {
+    *buf++ = '.';
+    for (i = r->scale - 1; i >= 0; i--)
+      *buf++ = i < n ? digits[i] : '0';
+  }
+  *buf = '\0';
+}
+
+/*
+ * do_check
+ *
+ * This function runs COUNT random cases against the reference.  Returns the number that differed.
+ */
+static long do_check (long count)
+{
+  char a[64], b[64], want[128];
+  ref_num ra, rb, rr;
+  bench_op op;
+  long i, bad = 0;
+  int scale, status, got, exp;
+
+  for (i = 0; i < count; i++) {
+    op = (bench_op) (rand () % (OP_CMP + 1));
+    scale = rand () % 7;
+    ref_rand (a, &ra, scale);
+    ref_rand (b, &rb, scale);
+    if (op == OP_CMP) {
+      got = bcnum_ctx_compare (&ctx, a, b, scale);
+      exp = ref_compare (&ra, &rb);
+      if (got != exp) {
+        printf ("compare (%s, %s, %d): got %d, expected %d\n", a, b, scale, got, exp);
+        bad++;
+      }
+      continue;
+    }
+    status = 0;
+    switch (op) {
+      case OP_ADD:
+        status = bcnum_ctx_add (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_SUB:
+        status = bcnum_ctx_sub (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_MUL:
+        status = bcnum_ctx_multiply (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      case OP_DIV:
+        status = bcnum_ctx_divide (&ctx, a, b, scale, out, OUT_SIZE);
+        break;
+      default:
+        break;
+    }
+    if (ref_op (op, &ra, &rb, scale, &rr) != 0) {
+      if (status == 0 || ctx.error != BCNUM_DIVZERO) {
+        printf ("%s (%s, %s, %d): expected a division by zero, got %s\n", op_name[op], a, b, scale, out);
+        bad++;
+      }
+      continue;
+    }
+    ref_str (&rr, want);
+    if (status != 0 || strcmp (out, want) != 0) {
+      printf ("%s (%s, %s, %d): got %s, expected %s\n", op_name[op], a, b, scale,
+              status ? bcnumErrMsg[ctx.error] : out, want);
+      bad++;
+    }
+  }
+  return bad;
+}
+
+/*
+ * rand_long
+ *
+ * This function writes a random number with up to LEN digits on each side of the point into BUF.
+ */
+static void rand_long (char *buf, int len)
+{
+  int i, n;
+
+  if (rand () % 3 == 0)
+    *buf++ = '-';
+  for (i = 0, n = rand () % len; i < n; i++)
+    *buf++ = (char) ('0' + (i == 0 ? 1 + rand () % 9 : rand () % 10));
+  *buf++ = '.';
+  for (i = 0, n = rand () % len; i < n; i++)
+    *buf++ = (char) ('0' + (rand () % 4 ? rand () % 10 : 9));
+  *buf = '\0';
+}
+
+/*
+ * do_check_long
+ *
+ * This function runs COUNT random products and quotients of long operands on the base 10^9 limbs, the recursive
+ * multiply and the Newton division, and compares each with what the digit loops make of it.  Every tenth case is up to
+ * 400 digits long.  Returns the number that differed.
+ */
+static long do_check_long (long count)
+{
+  static char a[1000], b[1000], want[OUT_SIZE];
+  int ml = mul_limb_digits, dl = div_limb_digits, kl = mul_karatsuba_limbs, nl = div_newton_limbs;
+  long i, bad = 0;
+  int big, mul, scale, s1, s2;
+
+  for (i = 0; i < count; i++) {
+    big = i % 10 == 0;
+    mul = i % 2;
+    rand_long (a, 1 + rand () % (big ? 400 : 60));
+    rand_long (b, 1 + rand () % (big ? 300 : 60));
+    scale = rand () % (big ? 400 : 40);
+    mul_limb_digits = div_limb_digits = INT_MAX;
+    s1 = mul ? bcnum_ctx_multiply (&ctx, a, b, scale, want, OUT_SIZE) : bcnum_ctx_divide (&ctx, a, b, scale, want, OUT_SIZE);
+    mul_limb_digits = div_limb_digits = 0;
+    mul_karatsuba_limbs = i % 3 ? kl : 4;
+    div_newton_limbs = i % 3 ? nl : 2;
+    s2 = mul ? bcnum_ctx_multiply (&ctx, a, b, scale, out, OUT_SIZE) : bcnum_ctx_divide (&ctx, a, b, scale, out, OUT_SIZE);
+    mul_limb_digits = ml;
+    div_limb_digits = dl;
+    mul_karatsuba_limbs = kl;
+    div_newton_limbs = nl;
+    if (s1 != s2 || (s1 == 0 && strcmp (out, want) != 0)) {
+      printf ("%s (%s, %s, %d): the digit loops gave %s, the limbs gave %s\n", op_name[mul ? OP_MUL : OP_DIV], a, b, scale,
+              s1 ? "an error" : want, s2 ? "an error" : out);
+      bad++;
+    }
+  }
+  return bad;
+}
+
+int main (int argc, char *argv[])
+{
+  static struct option long_options[] = {
+    {"csv", no_argument, 0, 'c'},
+    {"json", no_argument, 0, 'j'},
+    {"op", required_argument, 0, 'o'},
+    {"time", required_argument, 0, 't'},
+    {"seed", required_argument, 0, 's'},
+    {"check", required_argument, 0, 'k'},
+    {"help", no_argument, 0, 'h'},
+    {0, 0, 0, 0}
+  };
+  int c, i, j, k, json = 0, first = 1, only = -1;
+  long check = 0, bad, bad_long;
+  double budget = 0.2;
+  unsigned int seed = 1;
+
+  while ((c = getopt_long (argc, argv, "cjo:t:s:k:h", long_options, 0)) != -1) {
+    switch (c) {
+      case 'c':
+        json = 0;
+        break;
+      case 'j':
+        json = 1;
+        break;
+      case 'o':
+        for (only = 0; only < NUM_OPS && strcmp (optarg, op_name[only]) != 0; only++)
+          ;
+        if (only == NUM_OPS) {
+          printf ("\n***Error in main(), line %d: No operation named '%s'\n", __LINE__, optarg);
+          return 2;
+        }
+        break;
+      case 't':
+        budget = atof (optarg);
+        break;
+      case 's':
+        seed = (unsigned int) strtoul (optarg, 0, 10);
+        break;
+      case 'k':
+        check = atol (optarg);
+        break;
+      case 'h':
+        printf ("%s", usg);
+        return 0;
+      default:
+        printf ("%s", usg);
+        return 2;
+    }
+  }
+  srand (seed);
+  bcnum_init ();
+  if (bcnum_ctx_init (&ctx) != 0) {
+    printf ("\n***Error in main(), line %d: bcnum_ctx_init() failed.\n", __LINE__);
+    return 2;
+  }
+
+  if (check > 0) {
+    bad = do_check (check);
+    printf ("%ld of %ld cases differ from the reference\n", bad, check);
+    bad_long = do_check_long (MAX (check / 10, 1));
+    printf ("%ld of %ld long cases differ from the digit loops\n", bad_long, MAX (check / 10, 1));
+    bcnum_ctx_uninit (&ctx);
+    return bad + bad_long != 0;
+  }
+
+  bc_init_num (&num);
+  if (json)
+    printf ("[");
+  else
+    printf ("op,digits,scale,calls,ns_per_op,p50_ns,p99_ns,ops_per_sec\n");
+  for (k = 0; k < NUM_OPS; k++) {
+    if (only >= 0 && k != only)
+      continue;
+    for (i = 0; sizes[i] != 0; i++)
+      for (j = 0; scales[j] >= 0; j++)
+        bench_case ((bench_op) k, sizes[i], scales[j], budget * 1e9, json, &first);
+  }
+  if (json)
+    printf ("\n]\n");
+  bc_free_num (&num);
+  bcnum_ctx_uninit (&ctx);
+  return 0;
+}
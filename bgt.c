@@ -136,14 +136,27 @@
 #error "Must have getopt.h to compile bgt."
 #endif
 #include <ctype.h>
+#include <stddef.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #ifdef HAVE_READLINE_H
 #include <readline/readline.h>
+#include <readline/history.h>
 #else
 # error "Must have readline to compile bgt."
 #endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#else
+# error "Must have pthreads to compile bgt."
+#endif
 #include "sqlite3.h"
 #include "number.h"
 
@@ -167,6 +180,17 @@
 #define SIZE_ARB 4095
 #define SIZE_TSTMP 20
 #define SIZE_AMT 25
+#define SIZE_ARGV 64                    /* words in one command of a batch */
+#define MAX_CLIENTS 64                  /* connections the daemon serves at once */
+#define MAX_THREADS 64                  /* --threads for a recalc */
+#define PAR_MIN_ROWS 10000              /* a recalc thread gets at least this many transactions, or the recalc stays serial */
+#define SCHEMA_VERSION 3               /* kept in PRAGMA user_version; cents from 1 on, checkpoints from 2, report indexes from 3 */
+#define CKPT_ROWS 1000                  /* a posting writes a balance checkpoint once this many transactions are past the last one */
+#define CKPT_KEEP 4                     /* balance checkpoints kept */
+#define MMAP_FAST 268435456             /* PRAGMA mmap_size for the fast profile */
+#define CACHE_FAST -65536               /* PRAGMA cache_size for the fast profile, in KiB */
+#define XSTR(x) STR(x)
+#define STR(x) #x
 #ifndef PATH_MAX
 #define PATH_MAX 4096
 #endif
@@ -234,10 +258,100 @@ typedef struct _splitObject {
 typedef struct _cat_ls {
   int cat;
   char dtime[SIZE_TSTMP+1];
-  char amt[SIZE_AMT+1];
+  long long cents;                      /* balance as stored in cat.amt */
+  char amt[SIZE_AMT+1];                 /* what gets printed; normally cents formatted */
   char name[FIELD_ARB+1];
 } cat_ls;
 
+/*
+ * cat_reg - the category registry.  The categories live in one dense array in category-number order.  by_num maps a category
+ * number to its slot in cats and by_name is an open-addressed hash of slots keyed by name, so finding a category either way is
+ * O(1) and never goes to SQLite.  The arrays grow as needed, so there is no limit on the number of categories.
+ *
+ * The registry is loaded once and then kept in step by bgt's own changes.  It is thrown away (loaded goes back to FALSE) when a
+ * transaction rolls back, and when db_begin() sees from data_version that another process has committed since it was loaded.
+ */
+typedef struct _cat_reg {
+  cat_ls *cats;
+  int num_cats;
+  int max_cats;
+  int *by_num;                          /* category number -> slot, -1 if there is no such category */
+  int max_num;
+  int *by_name;                         /* hash of slots, -1 if empty; name_size is a power of two */
+  int name_size;
+  int loaded;
+  int data_version;                     /* PRAGMA data_version when the registry was loaded */
+  int posted;                           /* the balances take in every transaction; nothing has been added since */
+  int reformat;                         /* some amt strings hold report totals (--exp, --nclr) rather than the balance */
+} cat_reg;
+
+/*
+ * db_profile - a durability profile, the pragmas set on bgt.db right after it is opened.  safe is what bgt always did: a rollback
+ * journal and a full sync on every commit.  wal keeps every commit durable but writes it once, to the write-ahead log.  fast is
+ * for bulk jobs; a power cut can lose the last commits, though never corrupt the database.  A 0 leaves SQLite's default.
+ */
+typedef struct _db_profile {
+  const char *name;
+  const char *journal_mode;
+  const char *synchronous;
+  long long mmap_size;                  /* bytes of the file to map, 0 for none */
+  int cache_size;                       /* pages, or KiB if negative */
+  const char *temp_store;
+} db_profile;
+
+static const db_profile db_profiles[] = {
+  {"safe", "DELETE", "FULL",   0,         0,          0},
+  {"wal",  "WAL",    "FULL",   0,         0,          0},
+  {"fast", "WAL",    "NORMAL", MMAP_FAST, CACHE_FAST, "MEMORY"},
+  {0,      0,        0,        0,         0,          0}
+};
+
+/*
+ * stmt_id - the statements kept prepared in opt->stmt.  The SQL for each one is in stmt_sql[], in the same order.
+ */
+typedef enum _stmt_id {
+  STMT_BEGIN,
+  STMT_COMMIT,
+  STMT_ROLLBACK,
+  STMT_MAX_CAT,
+  STMT_MAX_TRAN,
+  STMT_DATA_VERSION,
+  STMT_ADD_TRAN,
+  STMT_ADD_CAT,
+  STMT_ADD_ACT,
+  STMT_CAT_LOAD,
+  STMT_POST_SUMS,
+  STMT_RECALC_SUMS,
+  STMT_POST_FLAG,
+  STMT_RECALC_FLAG,
+  STMT_SET_CAT_AMT,
+  STMT_TRAN_GET,
+  STMT_EDIT_AMT,
+  STMT_EDIT_CAT,
+  STMT_EDIT_TO,
+  STMT_EDIT_CMT,
+  STMT_EDIT_DATE,
+  STMT_RM_FLAG,
+  STMT_RM_ARCH,
+  STMT_RM_DELETE,
+  STMT_ARCH_FLAG,
+  STMT_ARCH_COPY,
+  STMT_ARCH_CLEAR,
+  STMT_ARCH_BALANCE,
+  STMT_CKPT_LIST,
+  STMT_CKPT_COUNT,
+  STMT_CKPT_LOAD,
+  STMT_CKPT_SUMS,
+  STMT_CKPT_WRITE,
+  STMT_CKPT_MARK,
+  STMT_CKPT_DIFF,
+  STMT_CKPT_DROP,
+  STMT_CKPT_PRUNE,
+  STMT_RANGE_SPAN,
+  STMT_RANGE_SUMS,
+  STMT_MAX
+} stmt_id;
+
 
 /*
  * ================================================================================
@@ -253,11 +367,22 @@ typedef struct _optObject {
   char db_name[PATH_MAX];
   char inputline[FIELD_ARB+1];
   sqlite3 *db;
+  sqlite3_stmt *stmt[STMT_MAX];
+  int tx_depth;
   int initialized;
-  cat_ls catList[MD_ARY];
+  cat_reg cats;
   /* options variables here */
   char is_bgt;
   char bgt[PATH_MAX];
+  int is_batch;
+  char batch[SIZE_ARB+1];
+  int chunk;
+  int is_shell;
+  int is_daemon;
+  int is_client;
+  char sock[PATH_MAX];
+  char profile[SM_ARY+1];
+  /* command options - everything from is_cat on is cleared by clear_cmd_opts() before each command of a batch */
   int is_cat;
   int cat;
   int is_catt;
@@ -287,6 +412,10 @@ typedef struct _optObject {
   int is_qry;
   char qry[DESCR_ARB+1];
   int is_recalc;
+  int is_full;
+  int threads;
+  int is_explain;
+  char explained[STMT_MAX];
   int is_arch;
   int is_pr;
   int is_exp;
@@ -312,17 +441,40 @@ typedef struct _optObject {
 optObject *opt;
 
 /*
- * c_item - used for queries with up to SM_ARY columns returned.
+ * rs_chunk - one block of a result set's arena.  Strings are bump-allocated out of data and the whole chain is freed at once.
+ */
+#define RS_CHUNK_SIZE 16384
+typedef struct _rs_chunk {
+  struct _rs_chunk *next;
+  size_t used;
+  size_t size;
+  char data[1];
+} rs_chunk;
+
+/*
+ * result_set - used for queries with up to SM_ARY columns returned.  The column names are stored once, the rows are one
+ * contiguous array of num_cols pointers per row, and every string lives in the arena.
  */
-typedef struct _c_item {
-  struct _c_item *next;
-  struct _c_item *prev;
-  int num_items;
+typedef struct _result_set {
+  int num_cols;
+  int num_rows;
+  int max_rows;
   char *col[SM_ARY];
-  char *item[SM_ARY];
-} c_item;
+  char **rows;
+  rs_chunk *arena;
+} result_set;
+
+#define RESULT_SET_INIT {0, 0, 0, {0}, 0, 0}
+/* walk the rows: for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)), then c[0]...c[num_cols-1] */
+#define RS_FIRST(rs) ((rs)->rows)
+#define RS_END(rs) ((rs)->rows + (size_t)(rs)->num_rows * (size_t)(rs)->num_cols)
+#define RS_NEXT(rs, c) ((c) + (rs)->num_cols)
 
-c_item *c_head, *c_tail, *c_current;
+/*
+ * row_visitor - called by exec_rows() for each row as SQLite steps to it.  The values are only good until the visitor returns.
+ * A non-zero return stops the query.
+ */
+typedef int (*row_visitor) (void *arg, int argc, const char **row);
 
 /*
  * nclr_dat - needed by proc_nclr_file() and do_nclr().
@@ -376,15 +528,21 @@ typedef struct _qif_item {
 "--edit The --edit switch allows the user to edit a transaction (an entry) by transaction id\n"
 "  (using the --tran switch).  Anything specified on the command-line, up to and including all\n"
 "  five of --amt, --to, --cat (or --catt), --date, and/or --cmt, are changed on the transaction.\n"
+"  If the transaction was already posted and its amount or category changes, the difference is moved\n"
+"  between the balances it touches; nothing else is reposted.\n"
 "\n"
 "--rm The --rm switch allows the user to remove a transaction.  A copy is made of the transaction\n"
-"  in the archive table and it is removed from the tran table.  A recalc is forced after a transaction\n"
-"  is removed.\n"
+"  in the archive table and it is removed from the tran table.  If the transaction was posted, its\n"
+"  amount is taken back out of its category's balance.  A transaction that was never posted leaves the\n"
+"  balances alone.  Use --recalc to rebuild every balance from the tran table.\n"
 "\n"
 "--recalc The --recalc switch forces a recalc of all the transactions in the tran table.  Unlike a posting during a\n"
 "--ls, this will act is if nothing is posted and recalculate everything.  Anything that is not\n"
 "  posted will get flagged as posted after this is complete.  Finally, a listing of the recalculated\n"
-"  balances is produced.\n"
+"  balances is produced.  The recalc starts from the latest balance checkpoint and replays only the\n"
+"  transactions after it.  With --full, it replays the whole tran table instead and checks every\n"
+"  checkpoint against it, dropping any that do not match.  With --threads N, the transactions to\n"
+"  replay are split into N ranges that are summed at the same time.\n"
 "\n"
 "--qry 'QRY_STR'  The --qry switch allows the user to query for transactions by specifying matching\n"
 "  criteria.  The QRY_STR will determine the criteria.  The following query types are supported:\n"
@@ -438,6 +596,34 @@ typedef struct _qif_item {
 "  file.  This allows you to have the actual balances reflected by bgt be what has actually cleared the bank, but\n"
 "  also allows you to get the actual amount that is available by subtracting out what has not cleared but is paid.\n"
 "\n"
+"--batch FILE  The --batch switch runs the commands in FILE (or standard input, if FILE is -), one per line, using the\n"
+"  same switches as the command-line.  Blank lines and lines starting with # are skipped, and a leading 'bgt' and any --bgt\n"
+"  switch are ignored, so the output of --scr can be fed straight back in.  All the commands run in one process and one\n"
+"  transaction.  If a command fails, the batch stops and the commands since the last commit are rolled back.\n"
+"\n"
+"--chunk N  With --batch, commit after every N commands instead of once at the end.\n"
+"\n"
+"--shell  The --shell switch starts an interactive shell on the budget.  Each line is a command with the same switches as\n"
+"  the command-line, and the action can be a bare word: ls, add --catt Food --amt -4.50 --to Store --cmt Lunch, qry dt:2012.\n"
+"  The database stays open between commands.  There is line editing and history, and Tab completes commands, switches and,\n"
+"  after --catt, category names.  Enter quit or exit (or end of file) to leave.\n"
+"\n"
+"--daemon  The --daemon switch keeps the budget open and serves commands over a Unix socket (<bgt>/bgt.sock, or --sock)\n"
+"  until it is interrupted.  The categories and their balances stay in memory, so lookups like --ls --tot don't touch the\n"
+"  database unless something was added, and every write goes through the one daemon.  --arch isn't served.\n"
+"\n"
+"--client  The --client switch sends the rest of the command-line to the daemon and prints its answer, instead of\n"
+"  opening the database itself.  The exit status is the command's.\n"
+"\n"
+"--sock PATH  With --daemon or --client, the socket to use instead of <bgt>/bgt.sock.\n"
+"\n"
+"--profile NAME  How bgt.db trades durability for speed: safe (the default) syncs every commit through a rollback journal,\n"
+"  wal syncs every commit through a write-ahead log, and fast uses the log without syncing each commit, plus a larger cache\n"
+"  and memory mapping, for bulk jobs like a big --batch.  BGT_PROFILE sets the profile when --profile isn't given.\n"
+"\n"
+"--explain  The --explain switch prints how SQLite runs each query an action makes, as the action runs it.  On its own,\n"
+"  it prints the plan of every query bgt uses, so you can check which index each one takes.\n"
+"\n"
 "--qif <filename>  The --qif switch will read a qif file and parse it.  The categories in the file must\n"
 "  correspond to categories in the budget database, or an warning is issued, though parsing continues.\n"
 "  Once parsing is completed, you should be able to take the --add statements thus generated and add them to your\n"
@@ -472,23 +658,62 @@ typedef struct _qif_item {
 "\n"
 "--help This generates a help screen.\n";
 
-int is_query = 0;
-
 /*
  * ================================================================================
  * Function Prototypes
  * ================================================================================
  */
-inline int init_cb_data (void);
-inline void del_cb_data (void);
-static int cbitem (void *NotUsed, int argc, char **argv, char **azColName);
+static char *rs_strdup (result_set *rs, const char *str);
+inline void del_cb_data (result_set *rs);
+static int cbitem (void *arg, int argc, char **argv, char **azColName);
+static int exec_rows (const char *sql, row_visitor visit, void *arg);
+static int explain (const char *sql);
+static sqlite3_stmt *stmt_get (stmt_id id);
+static int stmt_exec (sqlite3_stmt *stmt);
+static void stmt_free_all (void);
+static int db_begin (void);
+static int db_commit (void);
+static void db_rollback (void);
+static int db_data_version (void);
+static int visit_cat_total (void *arg, int argc, const char **row);
+static char *shell_quote (const char *str, char *buf, size_t size);
+static int visit_scr_cat (void *arg, int argc, const char **row);
+static int visit_scr_tran (void *arg, int argc, const char **row);
+static int visit_csv (void *arg, int argc, const char **row);
 static void remove_chr (char *str, int chr);
 static int do_initialize (void);
+static void sql_bgt_cents (sqlite3_context *ctx, int argc, sqlite3_value **argv);
+static void sql_bgt_amt (sqlite3_context *ctx, int argc, sqlite3_value **argv);
+static int migrate_db (void);
+static int set_profile (void);
 static int get_cat_num_from_name (char *name);
 static int get_cat_name_from_num (int num, char *name);
+static int get_next_num (stmt_id id);
 static int get_next_cat_num (void);
 static int get_next_tran_num (void);
+static unsigned int cat_hash (const char *name);
+static int cat_rehash (int size);
+static cat_ls *cat_find_num (int num);
+static cat_ls *cat_find_name (const char *name);
+static cat_ls *cat_add (int num, const char *dtime, const char *name, long long cents);
+static int cat_load (void);
+static int cat_set_amt (const cat_ls *cl);
+static int cat_apply (cat_ls *cl, long long cents, const char *func);
+static int tran_posted (int tran, int *cat, long long *cents);
+static int ckpt_count (int hwm);
+static int ckpt_find (int *hwm, int *count);
+static int ckpt_load (int hwm);
+static int ckpt_write (int force);
+static int ckpt_drop (int from);
+static int ckpt_verify (void);
+static int post_sum (int cat_num, long long cents, int count, int *num_trans);
+static void *recalc_worker (void *arg);
+static int recalc_parallel (int hwm, int *num_trans);
+static void cat_check (void);
+static void cat_free (void);
 static inline int verify_number (const char *num);
+static void put_amt (char *amt, const bcmoney *m);
+static void put_sum (char *amt, bcnum_sum *s);
 static int proc_nclr_file (void);
 static qifItem *parseQIFItem (char *rqda[], const char *file, int lnctr);
 
@@ -499,6 +724,7 @@ static int do_post (int recalc);
 static int do_nclr (void);
 static int do_ls (void);
 static int do_recalc ();
+static int do_explain (void);
 static int do_qry(void);
 static int do_edit (void);
 static int do_rm (void);
@@ -509,6 +735,19 @@ static int do_scr (void);
 static int do_arch (void);
 static int do_csv (void);
 static int do_qif (void);
+static int split_args (char *line, char *argv[], int max);
+static int do_batch (void);
+static int parse_opts (int argc, char *argv[], int cmdline);
+static void clear_cmd_opts (void);
+static int run_opts (void);
+static char *shell_complete_word (const char *text, int state);
+static char **shell_complete (const char *text, int start, int end);
+static int do_shell (void);
+static int send_all (int fd, const char *buf, size_t len);
+static int serve_line (int fd, char *line);
+static void daemon_signal (int sig);
+static int do_daemon (void);
+static int do_client (int argc, char *argv[]);
 
 /*
  * ================================================================================
@@ -594,193 +833,530 @@ static void remove_chr (char *str, int chr)
 }
 
 /*
- * init_cb_data
+ * rs_strdup
  *
- * This initializes the linked list that will contain all the results of queries.
+ * This function copies a string into the result set's arena, starting a new chunk when the current one is full.
  */
-inline int init_cb_data (void)
+static char *rs_strdup (result_set *rs, const char *str)
 {
-  c_head = malloc (sizeof (c_item));
-  if (c_head == 0) {
-    printf ("\n***Error: Fatal memory error, line %d, allocating c_item head (%d bytes)\n", __LINE__, sizeof(c_item));
-    return -1;
-  }
-  memset (c_head, 0, sizeof (c_item));
-  c_tail = malloc (sizeof (c_item));
-  if (c_tail == 0) {
-    printf ("\n***Error: Fatal memory error, line %d, allocating c_1item tail (%d bytes)\n", __LINE__, sizeof(c_item));
-    return -1;
-  }
-  memset (c_tail, 0, sizeof (c_item));
-  c_head->next = c_tail;
-  c_tail->prev = c_head;
-  c_current = c_head;
-  is_query = TRUE;
-  return 0;
+  size_t len = strlen (str) + 1;
+  size_t size;
+  rs_chunk *ch = rs->arena;
+  char *cp;
+
+  if (ch == 0 || ch->size - ch->used < len) {
+    size = (len > RS_CHUNK_SIZE) ? len : RS_CHUNK_SIZE;
+    ch = malloc (sizeof (rs_chunk) + size);
+    if (ch == 0) {
+      printf ("\n***Error in rs_strdup(), line %d: Fatal memory error allocating %d bytes for the result arena\n", __LINE__, (int)(sizeof (rs_chunk) + size));
+      return 0;
+    }
+    ch->next = rs->arena;
+    ch->used = 0;
+    ch->size = size;
+    rs->arena = ch;
+  }
+  cp = ch->data + ch->used;
+  memcpy (cp, str, len);
+  ch->used += len;
+  return cp;
 }
 
 /*
  * del_cb_data
  *
- * This function removes the query linked list and cleans up all used allocated memory.
+ * This function releases everything a result set holds and leaves it empty, ready for another query.
  */
-inline void del_cb_data (void)
+inline void del_cb_data (result_set *rs)
 {
-  int i;
-  c_item *c;
-  if (c_head == 0 || c_tail == 0) {
-    return;
-  }
-  while (c_head->next != c_tail) {
-    c = c_head->next;
-    c->next->prev = c->prev;
-    c->prev->next = c->next;
-    for (i = 0; i < SM_ARY; i++) {
-      if (c->col[i] != 0) {
-        free (c->col[i]);
-        c->col[i] = 0;
-      }
-      if (c->item[i] != 0) {
-        free (c->item[i]);
-        c->item[i] = 0;
-      }
-    }
-    free (c);
-    c_head->num_items--;
+  rs_chunk *ch;
+
+  while (rs->arena != 0) {
+    ch = rs->arena;
+    rs->arena = ch->next;
+    free (ch);
   }
-  free (c_tail);
-  c_tail = 0;
-  free (c_head);
-  c_head = 0;
-  is_query = FALSE;
+  if (rs->rows != 0)
+    free (rs->rows);
+  memset (rs, 0, sizeof (result_set));
   return;
 }
 
 /*
  * cbitem
- * Call back function for queries.  This function populates a c_item linked list for a
- * query returning n columns.  The number of columns for each line is in c->num_items,
- * so the caller can verify it is right.
+ * Call back function for queries.  This function appends a row to the result_set passed as the sqlite3_exec() argument.
+ * The column names are kept from the first row, and every row of a query has rs->num_cols columns.
  */
-static int cbitem (void *NotUsed, int argc, char **argv, char **azColName)
+static int cbitem (void *arg, int argc, char **argv, char **azColName)
 {
-  int len, i;
-  c_item *c;
+  result_set *rs = arg;
+  char **row;
+  char **rows;
+  int max_rows;
+  int i;
 
   if (argc < 1 || argc > SM_ARY) {
     printf ("***Error in cbitem(), line %d: argc = %d is invalid.\n", __LINE__, argc);
     return -1;
   }
-  c = malloc (sizeof (c_item));
-  if (c == 0) {
-    printf ("\n***Error, in cbitem(), line %d: Fatal memory error allocating %d bytes for a c_item\n",
-        __LINE__, sizeof(c_item));
-    return -1;
-  }
-  memset (c, 0, sizeof(c_item));
-  if (! is_query)
-    init_cb_data();
   if (azColName[0] == 0) {
     // ignore this call
-    free (c);
     return 0;
   }
-  for (i = 0; i < argc; i++) {
-    len = strlen (azColName[i]);
-    c->col[i] = malloc (len+1);
-    if (c->col[i] == 0) {
-      printf ("***Error in cbitem(), line %d: Fatal memory error allocating %d bytes for arg %d column name, azColName='%s'\n",
-          __LINE__, len+1, i, azColName[i]);
-      free(c);
+  if (rs->num_rows == 0) {
+    rs->num_cols = argc;
+    for (i = 0; i < argc; i++) {
+      rs->col[i] = rs_strdup (rs, azColName[i]);
+      if (rs->col[i] == 0)
+        return -1;
+    }
+  }
+  else if (argc != rs->num_cols) {
+    printf ("***Error in cbitem(), line %d: argc = %d, but the query has %d columns.\n", __LINE__, argc, rs->num_cols);
+    return -1;
+  }
+  if (rs->num_rows == rs->max_rows) {
+    max_rows = rs->max_rows ? rs->max_rows * 2 : 64;
+    rows = realloc (rs->rows, (size_t)max_rows * (size_t)argc * sizeof (char *));
+    if (rows == 0) {
+      printf ("\n***Error, in cbitem(), line %d: Fatal memory error growing the result set to %d rows\n", __LINE__, max_rows);
       return -1;
     }
-    strcpy (c->col[i], azColName[i]);
+    rs->rows = rows;
+    rs->max_rows = max_rows;
+  }
+  row = rs->rows + (size_t)rs->num_rows * (size_t)argc;
+  for (i = 0; i < argc; i++) {
     if (argv[i] == 0)
-      c->item[i] = 0;
+      row[i] = 0;
     else {
-      len = strlen (argv[i]);
-      c->item[i] = malloc (len+1);
-      if (c->item[i] == 0) {
-        printf ("***Error in cbitem(), line %d: Fatal memory error allocating %d bytes for arg %d argument, azColName='%s'\n",
-            __LINE__, len+1, i, azColName[i]);
-        free(c);
+      row[i] = rs_strdup (rs, argv[i]);
+      if (row[i] == 0)
         return -1;
-      }
-      memset (c->item[i], 0, len+1);
-      strcpy (c->item[i], argv[i]);
     }
   }
-  c->num_items = argc;
-  /* now, link it */
-  c_tail->prev->next = c;
-  c->prev = c_tail->prev;
-  c_tail->prev = c;
-  c->next = c_tail;
-  c_head->num_items++;
+  rs->num_rows++;
+  return 0;
+}
+
+/*
+ * exec_rows
+ *
+ * This function runs a query and hands each row to visit as soon as sqlite3_step() produces it, so nothing is held beyond the
+ * current row.  It returns the number of rows visited, or -1 if the query or the visitor failed.
+ */
+static int exec_rows (const char *sql, row_visitor visit, void *arg)
+{
+  sqlite3_stmt *stmt;
+  const char *row[SM_ARY];
+  int ret;
+  int argc;
+  int i;
+  int num_rows = 0;
+
+  explain (sql);
+  ret = sqlite3_prepare_v2 (opt->db, sql, -1, &stmt, 0);
+  if (ret != SQLITE_OK) {
+    printf ("\n\n***Error in exec_rows(), line %d: SQLite Error entering '%s': %s\n", __LINE__, sql, sqlite3_errmsg (opt->db));
+    return -1;
+  }
+  argc = sqlite3_column_count (stmt);
+  if (argc < 1 || argc > SM_ARY) {
+    printf ("***Error in exec_rows(), line %d: argc = %d is invalid.\n", __LINE__, argc);
+    sqlite3_finalize (stmt);
+    return -1;
+  }
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    for (i = 0; i < argc; i++)
+      row[i] = (const char *)sqlite3_column_text (stmt, i);
+    num_rows++;
+    if (visit (arg, argc, row) != 0) {
+      sqlite3_finalize (stmt);
+      return -1;
+    }
+  }
+  if (ret != SQLITE_DONE) {
+    printf ("\n\n***Error in exec_rows(), line %d: SQLite Error entering '%s': %s\n", __LINE__, sql, sqlite3_errmsg (opt->db));
+    sqlite3_finalize (stmt);
+    return -1;
+  }
+  sqlite3_finalize (stmt);
+  return num_rows;
+}
+
+/*
+ * explain
+ *
+ * With --explain, this function prints how SQLite will run sql, as an indented EXPLAIN QUERY PLAN tree.  A statement with no plan
+ * (BEGIN, or an INSERT of plain values) prints nothing.  It returns the number of plan lines.
+ */
+static int explain (const char *sql)
+{
+  sqlite3_stmt *stmt;
+  char *q;
+  int ids[SM_ARY];
+  int depth[SM_ARY];
+  int num_lines = 0;
+  int parent;
+  int d;
+  int i;
+
+  if (! opt->is_explain)
+    return 0;
+  q = sqlite3_mprintf ("EXPLAIN QUERY PLAN %s", sql);
+  if (q == 0)
+    return 0;
+  if (sqlite3_prepare_v2 (opt->db, q, -1, &stmt, 0) != SQLITE_OK) {
+    printf ("\n***Warning in explain(), line %d: Can't explain '%s': %s\n", __LINE__, sql, sqlite3_errmsg (opt->db));
+    sqlite3_free (q);
+    return 0;
+  }
+  sqlite3_free (q);
+  while (sqlite3_step (stmt) == SQLITE_ROW) {
+    if (num_lines == 0)
+      printf ("QUERY PLAN for %s\n", sql);
+    /* each line hangs under the one whose id is its parent */
+    parent = sqlite3_column_int (stmt, 1);
+    for (d = 0, i = 0; i < num_lines && i < SM_ARY; i++)
+      if (ids[i] == parent)
+        d = depth[i] + 1;
+    if (num_lines < SM_ARY) {
+      ids[num_lines] = sqlite3_column_int (stmt, 0);
+      depth[num_lines] = d;
+    }
+    printf ("  %*s%s\n", d * 2, "", (const char *)sqlite3_column_text (stmt, 3));
+    num_lines++;
+  }
+  sqlite3_finalize (stmt);
+  return num_lines;
+}
+
+/*
+ * stmt_sql
+ *
+ * The SQL behind each stmt_id.  Every value that comes from the user is a ? parameter, so a quote in --to or --cmt is just data.
+ * Amounts go through bgt_cents() so they are stored as cents however the user typed them.  A range with only one end on num is
+ * wrapped in likelihood(), so SQLite takes it as the short run of recent transactions it usually is and walks the rowids rather than
+ * scanning all of t_rpt.
+ */
+static const char *stmt_sql[STMT_MAX] = {
+  /* STMT_BEGIN */        "BEGIN IMMEDIATE TRANSACTION;",
+  /* STMT_COMMIT */       "COMMIT;",
+  /* STMT_ROLLBACK */     "ROLLBACK;",
+  /* STMT_MAX_CAT */      "SELECT MAX(num) FROM cat;",
+  /* STMT_MAX_TRAN */     "SELECT MAX(num) FROM tran;",
+  /* STMT_DATA_VERSION */ "PRAGMA data_version;",
+  /* STMT_ADD_TRAN */     "INSERT INTO tran VALUES (?1,?2,COALESCE(?3,datetime('now','localtime')),bgt_cents(?4),'NPST',?5,?6);",
+  /* STMT_ADD_CAT */      "INSERT INTO cat VALUES (?1,datetime('now','localtime'),?2,0,?3);",
+  /* STMT_ADD_ACT */      "INSERT INTO act VALUES (?1,?2,?3,COALESCE(?4,datetime('now','localtime')),bgt_cents(?5),?6,?7);",
+  /* STMT_CAT_LOAD */     "SELECT num,dtime,name,amt FROM cat ORDER BY num;",
+  /* STMT_POST_SUMS */    "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE status = 'NPST' GROUP BY cat_num;",
+  /* STMT_RECALC_SUMS */  "SELECT cat_num,SUM(amt),COUNT(*) FROM tran GROUP BY cat_num;",
+  /* STMT_POST_FLAG */    "UPDATE tran SET status = 'PSTD' WHERE status = 'NPST';",
+  /* STMT_RECALC_FLAG */  "UPDATE tran SET status = 'PSTD' WHERE status != 'PSTD';",
+  /* STMT_SET_CAT_AMT */  "UPDATE cat SET amt = ?1,dtime=datetime('now','localtime') WHERE num = ?2;",
+  /* STMT_TRAN_GET */     "SELECT cat_num,amt,status FROM tran WHERE num = ?1;",
+  /* STMT_EDIT_AMT */     "UPDATE tran SET amt = bgt_cents(?1) WHERE num = ?2;",
+  /* STMT_EDIT_CAT */     "UPDATE tran SET cat_num = ?1 WHERE num = ?2;",
+  /* STMT_EDIT_TO */      "UPDATE tran SET to_who = ?1 WHERE num = ?2;",
+  /* STMT_EDIT_CMT */     "UPDATE tran SET comment = ?1 WHERE num = ?2;",
+  /* STMT_EDIT_DATE */    "UPDATE tran SET dtime = ?1 WHERE num = ?2;",
+  /* STMT_RM_FLAG */      "UPDATE tran SET status = 'RMVD' WHERE num = ?1;",
+  /* STMT_RM_ARCH */      "INSERT INTO arch SELECT * FROM tran WHERE num = ?1;",
+  /* STMT_RM_DELETE */    "DELETE FROM tran WHERE num = ?1;",
+  /* STMT_ARCH_FLAG */    "UPDATE tran SET status = 'ARCH';",
+  /* STMT_ARCH_COPY */    "INSERT INTO arch SELECT * FROM tran;",
+  /* STMT_ARCH_CLEAR */   "DELETE FROM tran;",
+  /* STMT_ARCH_BALANCE */ "INSERT INTO tran VALUES (?1,?2,datetime('now','localtime'),bgt_cents(?3),'PSTD','Initial','Initial Balance for account.');",
+  /* STMT_CKPT_LIST */    "SELECT hwm,amt FROM balance_checkpoint WHERE cat_num = -1 ORDER BY hwm DESC;",
+  /* STMT_CKPT_COUNT */   "SELECT COUNT(*) FROM tran WHERE num <= ?1;",
+  /* STMT_CKPT_LOAD */    "SELECT cat_num,amt FROM balance_checkpoint WHERE hwm = ?1 AND cat_num >= 0;",
+  /* STMT_CKPT_SUMS */    "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE likelihood(num > ?1, 0.001) GROUP BY cat_num;",
+  /* STMT_CKPT_WRITE */   "INSERT INTO balance_checkpoint SELECT ?2,cat_num,datetime('now','localtime'),SUM(amt) FROM "
+                          "(SELECT cat_num,amt FROM balance_checkpoint WHERE hwm = ?1 AND cat_num >= 0 "
+                          "UNION ALL SELECT cat_num,amt FROM tran WHERE num > ?1 AND num <= ?2) GROUP BY cat_num;",
+  /* STMT_CKPT_MARK */    "INSERT INTO balance_checkpoint VALUES (?1,-1,datetime('now','localtime'),?2);",
+  /* STMT_CKPT_DIFF */    "SELECT COUNT(*) FROM (SELECT cat_num FROM (SELECT cat_num,amt FROM tran WHERE num <= ?1 "
+                          "UNION ALL SELECT cat_num,-amt FROM balance_checkpoint WHERE hwm = ?1 AND cat_num >= 0) "
+                          "GROUP BY cat_num HAVING SUM(amt) != 0);",
+  /* STMT_CKPT_DROP */    "DELETE FROM balance_checkpoint WHERE hwm >= ?1;",
+  /* STMT_CKPT_PRUNE */   "DELETE FROM balance_checkpoint WHERE hwm < (SELECT MIN(hwm) FROM "
+                          "(SELECT hwm FROM balance_checkpoint WHERE cat_num = -1 ORDER BY hwm DESC LIMIT ?1));",
+  /* STMT_RANGE_SPAN */   "SELECT MIN(num),MAX(num),COUNT(*) FROM tran WHERE num > ?1;",
+  /* STMT_RANGE_SUMS */   "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE num > ?1 AND num <= ?2 GROUP BY cat_num;"
+};
+
+/*
+ * stmt_get
+ *
+ * This function hands back the cached statement for id, ready to have its parameters bound.  The statement is prepared the first
+ * time it is asked for and reset (with its bindings cleared) every time after that.  It returns 0 if the statement can't be prepared.
+ */
+static sqlite3_stmt *stmt_get (stmt_id id)
+{
+  int ret;
+
+  if (opt->is_explain && ! opt->explained[id]) {
+    opt->explained[id] = TRUE;
+    explain (stmt_sql[id]);
+  }
+  if (opt->stmt[id] != 0) {
+    sqlite3_reset (opt->stmt[id]);
+    sqlite3_clear_bindings (opt->stmt[id]);
+    return opt->stmt[id];
+  }
+  ret = sqlite3_prepare_v2 (opt->db, stmt_sql[id], -1, &opt->stmt[id], 0);
+  if (ret != SQLITE_OK) {
+    printf ("\n\n***Error in stmt_get(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[id], sqlite3_errmsg (opt->db));
+    opt->stmt[id] = 0;
+    return 0;
+  }
+  return opt->stmt[id];
+}
+
+/*
+ * stmt_exec
+ *
+ * This function runs a statement that doesn't return rows and resets it so it doesn't hold a read lock open.  It returns 0 on
+ * success and -1 on error.
+ */
+static int stmt_exec (sqlite3_stmt *stmt)
+{
+  int ret;
+
+  if (stmt == 0)
+    return -1;
+  ret = sqlite3_step (stmt);
+  if (ret != SQLITE_DONE && ret != SQLITE_ROW) {
+    printf ("\n\n***Error in stmt_exec(), line %d: SQLite Error entering '%s': %s\n", __LINE__, sqlite3_sql (stmt), sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
+    return -1;
+  }
+  sqlite3_reset (stmt);
+  return 0;
+}
+
+/*
+ * stmt_free_all
+ *
+ * This function finalizes every cached statement.  It has to run before sqlite3_close().
+ */
+static void stmt_free_all (void)
+{
+  int i;
+
+  for (i = 0; i < STMT_MAX; i++) {
+    if (opt->stmt[i] != 0)
+      sqlite3_finalize (opt->stmt[i]);
+    opt->stmt[i] = 0;
+  }
+}
+
+/*
+ * db_begin, db_commit, db_rollback
+ *
+ * These functions wrap the SQL transaction.  They nest: only the outermost db_begin() and db_commit() touch the database, so
+ * do_edit() can call do_post() and have both land in one transaction.  db_rollback() always rolls back the whole thing, and the
+ * outer db_commit() then reports the failure.
+ */
+static int db_begin (void)
+{
+  if (opt->tx_depth++ > 0)
+    return 0;
+  if (stmt_exec (stmt_get (STMT_BEGIN)) != 0) {
+    opt->tx_depth = 0;
+    return -1;
+  }
+  /* we hold the write lock now; if someone else committed since the registry was loaded, it has to be reloaded */
+  cat_check ();
+  return 0;
+}
+
+static int db_commit (void)
+{
+  if (opt->tx_depth == 0) {
+    printf ("\n***Error in db_commit(), line %d: The transaction was already rolled back\n", __LINE__);
+    return -1;
+  }
+  if (--opt->tx_depth > 0)
+    return 0;
+  if (stmt_exec (stmt_get (STMT_COMMIT)) != 0) {
+    if (! sqlite3_get_autocommit (opt->db))
+      stmt_exec (stmt_get (STMT_ROLLBACK));
+    opt->cats.loaded = FALSE;
+    return -1;
+  }
   return 0;
 }
 
+static void db_rollback (void)
+{
+  if (opt->tx_depth == 0)
+    return;
+  opt->tx_depth = 0;
+  if (! sqlite3_get_autocommit (opt->db))
+    stmt_exec (stmt_get (STMT_ROLLBACK));
+  /* the registry may hold changes that never made it to the database */
+  opt->cats.loaded = FALSE;
+}
+
+/*
+ * db_data_version
+ *
+ * This function returns PRAGMA data_version, which changes whenever another connection commits to the database.  It returns -1 on
+ * error, which never matches a real version.
+ */
+static int db_data_version (void)
+{
+  sqlite3_stmt *stmt;
+  int ret = -1;
+
+  stmt = stmt_get (STMT_DATA_VERSION);
+  if (stmt == 0)
+    return -1;
+  if (sqlite3_step (stmt) == SQLITE_ROW)
+    ret = sqlite3_column_int (stmt, 0);
+  sqlite3_reset (stmt);
+  return ret;
+}
+
+/*
+ * The tables and indexes, shared by SQLInitializeString and the migrations.  Amounts are INTEGER cents.
+ */
+#define SQL_SCHEMA \
+"/* cat table */\n" \
+"/* Contains information about categories, including balances. */\n" \
+"CREATE TABLE cat (\n" \
+"  num INTEGER PRIMARY KEY AUTOINCREMENT,\n" \
+"  dtime CHAR (20),\n" \
+"  name VARCHAR (256),\n" \
+"  amt INTEGER,\n" \
+"  comment VARCHAR (256)\n" \
+");\n" \
+"-- INSERT INTO cat VALUES (1, datetime('now','localtime'), 'overflow', 0, 'The overflow category used to track cent amounts.');\n" \
+"CREATE INDEX c_dt ON cat(dtime);\n" \
+"CREATE INDEX c_cnm ON cat(name);\n" \
+"\n" \
+"/* tran table */\n" \
+"/* Contains information about transactions. */\n" \
+"CREATE TABLE tran (\n" \
+"  num INTEGER PRIMARY KEY AUTOINCREMENT,\n" \
+"  cat_num INTEGER,\n" \
+"  dtime CHAR (20),\n" \
+"  amt INTEGER,\n" \
+"  status CHAR (4) CHECK (status IN ('ARCH','EDIT','FARC','NPST','PSTD','RMVD')),\n" \
+"  to_who VARCHAR (256),\n" \
+"  comment VARCHAR (256)\n" \
+");\n" \
+"\n" \
+"CREATE INDEX t_dt ON tran(dtime);\n" \
+"CREATE INDEX t_amt ON tran(amt);\n" \
+"\n" \
+"/* arch table */\n" \
+"/* Contains archived transactions. */\n" \
+"CREATE TABLE arch (\n" \
+"  num INTEGER,\n" \
+"  cat_num INTEGER,\n" \
+"  dtime CHAR (20),\n" \
+"  amt INTEGER,\n" \
+"  status CHAR (4) CHECK (status IN ('ARCH','EDIT','FARC','NPST','PSTD','RMVD')),\n" \
+"  to_who VARCHAR (256),\n" \
+"  comment VARCHAR (256)\n" \
+");\n" \
+"CREATE INDEX a_num ON arch(num);\n" \
+"CREATE INDEX a_dt ON arch(dtime);\n" \
+"\n" \
+"/* act table */\n" \
+"/* Contains activity information, like a journal. */\n" \
+"CREATE TABLE act (\n" \
+"  type CHAR(4) CHECK (type IN ('ARC','CAT','EDT','RMV','TRN')),\n" \
+"  cat_num INTEGER,\n" \
+"  tran_num INTEGER,\n" \
+"  dtime CHAR(20),\n" \
+"  amt INTEGER,\n" \
+"  to_who VARCHAR (256),\n" \
+"  comment VARCHAR (256)\n" \
+");\n" \
+"-- INSERT INTO act VALUES ('CAT',1,NULL,datetime('now','localtime'),NULL,'overflow','Added cat 1, the overflow category.');\n" \
+"CREATE INDEX ct_dt ON act(dtime);\n"
+
+/*
+ * Added in schema version 2.  A checkpoint is the category balances as of a transaction number (its high-water mark), so a
+ * recalc only has to replay the transactions after it.  Each checkpoint has one row per category, plus a row with cat_num -1
+ * whose amt is the number of transactions it covers.
+ */
+#define SQL_CHECKPOINT_SCHEMA \
+"/* balance_checkpoint table */\n" \
+"/* Contains category balances as of a transaction number. */\n" \
+"CREATE TABLE balance_checkpoint (\n" \
+"  hwm INTEGER,\n" \
+"  cat_num INTEGER,\n" \
+"  dtime CHAR (20),\n" \
+"  amt INTEGER\n" \
+");\n" \
+"CREATE INDEX bc_hwm ON balance_checkpoint(hwm,cat_num);\n"
+
+/*
+ * Added in schema version 3, for the ways bgt reads the tran table.  t_npst holds only the unposted rows, so a posting finds and
+ * sums them without a scan.  t_cdt is a category's transactions in date order.  t_rpt covers the --exp, --inc and --net reports
+ * and a full recalc, which read nothing but cat_num, amt and to_who, in cat_num order.
+ */
+#define SQL_INDEX_SCHEMA \
+"CREATE INDEX t_npst ON tran(cat_num,amt) WHERE status = 'NPST';\n" \
+"CREATE INDEX t_cdt ON tran(cat_num,dtime);\n" \
+"CREATE INDEX t_rpt ON tran(cat_num,amt,to_who);\n"
+
 static char *SQLInitializeString =
 "/* Created by the bgt program. */\n"
 "/* Do not change this schema manually. */\n"
 "/* Vile things will happen to your data if you do. */\n"
 "BEGIN TRANSACTION;\n"
-"/* cat table */\n"
-"/* Contains information about categories, including balances. */\n"
-"CREATE TABLE cat (\n"
-"  num INTEGER PRIMARY KEY AUTOINCREMENT,\n"
-"  dtime CHAR (20),\n"
-"  name VARCHAR (256),\n"
-"  amt VARCHAR (25),\n"
-"  comment VARCHAR (256)\n"
-");\n"
-"-- INSERT INTO cat VALUES (1, datetime('now','localtime'), 'overflow', '0.00', 'The overflow category used to track cent amounts.');\n"
-"CREATE INDEX c_dt ON cat(dtime);\n"
-"CREATE INDEX c_cnm ON cat(name);\n"
-"\n"
-"/* tran table */\n"
-"/* Contains information about transactions. */\n"
-"CREATE TABLE tran (\n"
-"  num INTEGER PRIMARY KEY AUTOINCREMENT,\n"
-"  cat_num INTEGER,\n"
-"  dtime CHAR (20),\n"
-"  amt CHAR (25),\n"
-"  status CHAR (4) CHECK (status IN ('ARCH','EDIT','FARC','NPST','PSTD','RMVD')),\n"
-"  to_who VARCHAR (256),\n"
-"  comment VARCHAR (256)\n"
-");\n"
-"\n"
-"CREATE INDEX t_dt ON tran(dtime);\n"
-"\n"
-"/* arch table */\n"
-"/* Contains archived transactions. */\n"
-"CREATE TABLE arch (\n"
-"  num INTEGER,\n"
-"  cat_num INTEGER,\n"
-"  dtime CHAR (20),\n"
-"  amt CHAR (25),\n"
-"  status CHAR (4) CHECK (status IN ('ARCH','EDIT','FARC','NPST','PSTD','RMVD')),\n"
-"  to_who VARCHAR (256),\n"
-"  comment VARCHAR (256)\n"
-");\n"
-"CREATE INDEX a_num ON arch(num);\n"
-"CREATE INDEX a_dt ON arch(dtime);\n"
-"\n"
-"/* act table */\n"
-"/* Contains activity information, like a journal. */\n"
-"CREATE TABLE act (\n"
-"  type CHAR(4) CHECK (type IN ('ARC','CAT','EDT','RMV','TRN')),\n"
-"  cat_num INTEGER,\n"
-"  tran_num INTEGER,\n"
-"  dtime CHAR(20),\n"
-"  amt CHAR(25),\n"
-"  to_who VARCHAR (256),\n"
-"  comment VARCHAR (256)\n"
-");\n"
-"-- INSERT INTO act VALUES ('CAT',1,NULL,datetime('now','localtime'),NULL,'overflow','Added cat 1, the overflow category.');\n"
-"CREATE INDEX ct_dt ON act(dtime);\n"
+SQL_SCHEMA
+SQL_CHECKPOINT_SCHEMA
+SQL_INDEX_SCHEMA
+"PRAGMA user_version = " XSTR(SCHEMA_VERSION) ";\n"
 "COMMIT;\n";
 
+/*
+ * Schema version 0 kept amounts as text.  Move the old tables aside, build the current ones and copy everything across,
+ * converting the amounts to cents.  This runs inside migrate_db()'s transaction.
+ */
+static char *SQLMigrate1String =
+"DROP INDEX IF EXISTS c_dt;\n"
+"DROP INDEX IF EXISTS c_cnm;\n"
+"DROP INDEX IF EXISTS t_dt;\n"
+"DROP INDEX IF EXISTS a_num;\n"
+"DROP INDEX IF EXISTS a_dt;\n"
+"DROP INDEX IF EXISTS ct_dt;\n"
+"ALTER TABLE cat RENAME TO v0_cat;\n"
+"ALTER TABLE tran RENAME TO v0_tran;\n"
+"ALTER TABLE arch RENAME TO v0_arch;\n"
+"ALTER TABLE act RENAME TO v0_act;\n"
+SQL_SCHEMA
+"INSERT INTO cat SELECT num,dtime,name,bgt_cents(amt),comment FROM v0_cat;\n"
+"INSERT INTO tran SELECT num,cat_num,dtime,bgt_cents(amt),status,to_who,comment FROM v0_tran;\n"
+"INSERT INTO arch SELECT num,cat_num,dtime,bgt_cents(amt),status,to_who,comment FROM v0_arch;\n"
+"INSERT INTO act SELECT type,cat_num,tran_num,dtime,bgt_cents(amt),to_who,comment FROM v0_act;\n"
+"DROP TABLE v0_cat;\n"
+"DROP TABLE v0_tran;\n"
+"DROP TABLE v0_arch;\n"
+"DROP TABLE v0_act;\n"
+"PRAGMA user_version = 1;\n";
+
+/*
+ * Schema version 2 adds the balance checkpoints.  A database starts with none; the next recalc or posting writes one.
+ */
+static char *SQLMigrate2String =
+SQL_CHECKPOINT_SCHEMA
+"PRAGMA user_version = 2;\n";
+
+/*
+ * Schema version 3 adds indexes for the posting, the reports and the category queries.
+ */
+static char *SQLMigrate3String =
+SQL_INDEX_SCHEMA
+"PRAGMA user_version = 3;\n";
+
 /*
  * do_initialize
  *
@@ -816,2524 +1392,4062 @@ static int do_initialize (void)
 }
 
 /*
- * get_cat_num_from_name
+ * sql_bgt_cents
  *
- * This function gets the category number when the caller provides the category name.
+ * The bgt_cents(AMT) SQL function.  It turns an amount as the user types it into integer cents, the way bc would read it.
  */
-static int get_cat_num_from_name (char *name)
+static void sql_bgt_cents (sqlite3_context *ctx, int argc, sqlite3_value **argv)
 {
-  char *errmsg = 0;
-  c_item *c;
-  int ret;
-  char tmp[SIZE_ARB+1];
+  long long cents;
+  const char *amt;
 
-  if (is_query) {
-    printf ("\n***Error: in get_cat_num_from_name (), line %d: Called when is_query is TRUE\n", __LINE__);
-    return -1;
-  }
-  snprintf (tmp, SIZE_ARB, "SELECT num FROM cat WHERE name = '%s';", name);
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in get_cat_num_from_name(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
+  if (argc != 1 || sqlite3_value_type (argv[0]) == SQLITE_NULL) {
+    sqlite3_result_null (ctx);
+    return;
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    del_cb_data();
-    return -1;
+  if (sqlite3_value_type (argv[0]) == SQLITE_INTEGER) {
+    /* already cents */
+    sqlite3_result_int64 (ctx, sqlite3_value_int64 (argv[0]));
+    return;
   }
-  if (c_head->num_items != 1) {
-    printf ("\n***Error: in get_cat_num_from_name(), line %d, c_head->num_items = %d for query '%s'\n",  __LINE__, c_head->num_items, tmp);
-    return -1;
+  amt = (const char *)sqlite3_value_text (argv[0]);
+  if (amt == 0 || bcmoney_cents (amt, &cents) != 0) {
+    sqlite3_result_error (ctx, "bgt_cents(): amount is too large to store", -1);
+    return;
   }
-  c = c_head->next;
-  ret = atoi (c->item[0]);
-  del_cb_data();
-  return ret;
+  sqlite3_result_int64 (ctx, (sqlite3_int64)cents);
 }
 
 /*
- * get_cat_num_from_name
+ * sql_bgt_amt
  *
- * This function gets the category number when the caller provides the category name.
+ * The bgt_amt(CENTS) SQL function.  It formats integer cents the same way the balances always have been printed.
  */
-static int get_cat_name_from_num (int num, char *name)
+static void sql_bgt_amt (sqlite3_context *ctx, int argc, sqlite3_value **argv)
 {
-  char *errmsg = 0;
-  int ret;
-  c_item *c;
-  char tmp[SIZE_ARB+1];
+  char buf[SIZE_AMT+1];
 
-  if (is_query) {
-    printf ("\n***Error: in get_cat_num_from_name (), line %d: Called when is_query is TRUE\n", __LINE__);
-    return -1;
-  }
-  snprintf (tmp, SIZE_ARB, "SELECT name FROM cat WHERE num = '%d';", num);
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in get_cat_num_from_name(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    del_cb_data();
-    return -1;
+  if (argc != 1 || sqlite3_value_type (argv[0]) == SQLITE_NULL) {
+    sqlite3_result_null (ctx);
+    return;
   }
-  if (c_head->num_items != 1) {
-    printf ("\n***Error: in get_cat_num_from_name(), line %d, c_head->num_items = %d for query '%s'\n",  __LINE__, c_head->num_items, tmp);
-    return -1;
+  if (bcmoney_fmt ((long long)sqlite3_value_int64 (argv[0]), buf, SIZE_AMT+1) == 0) {
+    sqlite3_result_error (ctx, "bgt_amt(): could not format the amount", -1);
+    return;
   }
-  c = c_head->next;
-  strcpy (name, c->item[0]);
-  del_cb_data();
-  return 0;
+  sqlite3_result_text (ctx, buf, -1, SQLITE_TRANSIENT);
 }
 
 /*
- * Get_next_cat_num
+ * set_profile
  *
- * This function gets the next category number.  It grabs max(num) from the table, and adds one to it.
+ * This function applies the durability profile named by --profile, or else by BGT_PROFILE, to opt->db.  The default is safe.  The
+ * journal mode is kept in bgt.db, so it can only change while no other connection has the database open; if it can't, bgt says
+ * so and carries on in the mode the database is in.
  */
-static int get_next_cat_num (void)
+static int set_profile (void)
 {
+  const db_profile *p;
+  const char *name;
+  const char *mode;
+  sqlite3_stmt *stmt;
+  char tmp[SIZE_ARB+1];
   char *errmsg = 0;
-  c_item *c;
+  int len;
   int ret;
-  char tmp[SIZE_ARB+1];
 
-  if (is_query) {
-    printf ("\n***Error: in get_next_cat_num (), line %d: Called when is_query is TRUE\n", __LINE__);
+  name = opt->profile[0] != '\0' ? opt->profile : getenv ("BGT_PROFILE");
+  if (name == 0 || *name == '\0')
+    name = "safe";
+  for (p = db_profiles; p->name != 0; p++)
+    if (strcasecmp (p->name, name) == 0)
+      break;
+  if (p->name == 0) {
+    printf ("\n***Error in set_profile(), line %d: Unknown profile '%s'; use safe, wal or fast\n", __LINE__, name);
     return -1;
   }
-  snprintf (tmp, SIZE_ARB, "SELECT MAX(num) FROM cat;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
+  len = snprintf (tmp, SIZE_ARB, "PRAGMA synchronous = %s;", p->synchronous);
+  if (p->mmap_size != 0)
+    len += snprintf (tmp + len, SIZE_ARB - len, "PRAGMA mmap_size = %lld;", p->mmap_size);
+  if (p->cache_size != 0)
+    len += snprintf (tmp + len, SIZE_ARB - len, "PRAGMA cache_size = %d;", p->cache_size);
+  if (p->temp_store != 0)
+    snprintf (tmp + len, SIZE_ARB - len, "PRAGMA temp_store = %s;", p->temp_store);
+  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg);
   if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in get_next_cat_num(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+    printf ("\n***Error in set_profile(), line %d: SQLite Error setting the %s profile: %s\n", __LINE__, p->name, errmsg);
     sqlite3_free (errmsg);
-    del_cb_data();
     return -1;
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    del_cb_data();
-    return 1;
-  }
-  if (c_head->num_items != 1) {
-    printf ("\n***Error: in get_next_cat_num(), line %d, c_head->num_items = %d for query '%s'\n",  __LINE__, c_head->num_items, tmp);
+  /* PRAGMA journal_mode answers with the mode the database ended up in */
+  snprintf (tmp, SIZE_ARB, "PRAGMA journal_mode = %s;", p->journal_mode);
+  ret = sqlite3_prepare_v2 (opt->db, tmp, -1, &stmt, 0);
+  if (ret != SQLITE_OK) {
+    printf ("\n***Error in set_profile(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, sqlite3_errmsg (opt->db));
     return -1;
   }
-  c = c_head->next;
-  if (c->item[0] == 0)
-    ret = 0;
-  else
-    ret = atoi (c->item[0]);
-  ret++;
-  del_cb_data();
-  return ret;
+  ret = sqlite3_step (stmt);
+  mode = ret == SQLITE_ROW ? (const char *)sqlite3_column_text (stmt, 0) : 0;
+  if (mode == 0 || strcasecmp (mode, p->journal_mode) != 0)
+    printf ("\n***Warning in set_profile(), line %d: %s stays in %s journal mode; another connection may have it open\n", __LINE__,
+        opt->db_name, mode != 0 ? mode : "its");
+  sqlite3_finalize (stmt);
+  return 0;
 }
 
 /*
- * get_next_tran_num
+ * migrate_db
  *
- * This function gets the next transaction number.  It grabs max(tran_num) from the table and adds one to it.
+ * This function registers bgt's SQL functions on opt->db and brings an older database up to SCHEMA_VERSION in place.
+ * The whole upgrade is one transaction, so an interrupted migration leaves the old database untouched.
  */
-static int get_next_tran_num (void)
+static int migrate_db (void)
 {
-  char *errmsg = 0;
-  c_item *c;
   int ret;
-  char tmp[SIZE_ARB+1];
+  int version;
+  char *errmsg = 0;
+  sqlite3_stmt *stmt;
 
-  if (is_query) {
-    printf ("\n***Error: in get_next_tran_num (), line %d: Called when is_query is TRUE\n", __LINE__);
+  ret = sqlite3_create_function (opt->db, "bgt_cents", 1, SQLITE_UTF8, 0, sql_bgt_cents, 0, 0);
+  if (ret == SQLITE_OK)
+    ret = sqlite3_create_function (opt->db, "bgt_amt", 1, SQLITE_UTF8, 0, sql_bgt_amt, 0, 0);
+  if (ret != SQLITE_OK) {
+    printf ("\n***Error in migrate_db(), line %d: Can't register the bgt SQL functions: %s\n", __LINE__, sqlite3_errmsg (opt->db));
+    return -1;
+  }
+  ret = sqlite3_prepare_v2 (opt->db, "PRAGMA user_version;", -1, &stmt, 0);
+  if (ret != SQLITE_OK) {
+    printf ("\n***Error in migrate_db(), line %d: Can't read the schema version: %s\n", __LINE__, sqlite3_errmsg (opt->db));
     return -1;
   }
-  snprintf (tmp, SIZE_ARB, "SELECT MAX(num) FROM tran;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
+  version = 0;
+  if (sqlite3_step (stmt) == SQLITE_ROW)
+    version = sqlite3_column_int (stmt, 0);
+  sqlite3_finalize (stmt);
+  if (version >= SCHEMA_VERSION)
+    return 0;
+
+  ret = sqlite3_exec (opt->db, "BEGIN IMMEDIATE TRANSACTION;", 0, 0, &errmsg);
   if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in get_next_tran_num(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+    printf ("\n\n***Error in migrate_db(), line %d: SQLite Error starting the migration: %s\n", __LINE__, errmsg);
     sqlite3_free (errmsg);
-    del_cb_data();
     return -1;
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    del_cb_data();
-    return 1;
+  if (version < 1) {
+    ret = sqlite3_exec (opt->db, SQLMigrate1String, 0, 0, &errmsg);
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in migrate_db(), line %d: SQLite Error migrating %s to schema version 1: %s\n", __LINE__, opt->db_name, errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_exec (opt->db, "ROLLBACK;", 0, 0, 0);
+      return -1;
+    }
   }
-  if (c_head->num_items != 1) {
-    printf ("\n***Error: in get_next_tran_num(), line %d, c_head->num_items = %d for query '%s'\n",  __LINE__, c_head->num_items, tmp);
-    return -1;
+  if (version < 2) {
+    ret = sqlite3_exec (opt->db, SQLMigrate2String, 0, 0, &errmsg);
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in migrate_db(), line %d: SQLite Error migrating %s to schema version 2: %s\n", __LINE__, opt->db_name, errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_exec (opt->db, "ROLLBACK;", 0, 0, 0);
+      return -1;
+    }
   }
-  c = c_head->next;
-  if (c->item[0] == 0)
-    ret = 0;
-  else
-    ret = atoi (c->item[0]);
-  ret++;
-  del_cb_data();
-  return ret;
+  if (version < 3) {
+    ret = sqlite3_exec (opt->db, SQLMigrate3String, 0, 0, &errmsg);
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in migrate_db(), line %d: SQLite Error migrating %s to schema version 3: %s\n", __LINE__, opt->db_name, errmsg);
+      sqlite3_free (errmsg);
+      sqlite3_exec (opt->db, "ROLLBACK;", 0, 0, 0);
+      return -1;
+    }
+  }
+  ret = sqlite3_exec (opt->db, "COMMIT;", 0, 0, &errmsg);
+  if (ret != SQLITE_OK) {
+    printf ("\n\n***Error in migrate_db(), line %d: SQLite Error committing the migration: %s\n", __LINE__, errmsg);
+    sqlite3_free (errmsg);
+    sqlite3_exec (opt->db, "ROLLBACK;", 0, 0, 0);
+    return -1;
+  }
+  if (! opt->is_quiet)
+    printf ("Upgraded %s from schema version %d to %d\n", opt->db_name, version, SCHEMA_VERSION);
+  return 0;
 }
 
 /*
- * verify_number
+ * get_cat_num_from_name
  *
- * This function verifies a number.
+ * This function gets the category number when the caller provides the category name.  The answer comes from the category registry,
+ * so after the first call this doesn't touch SQLite.
  */
-static inline int verify_number (const char *num)
+static int get_cat_num_from_name (char *name)
 {
-  int i = 0;
-  int saw_period = FALSE;
-  /* first char must be -, + or a digit */
-  if (num[0] != '-' && num[0] != '+' && ! isdigit (num[0])) {
-    printf ("\n***Error in verify_number(), line %d: invalid number '%s'\n", __LINE__, num);
-    return FALSE;
+  cat_ls *cl;
+
+  if (cat_load ())
+    return -1;
+  cl = cat_find_name (name);
+  if (cl == 0)
+    return -1;
+  return cl->cat;
+}
+
+/*
+ * get_cat_name_from_num
+ *
+ * This function gets the category name when the caller provides the category number.  Like get_cat_num_from_name(), it is answered
+ * from the category registry.
+ */
+static int get_cat_name_from_num (int num, char *name)
+{
+  cat_ls *cl;
+
+  if (cat_load ())
+    return -1;
+  cl = cat_find_num (num);
+  if (cl == 0)
+    return -1;
+  strcpy (name, cl->name);
+  return 0;
+}
+
+/*
+ * get_next_num
+ *
+ * This function runs one of the SELECT MAX(num) statements and adds one to what it gets back.  An empty table starts at 1.
+ */
+static int get_next_num (stmt_id id)
+{
+  sqlite3_stmt *stmt;
+  int ret;
+
+  stmt = stmt_get (id);
+  if (stmt == 0)
+    return -1;
+  ret = sqlite3_step (stmt);
+  if (ret == SQLITE_DONE)
+    return 1;
+  if (ret != SQLITE_ROW) {
+    printf ("\n\n***Error in get_next_num(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[id], sqlite3_errmsg (opt->db));
+    return -1;
   }
-  while (num[i] != '\0') {
-    /* must be digits and 1 or 0 period from now on */
-    i++;
-    if (num[i] == '.') {
-      if (saw_period == TRUE) {
-        printf ("\n***Error in verify_number(), line %d: number has two '.' in it: '%s'\n", __LINE__, num);
-        return FALSE;
-      }
-      saw_period = TRUE;
-      continue;
-    }
-    if (isdigit (num[i]))
-      continue;
-    if (num[i] == '\0')
-      continue;
-    /* shouldn't get here */
-    printf ("\n***Error in verify_number(), line %d: number has invalid char %c: %s\n", __LINE__, num[i], num);
-    return FALSE;
+  ret = sqlite3_column_int (stmt, 0) + 1;
+  sqlite3_reset (stmt);
+  return ret;
+}
+
+/*
+ * Get_next_cat_num
+ *
+ * This function gets the next category number.  It grabs max(num) from the table, and adds one to it.
+ */
+static int get_next_cat_num (void)
+{
+  return get_next_num (STMT_MAX_CAT);
+}
+
+/*
+ * get_next_tran_num
+ *
+ * This function gets the next transaction number.  It grabs max(tran_num) from the table and adds one to it.
+ */
+static int get_next_tran_num (void)
+{
+  return get_next_num (STMT_MAX_TRAN);
+}
+
+/*
+ * cat_hash
+ *
+ * FNV-1a over a category name, for the by_name index.
+ */
+static unsigned int cat_hash (const char *name)
+{
+  unsigned int h = 2166136261U;
+
+  while (*name) {
+    h ^= (unsigned char)*name++;
+    h *= 16777619U;
   }
-  return TRUE;
+  return h;
 }
 
-static qifItem *parseQIFItem (char *rqda[], const char *file, int lnctr)
+/*
+ * cat_rehash
+ *
+ * This function rebuilds the by_name index with size buckets.  size has to be a power of two.  The first category with a given name
+ * wins, the same as the old SELECT did.
+ */
+static int cat_rehash (int size)
 {
-  qifItem *qi;
-  int i, j, mon, day, year;
-  char *cp;
-  char buf[10];
-  int splitNum = 0;
+  cat_reg *reg = &opt->cats;
+  int *tbl;
+  unsigned int h;
+  int i;
 
-  if (rqda[0][0] == '\0')
-    return 0;
-  qi = malloc (sizeof (qifItem));
-  if (qi == 0) {
-    printf ("\n\n***Error: fatal memory error allocating a qifItem\n");
-    return 0;
+  tbl = malloc (size * sizeof (int));
+  if (tbl == 0) {
+    printf ("\n***Error in cat_rehash(), line %d: Allocating %d buckets for the category index.\n", __LINE__, size);
+    return -1;
   }
-  memset (qi, 0, sizeof (qifItem));
-  /*check_pointer (qi);*/
-  for (i = 0; i < QIF_SIZE_RQDA && rqda[i][0] != '\0'; i++) {
-    switch (rqda[i][0]) {
-      case 'D':
-        /* parse the date */
-        // Stupid qif date formats.  <sigh>
-        // Date can be DD.MM.YYYY or M[M]/D[D]/[YY]YY or M[M]/D[D]'[ |Y]Y
-        // DD.MM.YYYY - I needed this because I couldn't get kmymoney to generate a better date format.
-        // Your mileage may vary.
-        cp = strchr (&rqda[i][1], '.');
-        if (cp != 0) {
-          cp = &rqda[i][1];
-          for (j = 0; *cp != '.' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          day = atoi (buf);
-            if (day < 1 || day > 31) {
-            goto BrokenDate;
-          }
-          if (*cp != '.')
-            goto BrokenDate;
-          cp++;
-          for (j = 0; *cp != '.' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          mon = atoi (buf);
-          if (mon < 1 || mon > 12)
-            goto BrokenDate;
-            if (*cp != '.')
-            goto BrokenDate;
-          cp++;
-          for (j = 0; *cp != '\0' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-        buf[j] = '\0';
-          year = atoi (buf);
-          if (year < 1900 || year > 2025)
-            goto BrokenDate;
-          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
-          goto GoodDate;
-        }
-        cp = strchr (rqda[i], '\'');
-        if (cp == 0) {
-          /* old date format M[M]/D[D]/[YY]YY*/
-          cp = &rqda[i][1];
-          for (j = 0; *cp != '/' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          mon = atoi (buf);
-          if (mon < 1 || mon > 12) {
-            goto BrokenDate;
-          }
-          if (*cp != '/')
-            goto BrokenDate;
-          cp++;
-          for (j = 0; *cp != '/' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          day = atoi (buf);
-          if (day < 1 || day > 31)
-            goto BrokenDate;
-          if (*cp != '/')
-            goto BrokenDate;
-          cp++;
-          for (j = 0; *cp != '\0' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          year = atoi (buf);
-          if (year >= 50 && year < 100)
-            year += 1900;
-          else if (year > 1 && year < 50)
-            year += 2000;
-          if (year < 1900 || year > 2025)
-            goto BrokenDate;
-          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
-          goto GoodDate;
-        }
-        else {
-          /* newer date format M[M]/D[D]'[ |Y]Y */
-          buf[0] = '2';
-          buf[1] = '0';
-          if (*(cp+1) == ' ')
-            buf[2] = '0';
-          else
-            buf[2] = *(cp+1);
-          buf[3] = *(cp+2);
-          buf[4] = '\0';
-          year = atoi(buf);
-          if (year < 1900 || year > 2025)
-            goto BrokenDate;
-          cp = &rqda[i][1];
-          for (j = 0; *cp != '/' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          mon = atoi (buf);
-          if (mon < 1 || mon > 12) {
-            goto BrokenDate;
-          }
-          if (*cp != '/')
-            goto BrokenDate;
-          cp++;
-          for (j = 0; *cp != '/' && j < 9; j++) {
-            buf[j] = *cp;
-            cp++;
-          }
-          buf[j] = '\0';
-          day = atoi (buf);
-          if (day < 1 || day > 31)
-            goto BrokenDate;
-          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
-          goto GoodDate;
-        }
+  for (i = 0; i < size; i++)
+    tbl[i] = -1;
+  for (i = 0; i < reg->num_cats; i++) {
+    for (h = cat_hash (reg->cats[i].name) & (size - 1); tbl[h] != -1; h = (h + 1) & (size - 1))
+      if (! strcmp (reg->cats[tbl[h]].name, reg->cats[i].name))
+        break;
+    if (tbl[h] == -1)
+      tbl[h] = i;
+  }
+  free (reg->by_name);
+  reg->by_name = tbl;
+  reg->name_size = size;
+  return 0;
+}
 
+/*
+ * cat_find_num
+ *
+ * This function returns the registry entry for category number num, or 0 if there isn't one.
+ */
+static cat_ls *cat_find_num (int num)
+{
+  cat_reg *reg = &opt->cats;
 
-BrokenDate:
-        printf ("***Warning: parse error on date \"%s\" ", &rqda[i][1]);
-        printf (": ignoring qif item\n");
-        free (qi);
-        return 0;
+  if (num < 0 || num >= reg->max_num || reg->by_num[num] == -1)
+    return 0;
+  return &reg->cats[reg->by_num[num]];
+}
 
-GoodDate:
-        break;
-      case 'U':;
+/*
+ * cat_find_name
+ *
+ * This function returns the registry entry for the category called name, or 0 if there isn't one.
+ */
+static cat_ls *cat_find_name (const char *name)
+{
+  cat_reg *reg = &opt->cats;
+  unsigned int h;
 
-        /* amt of first transaction - ignore it */
-        snprintf (qi->ftran, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
-        break;
-      case 'T':
-        /* get the amount */
-        // snprintf (qi->tran, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
-        cp = &rqda[i][1];
-        for (j = 0; j < QIF_SIZE_TRAN && *cp != '\0'; j++, cp++) {
-          if (*cp == ',') {
-            cp++;
-          }
-          qi->tran[j] = *cp;
-        }
-        qi->tran[j] = '\0';
-        break;
-      case 'C':
-        /* cleared status - ignore it */
-        break;
-      case 'P':
-        /* get the payee */
-        snprintf (qi->payee, QIF_SIZE_PAYEE, "%s", &rqda[i][1]);
-        break;
-      case 'M':
-        /* get the memo */
-        snprintf (qi->memo, QIF_SIZE_DESC, "%s", &rqda[i][1]);
-        break;
-      case 'L':
-        /* get the category */
-        snprintf (qi->category, QIF_SIZE_CAT, "%s", &rqda[i][1]);
-        break;
-      case 'N':
-        /* get the check number */
-        snprintf (qi->check, QIF_SIZE_CHECK, "%s", &rqda[i][1]);
-        break;
-      case 'E':
-        /* comment in split - ignore it */
-        break;
-      case 'R':
-        /* ignore it */
-        break;
-      case 'I':
-        /* ignore it */
-        break;
-      case 'B':
-        /* ignore it */
-        break;
-      case 'S':
-        /* process split rqda with S and $ prefixes */
-        qi->isSplit = TRUE;
-        qi->sia[splitNum] = malloc (sizeof (splitItem));
-        memset (qi->sia[splitNum], 0, sizeof (splitItem)); 
-        snprintf (qi->sia[splitNum]->split_cat, QIF_SIZE_CAT, "%s", &rqda[i][1]);
-        i++;
-        if (i >= QIF_SIZE_RQDA || rqda[i][0] == '\0') {
-          free (qi->sia[splitNum]);
-          qi->sia[splitNum] = 0;
-        }
-        else {
-          if (rqda[i][0] == 'E')
-            i++;
-          snprintf (qi->sia[splitNum]->amt, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
-        }
-        splitNum++;
-        break;
-      default:
-        /* unrecognized - just ignore it */
-        printf ("\n***Warning: qif file \"%s\", had an "
-            "unrecognized Bank item near line %d: %s\n",
-            file, lnctr, rqda[i]);
-        break;
+  if (reg->name_size == 0)
+    return 0;
+  for (h = cat_hash (name) & (reg->name_size - 1); reg->by_name[h] != -1; h = (h + 1) & (reg->name_size - 1))
+    if (! strcmp (reg->cats[reg->by_name[h]].name, name))
+      return &reg->cats[reg->by_name[h]];
+  return 0;
+}
+
+/*
+ * cat_add
+ *
+ * This function puts a category into the registry and returns its entry, or 0 if it runs out of memory.  Entries can move when the
+ * registry grows, so don't hold on to one across a call to cat_add().
+ */
+static cat_ls *cat_add (int num, const char *dtime, const char *name, long long cents)
+{
+  cat_reg *reg = &opt->cats;
+  cat_ls *cl;
+  void *p;
+  unsigned int h;
+  int n;
+
+  if (num < 0) {
+    printf ("\n***Error in cat_add(), line %d: Invalid category number %d\n", __LINE__, num);
+    return 0;
+  }
+  if (num < reg->max_num && reg->by_num[num] != -1)
+    return &reg->cats[reg->by_num[num]];
+  if (reg->num_cats == reg->max_cats) {
+    n = reg->max_cats ? reg->max_cats * 2 : 64;
+    p = realloc (reg->cats, n * sizeof (cat_ls));
+    if (p == 0) {
+      printf ("\n***Error in cat_add(), line %d: Allocating memory for %d categories.\n", __LINE__, n);
+      return 0;
+    }
+    reg->cats = p;
+    reg->max_cats = n;
+  }
+  if (num >= reg->max_num) {
+    n = reg->max_num ? reg->max_num : 64;
+    while (n <= num)
+      n *= 2;
+    p = realloc (reg->by_num, n * sizeof (int));
+    if (p == 0) {
+      printf ("\n***Error in cat_add(), line %d: Allocating memory for %d categories.\n", __LINE__, n);
+      return 0;
     }
+    reg->by_num = p;
+    while (reg->max_num < n)
+      reg->by_num[reg->max_num++] = -1;
   }
-  /* OK, we've got the rqda in the form of a qifParser; process it */
-  return qi;
+  /* keep the hash at most half full */
+  if ((reg->num_cats + 1) * 2 > reg->name_size && cat_rehash (reg->name_size ? reg->name_size * 2 : 128))
+    return 0;
+  cl = &reg->cats[reg->num_cats];
+  memset (cl, 0, sizeof (cat_ls));
+  cl->cat = num;
+  strncpy (cl->dtime, dtime, SIZE_TSTMP);
+  strncpy (cl->name, name, FIELD_ARB);
+  cl->cents = cents;
+  bcmoney_fmt (cents, cl->amt, SIZE_AMT+1);
+  reg->by_num[num] = reg->num_cats;
+  for (h = cat_hash (cl->name) & (reg->name_size - 1); reg->by_name[h] != -1; h = (h + 1) & (reg->name_size - 1))
+    if (! strcmp (reg->cats[reg->by_name[h]].name, cl->name))
+      break;
+  if (reg->by_name[h] == -1)
+    reg->by_name[h] = reg->num_cats;
+  reg->num_cats++;
+  return cl;
 }
 
 /*
- * do_add
+ * cat_load
  *
- * This function adds a transaction.
+ * This function fills the registry from the cat table.  It only goes to SQLite the first time; after that the registry is kept in
+ * step with the database by the functions that change it.
  */
-static int do_add (void)
+static int cat_load (void)
 {
-  char *errmsg = 0;
+  cat_reg *reg = &opt->cats;
+  sqlite3_stmt *stmt;
+  const char *dtime;
+  const char *name;
   int ret;
-  int cat;
-  int tran_num;
-  char tmp[SIZE_ARB+1];
-  char catt[FIELD_ARB+1];
+  int i;
 
-  if (! opt->is_amt) {
-    printf ("\n***Error in do_add(), line %d: no amount entered on the command-line\n", __LINE__);
-    return -1;
-  }
-  if (! opt->is_cat && ! opt->catt) {
-    printf ("\n***Error in do_add(), line %d: no category entered on the command-line\n", __LINE__);
+  if (reg->loaded)
+    return 0;
+  reg->num_cats = 0;
+  for (i = 0; i < reg->max_num; i++)
+    reg->by_num[i] = -1;
+  for (i = 0; i < reg->name_size; i++)
+    reg->by_name[i] = -1;
+  stmt = stmt_get (STMT_CAT_LOAD);
+  if (stmt == 0)
     return -1;
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    dtime = (const char *)sqlite3_column_text (stmt, 1);
+    name = (const char *)sqlite3_column_text (stmt, 2);
+    if (cat_add (sqlite3_column_int (stmt, 0), dtime ? dtime : "", name ? name : "", sqlite3_column_int64 (stmt, 3)) == 0) {
+      sqlite3_reset (stmt);
+      return -1;
+    }
   }
-  if (! opt->is_to) {
-    printf ("\n***Error in do_add(), line %d: no To: field entered in transaction\n", __LINE__);
+  if (ret != SQLITE_DONE) {
+    printf ("\n\n***Error in cat_load(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CAT_LOAD], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
     return -1;
   }
-  if (! opt->is_cmt) {
-    printf ("\n***Error in do_add(), line %d: no comment entered in transaction\n", __LINE__);
+  reg->data_version = db_data_version ();
+  reg->posted = FALSE;
+  reg->reformat = FALSE;
+  reg->loaded = TRUE;
+  return 0;
+}
+
+/*
+ * cat_set_amt
+ *
+ * This function writes a category's balance from the registry back to the cat table.
+ */
+static int cat_set_amt (const cat_ls *cl)
+{
+  sqlite3_stmt *stmt;
+
+  stmt = stmt_get (STMT_SET_CAT_AMT);
+  if (stmt == 0)
     return -1;
-  }
+  sqlite3_bind_int64 (stmt, 1, cl->cents);
+  sqlite3_bind_int (stmt, 2, cl->cat);
+  return stmt_exec (stmt);
+}
 
-  if (opt->catt) {
-    cat = get_cat_num_from_name (opt->catt);
-    strcpy (catt, opt->catt);
-  }
-  else {
-    cat = opt->cat;
-    ret = get_cat_name_from_num (cat, catt);
-    if (ret == -1)
-      cat = -1;
-  }
-  if (cat == -1) {
-    printf ("\n***Error in do_add(), line %d: Invalid category name or number\n", __LINE__);
+/*
+ * cat_apply
+ *
+ * This function adds cents to a category's balance, in the registry and in the cat table.  func names the caller for the error
+ * message if the balance no longer fits.
+ */
+static int cat_apply (cat_ls *cl, long long cents, const char *func)
+{
+  bcmoney bal = BCMONEY_INIT;
+  bcmoney add = BCMONEY_INIT;
+  char amt[SIZE_AMT+1];
+
+  bal.cents = cl->cents;
+  add.cents = cents;
+  bcmoney_add (&bal, &add);
+  if (bal.big != 0) {
+    printf ("\n***Error in %s(), line %d: The balance of category %d is too large to store: %s\n", func, __LINE__, cl->cat,
+            bcmoney_str (&bal, amt, sizeof (amt)) ? amt : "?");
+    bcmoney_free (&bal);
     return -1;
   }
+  cl->cents = bal.cents;
+  bcmoney_fmt (cl->cents, cl->amt, SIZE_AMT+1);
+  return cat_set_amt (cl);
+}
 
-  ret = verify_number (opt->amt);
-  if (!ret)
-    return ret;
+/*
+ * tran_posted
+ *
+ * This function looks up a transaction.  If it has been posted, so its amount is in its category's balance, it fills in the
+ * category and the amount and returns 1.  It returns 0 if the transaction is not posted or not there, and -1 on error.
+ */
+static int tran_posted (int tran, int *cat, long long *cents)
+{
+  sqlite3_stmt *stmt;
+  const char *status;
+  int ret;
 
-  tran_num = get_next_tran_num ();
-  if (tran_num == -1)
+  stmt = stmt_get (STMT_TRAN_GET);
+  if (stmt == 0)
     return -1;
-
-  if (opt->is_date) {
-    opt->date[SIZE_TSTMP] = '\0';
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO tran VALUES (%d,%d,'%s','%s','NPST','%s','%s');\nCOMMIT;\n",
-        tran_num, cat, opt->date, opt->amt, opt->to, opt->cmt);
-  }
-  else {
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO tran VALUES (%d,%d,datetime('now','localtime'),'%s','NPST','%s','%s');\nCOMMIT;\n",
-        tran_num, cat, opt->amt, opt->to, opt->cmt);
-  }
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
-  }
-  if (opt->is_date) {
-    opt->date[SIZE_TSTMP] = '\0';
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('TRN',%d,%d,'%s','%s','%s','%s');\nCOMMIT;\n",
-        cat, tran_num, opt->date, opt->amt, opt->to, opt->cmt);
+  sqlite3_bind_int (stmt, 1, tran);
+  ret = sqlite3_step (stmt);
+  if (ret == SQLITE_DONE) {
+    sqlite3_reset (stmt);
+    return 0;
   }
-  else {
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('TRN',%d,%d,datetime('now','localtime'),'%s','%s','%s');\nCOMMIT;\n",
-        cat, tran_num, opt->amt, opt->to, opt->cmt);
+  if (ret != SQLITE_ROW) {
+    printf ("\n\n***Error in tran_posted(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_TRAN_GET], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
+    return -1;
   }
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
+  status = (const char *)sqlite3_column_text (stmt, 2);
+  ret = status != 0 && ! strcmp (status, "PSTD") && sqlite3_column_type (stmt, 0) != SQLITE_NULL;
+  if (ret) {
+    *cat = sqlite3_column_int (stmt, 0);
+    *cents = sqlite3_column_int64 (stmt, 1);
   }
-  printf ("Journalized %s for the %d (%s) category.\n", opt->amt, cat, catt);
-
-  return 0;
+  sqlite3_reset (stmt);
+  return ret;
 }
 
 /*
- * do_new_cat
+ * ckpt_count
  *
- * This function adds a category to a budget.
+ * This function returns the number of transactions numbered hwm or lower, or -1 on error.
  */
-static int do_new_cat (void)
+static int ckpt_count (int hwm)
 {
+  sqlite3_stmt *stmt;
   int ret;
-  int new_cat;
-  char *errmsg = 0;
-  char tmp[SIZE_ARB+1];
-  char tmp1[SIZE_ARB+1];
 
-  if (! opt->is_catt) {
-    printf ("\n***Error in do_new_cat (), line %d: Called without --catt having been entered.\n", __LINE__);
+  stmt = stmt_get (STMT_CKPT_COUNT);
+  if (stmt == 0)
     return -1;
-  }
-  ret = get_cat_num_from_name (opt->catt);
-  if (ret != -1) {
-    printf ("\n***Error in do_new_cat(), line %d: Trying to create a category with a name that already exists: '%s'\n", __LINE__, opt->catt);
+  sqlite3_bind_int (stmt, 1, hwm);
+  if (sqlite3_step (stmt) != SQLITE_ROW) {
+    printf ("\n\n***Error in ckpt_count(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CKPT_COUNT], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
     return -1;
   }
-  new_cat = get_next_cat_num ();
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO cat VALUES (%d, datetime('now','localtime'), '%s', '0.00', '%s');\nCOMMIT;\n", new_cat, opt->catt,
-      (opt->is_cmt ? opt->cmt : "Create a new Category."));
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_new_cat(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
-  }
-  snprintf (tmp1, SIZE_ARB, "Add cat %d, %s", new_cat, opt->catt);
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('CAT',%d,NULL,datetime('now','localtime'),NULL,'%s','%s');\nCOMMIT;\n", 
-      new_cat, opt->catt, tmp1);
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_new_cat(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
-  }
-  snprintf (tmp1, SIZE_ARB, "Created cat %d named '%s'\n", new_cat, opt->catt);
-  printf ("%s\n", tmp1);
-  return 0;
+  ret = sqlite3_column_int (stmt, 0);
+  sqlite3_reset (stmt);
+  return ret;
 }
 
 /*
- * do_cedit
+ * ckpt_find
  *
- * This function allows the user to edit a category.
+ * This function finds the latest balance checkpoint that still covers the transactions it was written from, which means the
+ * tran table still has as many transactions up to its high-water mark as it did then.  It sets hwm and count, or hwm to -1 if
+ * there is no such checkpoint.
  */
-#if 0
-static int do_cedit (void)
+static int ckpt_find (int *hwm, int *count)
 {
+  sqlite3_stmt *stmt;
   int ret;
-  int new_cat;
-  char *errmsg = 0;
-  char tmp[SIZE_ARB+1];
-  char tmp1[SIZE_ARB+1];
+  int n;
 
-  if (! opt->is_cat) {
-    printf ("\n***Error in do_cedit (), line %d: Called without --cat having been entered.\n", __LINE__);
+  *hwm = -1;
+  *count = 0;
+  stmt = stmt_get (STMT_CKPT_LIST);
+  if (stmt == 0)
     return -1;
-  }
-  if (opt->is_catt) {
-    ret = get_cat_num_from_name (opt->catt);
-    if (ret != -1) {
-      printf ("\n***Error in do_cedit(), line %d: Trying to update a category with a name that already exists: '%s'\n", __LINE__, opt->catt);
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    n = ckpt_count (sqlite3_column_int (stmt, 0));
+    if (n < 0) {
+      sqlite3_reset (stmt);
       return -1;
     }
+    if (n == sqlite3_column_int (stmt, 1)) {
+      *hwm = sqlite3_column_int (stmt, 0);
+      *count = n;
+      break;
+    }
   }
-  // FIXME
-  // Continue here
-  // FIXME
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO cat VALUES (%d, datetime('now','localtime'), '%s', '0.00', '%s');\nCOMMIT;\n", new_cat, opt->catt,
-      (opt->is_cmt ? opt->cmt : "Create a new Category."));
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_cedit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
-  }
-  snprintf (tmp1, SIZE_ARB, "Add cat %d, %s", new_cat, opt->catt);
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('CAT',%d,NULL,datetime('now','localtime'),NULL,'%s','%s');\nCOMMIT;\n", 
-      new_cat, opt->catt, tmp1);
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_cedit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
+  if (ret != SQLITE_ROW && ret != SQLITE_DONE) {
+    printf ("\n\n***Error in ckpt_find(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CKPT_LIST], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
+    return -1;
   }
-  snprintf (tmp1, SIZE_ARB, "Updated cat %d named '%s'\n", new_cat, opt->catt);
-  printf ("%s\n", tmp1);
+  sqlite3_reset (stmt);
   return 0;
 }
-#endif
-
-typedef struct _tran_dat {
-  int num;
-  int cat_num;
-  char dtime[SIZE_TSTMP+1];
-  char amt[SIZE_AMT+1];
-} tran_dat;
 
 /*
- * do_post
+ * ckpt_load
  *
- * This function posts transactions.  If recalc is 0, only the transactions that haven't been posted before get changed.  If recalc is 1, do_post
- * recalculates everything from the beginning of the trans table.
+ * This function adds the balances of the checkpoint at hwm to the categories in the registry.
  */
-static int do_post (int recalc)
+static int ckpt_load (int hwm)
 {
-  char *errmsg = 0;
-  c_item *c;
+  sqlite3_stmt *stmt;
+  cat_ls *cl;
   int ret;
-  int i;
-  int num_cats;
-  int num_trans;
-  char tmp[SIZE_ARB+1];
-  char *cp;
-  tran_dat *td;
-  int cat_ary[MD_ARY];
 
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,amt FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_post(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
+  stmt = stmt_get (STMT_CKPT_LOAD);
+  if (stmt == 0)
     return -1;
+  sqlite3_bind_int (stmt, 1, hwm);
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    cl = cat_find_num (sqlite3_column_int (stmt, 0));
+    if (cl == 0)
+      continue;
+    cl->cents += sqlite3_column_int64 (stmt, 1);
+    bcmoney_fmt (cl->cents, cl->amt, SIZE_AMT+1);
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_post(), line %d: The SQL query '%s' generated no data and it should have.\n", __LINE__, tmp);
-    printf ("This probably means that the default bgt database has not been initialized properly.\n");
-    printf ("If there are no categories in the default budget, add some and try again.\n");
-    printf ("Worst case, remove the budget directory (rm -rf ~/.bgt) and try again.\n");
-    printf ("See the man page for more information.\n");
-    del_cb_data();
+  if (ret != SQLITE_DONE) {
+    printf ("\n\n***Error in ckpt_load(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CKPT_LOAD], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
     return -1;
   }
-  num_cats = c_head->num_items;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_post(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
-    }
-    opt->catList[cat].cat = cat;
-    strncpy (opt->catList[cat].dtime, c->item[1], SIZE_TSTMP);
-    strncpy (opt->catList[cat].name, c->item[2], FIELD_ARB);
-    if (recalc == 0)
-      /* posting - do not reset category amounts back to 0 */
-      strncpy (opt->catList[cat].amt, c->item[3], SIZE_AMT);
-    else
-      /* recalculating - reset category amounts back to 0 */
-      strcpy (opt->catList[cat].amt, "0.00");
-  }
-  del_cb_data();
-  /* now, let's grab the transactions that we need to process */
-  if (recalc == 0)
-    /* not doing a recalc - just grab what hasn't been posted yet. */
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt FROM tran WHERE status = 'NPST';");
-  else
-    /* doing a recalc - grab everything */
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt FROM tran;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_post(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
+  sqlite3_reset (stmt);
+  return 0;
+}
+
+/*
+ * ckpt_write
+ *
+ * This function writes a balance checkpoint at the last transaction.  Unless force is set, it only does so once CKPT_ROWS
+ * transactions have gone by since the latest checkpoint.  The new checkpoint is the latest good one plus the transactions after
+ * it, so it is summed from the tran table and not from the balances in the cat table.  Only the newest CKPT_KEEP are kept.
+ */
+static int ckpt_write (int force)
+{
+  sqlite3_stmt *stmt;
+  int last;
+  int prev;
+  int count;
+
+  /* the last transaction, and the latest checkpoint whether or not it is still good; both are cheap */
+  stmt = stmt_get (STMT_MAX_TRAN);
+  if (stmt == 0)
     return -1;
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    if (! opt->is_quiet)
-      printf ("\nNothing to post.\n");
-    del_cb_data();
+  last = sqlite3_step (stmt) == SQLITE_ROW && sqlite3_column_type (stmt, 0) != SQLITE_NULL ? sqlite3_column_int (stmt, 0) : -1;
+  sqlite3_reset (stmt);
+  stmt = stmt_get (STMT_CKPT_LIST);
+  if (stmt == 0)
+    return -1;
+  prev = sqlite3_step (stmt) == SQLITE_ROW ? sqlite3_column_int (stmt, 0) : -1;
+  sqlite3_reset (stmt);
+  if (last < 0 || last == prev || (! force && last - prev < CKPT_ROWS))
     return 0;
-  }
-  num_trans = c_head->num_items;
-  td = malloc (sizeof (tran_dat));
-  if (0 == td) {
-    printf ("\n***Error in do_post(), line %d: Fatal memory error allocating %d bytes.", __LINE__, sizeof (tran_dat));
-    del_cb_data();
-    return -1;
-  }
-  for (i = 0; i < MD_ARY; i++)
-    cat_ary[i] = 0;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    memset (td, 0, sizeof(tran_dat));
-    td->num = atoi (c->item[0]);
-    td->cat_num = atoi (c->item[1]);
-    strncpy (td->dtime, c->item[2], SIZE_TSTMP);
-    strncpy (td->amt, c->item[3], SIZE_AMT);
-    cp = bcnum_add (opt->catList[td->cat_num].amt, td->amt, 2);
-    strncpy (opt->catList[td->cat_num].amt, cp, SIZE_AMT);
-    /* flag the record in the transaction table as posted */
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET status = 'PSTD' WHERE num = %d AND status != 'PSTD';\nCOMMIT;\n", td->num);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_post(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    cat_ary[td->cat_num] = 1;
-  }
-  /* now, update the categories with the data that was entered */
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    if (cat_ary[i] == 0)
-      continue;
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE cat SET amt = '%s',dtime=datetime('now','localtime') WHERE num = %d;\nCOMMIT;\n", opt->catList[i].amt, opt->catList[i].cat);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_post(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-  }
-  if (! opt->is_quiet)
-    printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
-  return 0;
+
+  if (ckpt_find (&prev, &count))
+    return -1;
+  if (prev == last)
+    return 0;
+  count = ckpt_count (last);
+  if (count < 0)
+    return -1;
+  stmt = stmt_get (STMT_CKPT_WRITE);
+  if (stmt == 0)
+    return -1;
+  sqlite3_bind_int (stmt, 1, prev);
+  sqlite3_bind_int (stmt, 2, last);
+  if (stmt_exec (stmt))
+    return -1;
+  stmt = stmt_get (STMT_CKPT_MARK);
+  if (stmt == 0)
+    return -1;
+  sqlite3_bind_int (stmt, 1, last);
+  sqlite3_bind_int (stmt, 2, count);
+  if (stmt_exec (stmt))
+    return -1;
+  stmt = stmt_get (STMT_CKPT_PRUNE);
+  if (stmt == 0)
+    return -1;
+  sqlite3_bind_int (stmt, 1, CKPT_KEEP);
+  return stmt_exec (stmt);
 }
 
 /*
- * proc_nclr_file
+ * ckpt_drop
  *
- * This function opens an nclr file, parses it, and alters the totals according to what was in it.
+ * This function drops every checkpoint with a high-water mark of from or more.  Anything that changes transaction from calls it,
+ * since those checkpoints no longer add up.
  */
-static int proc_nclr_file (void)
+static int ckpt_drop (int from)
 {
-  nclr_dat *nd;
-  FILE *fp;
-  int lnctr = 0;
-  char *cp, *cp1;
-  int cat;
-  char line[SIZE_ARB+1];
+  sqlite3_stmt *stmt;
 
-  fp = fopen (opt->nclr, "rb");
-  if (fp == 0) {
-    printf ("\n***Warning in proc_nclr_file(), line %d: could not open %s to read.\n", __LINE__, opt->nclr);
-    printf ("\tNot processing nclr data.\n");
+  stmt = stmt_get (STMT_CKPT_DROP);
+  if (stmt == 0)
     return -1;
-  }
-  while (fgets (line, SIZE_ARB, fp) != 0) {
-    lnctr ++;
-    if (line[0] == '\n')
-      continue;
-    if (line[0] == '#')
-      continue;
-    if (line[0] == '/' && line[1] == '/')
-      continue;
-    nd = malloc (sizeof(nclr_dat));
-    if (nd == 0) {
-      printf ("\n***Warning in proc_nclr_file(), line %d: Allocating %d bytes of memory.\n", __LINE__, sizeof(nclr_dat));
-      printf ("\tNot processing nclr data.\n");
-      fclose (fp);
-      return -1;
-    }
-    memset (nd, 0, sizeof(nclr_dat));
-    cp = strchr (line, '\n');
-    if (0 != cp)
-      *cp = '\0';
-    cp1 = strchr (line, ':');
-    if (cp1 == 0) {
-      printf ("\n***Warning in proc_nclr_file(), line %d: Syntax error (no ':'), line %d, '%s'.\n", __LINE__, lnctr, line);
-      printf ("\tNot processing nclr data.\n");
-      free (nd);
-      do {
-        nd = ndlist;
-        ndlist = ndlist->next;
-        if (nd != 0)
-          free (nd);
-      } while (ndlist != NULL);
-      ndlist = 0;
-      fclose (fp);
-      return -1;
-    }
-    *cp1 = '\0';
-    cp = cp1+1;
-    if (verify_number (cp) == FALSE) {
-      printf ("\n***Warning in proc_nclr_file(), line %d: Invalid number in %s, line %d, '%s'\n", __LINE__, opt->nclr, lnctr, cp);
-      printf ("\tNot processing nclr data.\n");
-      do {
-        nd = ndlist;
-        ndlist = ndlist->next;
-        if (nd != 0)
-          free (nd);
-      } while (ndlist != NULL);
-      ndlist = 0;
-      fclose (fp);
+  sqlite3_bind_int (stmt, 1, from);
+  return stmt_exec (stmt);
+}
+
+/*
+ * ckpt_verify
+ *
+ * This function checks every checkpoint against the tran table, for --recalc --full.  A checkpoint that doesn't match is
+ * dropped, along with the ones after it, since they were built on it.
+ */
+static int ckpt_verify (void)
+{
+  sqlite3_stmt *stmt;
+  sqlite3_stmt *diff;
+  int ret;
+  int hwm;
+  int count;
+  int n;
+  int num_ckpts = 0;
+  int bad = -1;
+
+  stmt = stmt_get (STMT_CKPT_LIST);
+  if (stmt == 0)
+    return -1;
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    num_ckpts++;
+    hwm = sqlite3_column_int (stmt, 0);
+    count = ckpt_count (hwm);
+    diff = stmt_get (STMT_CKPT_DIFF);
+    if (count < 0 || diff == 0) {
+      sqlite3_reset (stmt);
       return -1;
     }
-    cat = get_cat_num_from_name (line);
-    if (cat == -1) {
-      printf ("\n***Warning in proc_nclr_file(), line %d: Invalid category name in %s, line %d, '%s'\n", __LINE__, opt->nclr, lnctr, cp);
-      printf ("\tNot processing nclr data.\n");
-      do {
-        nd = ndlist;
-        ndlist = ndlist->next;
-        if (nd != 0)
-          free (nd);
-      } while (ndlist != NULL);
-      ndlist = 0;
-      fclose (fp);
+    sqlite3_bind_int (diff, 1, hwm);
+    n = sqlite3_step (diff) == SQLITE_ROW ? sqlite3_column_int (diff, 0) : -1;
+    sqlite3_reset (diff);
+    if (n < 0) {
+      printf ("\n\n***Error in ckpt_verify(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CKPT_DIFF], sqlite3_errmsg (opt->db));
+      sqlite3_reset (stmt);
       return -1;
     }
-    nd->line = lnctr;
-    nd->cat = cat;
-    nd->next = 0;
-    strncpy (nd->amt, cp, SIZE_AMT);
-    if (ndlist == 0) {
-      ndlist = nd;
-      lastnd = nd;
-    }
-    else {
-      lastnd->next = nd;
-      lastnd = nd;
-    }
+    if (count != sqlite3_column_int (stmt, 1))
+      printf ("Checkpoint at transaction %d covered %d transactions; there are %d now\n", hwm, sqlite3_column_int (stmt, 1), count);
+    else if (n != 0)
+      printf ("Checkpoint at transaction %d does not match the transactions in %d categories\n", hwm, n);
+    else
+      continue;
+    bad = hwm;
   }
-  fclose (fp);
+  if (ret != SQLITE_DONE) {
+    printf ("\n\n***Error in ckpt_verify(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_CKPT_LIST], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
+    return -1;
+  }
+  sqlite3_reset (stmt);
+  if (bad >= 0 && ckpt_drop (bad))
+    return -1;
+  if (! opt->is_quiet)
+    printf ("Checked %d balance checkpoints: %s\n", num_ckpts, bad >= 0 ? "dropped the ones that did not match" : "all match");
   return 0;
 }
 
 /*
- * do_nclr
+ * cat_check
  *
- * This function is the high-level function that sets up for an nclr call.
+ * This function drops the registry if another process has committed to the database since it was loaded.
  */
-static int do_nclr (void)
+static void cat_check (void)
 {
-  nclr_dat *nd;
-  int ret;
-  char *cp;
-
-  ret = proc_nclr_file ();
-  if (ret)
-    /* ignore the error and return */
-    return 0;
-
-  for (nd = ndlist; nd != 0; nd = nd->next) {
-    cp = bcnum_add (opt->catList[nd->cat].amt, nd->amt, 2);
-    strncpy (opt->catList[nd->cat].amt, cp, SIZE_AMT);
-  }
-
-  /* Clean up the nclr file data */
-  do {
-    nd = ndlist;
-    ndlist = ndlist->next;
-    if (nd != 0)
-      free (nd);
-  } while (ndlist != NULL);
-  ndlist = 0;
-
-  return 0;
+  if (opt->cats.loaded && db_data_version () != opt->cats.data_version)
+    opt->cats.loaded = FALSE;
 }
 
-static int do_ls (void)
+/*
+ * cat_free
+ *
+ * This function releases the registry.
+ */
+static void cat_free (void)
 {
-  int ret;
-  int i;
-  char *cp;
-  char tot[SIZE_AMT+1];
-
-  ret = do_post(0);
-  if (ret)
-    return ret;
+  cat_reg *reg = &opt->cats;
 
-  if (opt->is_nclr) {
-    ret = do_nclr();
-    if (ret)
-      return ret;
-  }
-  if (opt->is_tot && ! opt->is_catt) {
-    printf ("\n***Error in do_ls(), line %d: Need --catt CAT with --ls --tot\n", __LINE__);
-    return (-1);
-  }
+  free (reg->cats);
+  free (reg->by_num);
+  free (reg->by_name);
+  memset (reg, 0, sizeof (cat_reg));
+}
 
-  if (! opt->is_tot) {
-    strcpy (tot, "0.00");
-    printf ("==========================================================================================\n");
-    printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-    printf ("------------------------------------------------------------------------------------------\n");
+/*
+ * verify_number
+ *
+ * This function verifies a number.
+ */
+static inline int verify_number (const char *num)
+{
+  int i = 0;
+  int saw_period = (num[0] == '.');
+  int saw_digit = isdigit (num[0]) != 0;
+  /* first char must be -, +, . or a digit (amounts under a dollar print as .25) */
+  if (num[0] != '-' && num[0] != '+' && num[0] != '.' && ! isdigit (num[0])) {
+    printf ("\n***Error in verify_number(), line %d: invalid number '%s'\n", __LINE__, num);
+    return FALSE;
   }
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
+  while (num[i] != '\0') {
+    /* must be digits and 1 or 0 period from now on */
+    i++;
+    if (num[i] == '.') {
+      if (saw_period == TRUE) {
+        printf ("\n***Error in verify_number(), line %d: number has two '.' in it: '%s'\n", __LINE__, num);
+        return FALSE;
+      }
+      saw_period = TRUE;
       continue;
-    if (! opt->is_tot) {
-      printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-      cp = bcnum_add (tot, opt->catList[i].amt, 2);
-      strncpy (tot, cp, SIZE_AMT);
     }
-    else {
-      if (! strcmp (opt->catList[i].name, opt->catt)) {
-        printf ("%s\n", opt->catList[i].amt);
-        return 0;
-      }
+    if (isdigit (num[i])) {
+      saw_digit = TRUE;
+      continue;
     }
+    if (num[i] == '\0')
+      continue;
+    /* shouldn't get here */
+    printf ("\n***Error in verify_number(), line %d: number has invalid char %c: %s\n", __LINE__, num[i], num);
+    return FALSE;
   }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
-  return 0;
+  /* a sign or a period alone is not an amount */
+  if (! saw_digit) {
+    printf ("\n***Error in verify_number(), line %d: number has no digits: '%s'\n", __LINE__, num);
+    return FALSE;
+  }
+  return TRUE;
 }
+
 /*
- * do_recalc
+ * put_amt
  *
- * This function forces a recalculation of all the transactions in the tran table.
+ * This function formats a money value into an amount field, the same way the result of a bcnum_add() always went into one.
  */
-static int do_recalc ()
+static void put_amt (char *amt, const bcmoney *m)
 {
-  int ret;
-  int i;
-  char *cp;
-  char tot[SIZE_AMT+1];
+  char buf[BCNUM_OUTSTRING_SIZE+1];
 
-  ret = do_post (1);
-  if (ret)
-    return ret;
-  strcpy (tot, "0.00");
-  printf ("==========================================================================================\n");
-  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-    cp = bcnum_add (tot, opt->catList[i].amt, 2);
-    strncpy (tot, cp, SIZE_AMT);
+  if (bcmoney_str (m, buf, BCNUM_OUTSTRING_SIZE+1) == 0) {
+    printf ("\n***Error in put_amt(), line %d: %s\n", __LINE__, bcnumErrMsg[bcnumError]);
+    return;
   }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
-  return 0;
+  if (strlen (buf) > SIZE_AMT) {
+    printf ("\n***Error in put_amt(), line %d: %s is too long for an amount (max %d characters)\n", __LINE__, buf, SIZE_AMT);
+    return;
+  }
+  strcpy (amt, buf);
 }
 
 /*
- * do_qry
+ * put_sum
  *
- * This function parses out the query string and does the specified query.
+ * This function formats the total of a column of amounts into an amount field, the same way put_amt() does a single value.
  */
-static int do_qry(void)
+static void put_sum (char *amt, bcnum_sum *s)
 {
-  int ret;
-  char *errmsg = 0;
-  c_item *c;
-  int len;
-  int num_trans;
-  char tmp[SIZE_ARB+1];
+  char buf[BCNUM_OUTSTRING_SIZE+1];
 
-  if (opt->qry[0] == 'd' && opt->qry[1] == 't' && opt->qry[2] == ':') {
-    /* query on the date */
-    len = strlen (opt->qry);
-    if (len <= 3) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.dtime like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
-        &(opt->qry[3]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 's' && opt->qry[1] == 't' && opt->qry[2] == ':') {
-    /* query on the status */
-    len = strlen (opt->qry);
-    if (len <= 3) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.status like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
-        &(opt->qry[3]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 't' && opt->qry[1] == 'o' && opt->qry[2] == ':') {
-    /* query on the date */
-    len = strlen (opt->qry);
-    if (len <= 3) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.to_who like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
-        &(opt->qry[3]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 'c' && opt->qry[1] == 'a' && opt->qry[2] == 't' && opt->qry[3] == ':') {
-    /* query on the date */
-    len = strlen (opt->qry);
-    if (len <= 4) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE c.name LIKE '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
-        &(opt->qry[4]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 'c' && opt->qry[1] == 'm' && opt->qry[2] == 't' && opt->qry[3] == ':') {
-    /* query on the date */
-    len = strlen (opt->qry);
-    if (len <= 4) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.comment LIKE '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
-        &(opt->qry[4]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 'a' && opt->qry[1] == 'm' && opt->qry[2] == 't' && opt->qry[3] == ':') {
-    /* query on the date */
-    len = strlen (opt->qry);
-    if (len <= 4) {
-      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.amt like '%%%s%%' ORDER BY t.dtime;",
-        &(opt->qry[4]));
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  if (opt->qry[0] == 'm' && opt->qry[1] == 'r') {
-    /* Machine readable dump of everything */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-    if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table\n", __LINE__);
-      del_cb_data();
-      return 0;
-    }
-    num_trans = c_head->num_items;
-    for (c = c_head; c != c_tail; c = c->next) {
-      if (c->item[0])
-        printf ("%s:%s:%s:%s:%s:%s:%s\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
-    }
-    printf ("Processed %d items\n", num_trans);
-    del_cb_data ();
-    return 0;
-  }
-  /* anything else => do all, in human readable form */
-  snprintf (tmp, SIZE_ARB,
-      "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table\n", __LINE__);
-    del_cb_data();
-    return 0;
+  if (bcnum_sum_str (s, buf, BCNUM_OUTSTRING_SIZE+1) == 0) {
+    printf ("\n***Error in put_sum(), line %d: %s\n", __LINE__, bcnumErrMsg[s->error]);
+    return;
   }
-  num_trans = c_head->num_items;
-  for (c = c_head; c != c_tail; c = c->next) {
-    if (c->item[0])
-      printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c->item[0],c->item[1],c->item[2],c->item[3],c->item[4],c->item[5],c->item[6]);
+  if (strlen (buf) > SIZE_AMT) {
+    printf ("\n***Error in put_sum(), line %d: %s is too long for an amount (max %d characters)\n", __LINE__, buf, SIZE_AMT);
+    return;
   }
-  printf ("Processed %d items\n", num_trans);
-  del_cb_data ();
-  return 0;
+  strcpy (amt, buf);
 }
 
-/*
- * do_edit
- *
- * This function processes an edit command.
- */
-static int do_edit (void)
+static qifItem *parseQIFItem (char *rqda[], const char *file, int lnctr)
 {
-  int ret;
-  int new_tran;
-  int val;
-  char *errmsg = 0;
-  char tmp[SIZE_ARB+1];
+  qifItem *qi;
+  int i, j, mon, day, year;
+  char *cp;
+  char buf[10];
+  int splitNum = 0;
 
-  if (! opt->is_tran) {
-    printf ("\n***Error in do_edit(), line %d: Must specify a transaction number\n", __LINE__);
-    return -1;
-  }
-  if (!opt->is_to && !opt->is_amt && !opt->is_cat && !opt->is_catt && !opt->is_cmt && !opt->is_date) {
-    printf ("\n***Error in do_edit(), line %d: User must specify something to change for transaction %d\n", __LINE__, opt->tran);
-    return -1;
-  }
-  new_tran = get_next_tran_num ();
-  if (opt->tran > new_tran-1 || opt->tran < 0) {
-    printf ("\n***Error in do_edit(), line %d: Invalid transaction number %d\n", __LINE__, opt->tran);
-    return -1;
-  }
-  if (opt->is_amt) {
-    ret = verify_number (opt->amt);
-    if (!ret)
-      return ret;
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET amt = %s WHERE num = %d;\nCOMMIT;\n", opt->amt, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('EDT',NULL,%d,datetime('now','localtime'),'%s',NULL,NULL);\nCOMMIT;\n",
-        opt->tran,opt->amt);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-  }
-  if (opt->is_cat) {
-    val = get_next_cat_num ();
-    if (opt->cat < 0 || opt->cat > val-1) {
-      printf ("\n***Error in do_edit(), line %d: Invalid category number %d\n", __LINE__, opt->cat);
-      return -1;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET cat_num = %d WHERE num = %d;\nCOMMIT;\n", opt->cat, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('EDT',%d,%d,datetime('now','localtime'),NULL,NULL,NULL);\nCOMMIT;\n",
-        opt->cat, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-  }
-  if (opt->is_to) {
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET to_who = '%s' WHERE num = %d;\nCOMMIT;\n", opt->to, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('EDT',NULL,%d,datetime('now','localtime'),NULL,'%s',NULL);\nCOMMIT;\n",
-        opt->tran, opt->to);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
+  if (rqda[0][0] == '\0')
+    return 0;
+  qi = malloc (sizeof (qifItem));
+  if (qi == 0) {
+    printf ("\n\n***Error: fatal memory error allocating a qifItem\n");
+    return 0;
   }
-  if (opt->is_cmt) {
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET comment = '%s' WHERE num = %d;\nCOMMIT;\n", opt->cmt, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('EDT',NULL,%d,datetime('now','localtime'),NULL,NULL,'%s');\nCOMMIT;\n",
-        opt->tran, opt->cmt);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-  }
-  if (opt->is_date) {
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET dtime = '%s' WHERE num = %d;\nCOMMIT;\n", opt->date, opt->tran);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
-    }
-    snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('EDT',NULL,%d,datetime('now','localtime'),NULL,NULL,'%s');\nCOMMIT;\n",
-        opt->tran, opt->date);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_add(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      ret = -1;
-      return ret;
+  memset (qi, 0, sizeof (qifItem));
+  /*check_pointer (qi);*/
+  for (i = 0; i < QIF_SIZE_RQDA && rqda[i][0] != '\0'; i++) {
+    switch (rqda[i][0]) {
+      case 'D':
+        /* parse the date */
+        // Stupid qif date formats.  <sigh>
+        // Date can be DD.MM.YYYY or M[M]/D[D]/[YY]YY or M[M]/D[D]'[ |Y]Y
+        // DD.MM.YYYY - I needed this because I couldn't get kmymoney to generate a better date format.
+        // Your mileage may vary.
+        cp = strchr (&rqda[i][1], '.');
+        if (cp != 0) {
+          cp = &rqda[i][1];
+          for (j = 0; *cp != '.' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          day = atoi (buf);
+            if (day < 1 || day > 31) {
+            goto BrokenDate;
+          }
+          if (*cp != '.')
+            goto BrokenDate;
+          cp++;
+          for (j = 0; *cp != '.' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          mon = atoi (buf);
+          if (mon < 1 || mon > 12)
+            goto BrokenDate;
+            if (*cp != '.')
+            goto BrokenDate;
+          cp++;
+          for (j = 0; *cp != '\0' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+        buf[j] = '\0';
+          year = atoi (buf);
+          if (year < 1900 || year > 2025)
+            goto BrokenDate;
+          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
+          goto GoodDate;
+        }
+        cp = strchr (rqda[i], '\'');
+        if (cp == 0) {
+          /* old date format M[M]/D[D]/[YY]YY*/
+          cp = &rqda[i][1];
+          for (j = 0; *cp != '/' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          mon = atoi (buf);
+          if (mon < 1 || mon > 12) {
+            goto BrokenDate;
+          }
+          if (*cp != '/')
+            goto BrokenDate;
+          cp++;
+          for (j = 0; *cp != '/' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          day = atoi (buf);
+          if (day < 1 || day > 31)
+            goto BrokenDate;
+          if (*cp != '/')
+            goto BrokenDate;
+          cp++;
+          for (j = 0; *cp != '\0' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          year = atoi (buf);
+          if (year >= 50 && year < 100)
+            year += 1900;
+          else if (year > 1 && year < 50)
+            year += 2000;
+          if (year < 1900 || year > 2025)
+            goto BrokenDate;
+          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
+          goto GoodDate;
+        }
+        else {
+          /* newer date format M[M]/D[D]'[ |Y]Y */
+          buf[0] = '2';
+          buf[1] = '0';
+          if (*(cp+1) == ' ')
+            buf[2] = '0';
+          else
+            buf[2] = *(cp+1);
+          buf[3] = *(cp+2);
+          buf[4] = '\0';
+          year = atoi(buf);
+          if (year < 1900 || year > 2025)
+            goto BrokenDate;
+          cp = &rqda[i][1];
+          for (j = 0; *cp != '/' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          mon = atoi (buf);
+          if (mon < 1 || mon > 12) {
+            goto BrokenDate;
+          }
+          if (*cp != '/')
+            goto BrokenDate;
+          cp++;
+          for (j = 0; *cp != '/' && j < 9; j++) {
+            buf[j] = *cp;
+            cp++;
+          }
+          buf[j] = '\0';
+          day = atoi (buf);
+          if (day < 1 || day > 31)
+            goto BrokenDate;
+          sprintf (qi->date, "%04d%02d%02d", year, mon, day);
+          goto GoodDate;
+        }
+
+
+BrokenDate:
+        printf ("***Warning: parse error on date \"%s\" ", &rqda[i][1]);
+        printf (": ignoring qif item\n");
+        free (qi);
+        return 0;
+
+GoodDate:
+        break;
+      case 'U':;
+
+        /* amt of first transaction - ignore it */
+        snprintf (qi->ftran, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
+        break;
+      case 'T':
+        /* get the amount */
+        // snprintf (qi->tran, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
+        cp = &rqda[i][1];
+        for (j = 0; j < QIF_SIZE_TRAN && *cp != '\0'; j++, cp++) {
+          if (*cp == ',') {
+            cp++;
+          }
+          qi->tran[j] = *cp;
+        }
+        qi->tran[j] = '\0';
+        break;
+      case 'C':
+        /* cleared status - ignore it */
+        break;
+      case 'P':
+        /* get the payee */
+        snprintf (qi->payee, QIF_SIZE_PAYEE, "%s", &rqda[i][1]);
+        break;
+      case 'M':
+        /* get the memo */
+        snprintf (qi->memo, QIF_SIZE_DESC, "%s", &rqda[i][1]);
+        break;
+      case 'L':
+        /* get the category */
+        snprintf (qi->category, QIF_SIZE_CAT, "%s", &rqda[i][1]);
+        break;
+      case 'N':
+        /* get the check number */
+        snprintf (qi->check, QIF_SIZE_CHECK, "%s", &rqda[i][1]);
+        break;
+      case 'E':
+        /* comment in split - ignore it */
+        break;
+      case 'R':
+        /* ignore it */
+        break;
+      case 'I':
+        /* ignore it */
+        break;
+      case 'B':
+        /* ignore it */
+        break;
+      case 'S':
+        /* process split rqda with S and $ prefixes */
+        qi->isSplit = TRUE;
+        qi->sia[splitNum] = malloc (sizeof (splitItem));
+        memset (qi->sia[splitNum], 0, sizeof (splitItem)); 
+        snprintf (qi->sia[splitNum]->split_cat, QIF_SIZE_CAT, "%s", &rqda[i][1]);
+        i++;
+        if (i >= QIF_SIZE_RQDA || rqda[i][0] == '\0') {
+          free (qi->sia[splitNum]);
+          qi->sia[splitNum] = 0;
+        }
+        else {
+          if (rqda[i][0] == 'E')
+            i++;
+          snprintf (qi->sia[splitNum]->amt, QIF_SIZE_TRAN, "%s", &rqda[i][1]);
+        }
+        splitNum++;
+        break;
+      default:
+        /* unrecognized - just ignore it */
+        printf ("\n***Warning: qif file \"%s\", had an "
+            "unrecognized Bank item near line %d: %s\n",
+            file, lnctr, rqda[i]);
+        break;
     }
   }
-
-  if (opt->is_amt || opt->is_cat)
-    return (do_post (1));  // need to repost everything.
-  return 0;
+  /* OK, we've got the rqda in the form of a qifParser; process it */
+  return qi;
 }
 
 /*
- * do_rm
+ * do_add
  *
- * This function processes an rm command.  It replicates a transaction into the journal table and then removes it from the tran table.
+ * This function adds a transaction.
  */
-static int do_rm (void)
+static int do_add (void)
 {
+  sqlite3_stmt *stmt;
   int ret;
-  int new_tran;
-  char *errmsg = 0;
-  char tmp[SIZE_ARB+1];
+  int cat;
+  int tran_num;
+  char catt[FIELD_ARB+1];
 
-  if (! opt->is_tran) {
-    printf ("\n***Error in do_rm(), line %d: Must specify a transaction number\n", __LINE__);
+  if (! opt->is_amt) {
+    printf ("\n***Error in do_add(), line %d: no amount entered on the command-line\n", __LINE__);
     return -1;
   }
-  new_tran = get_next_tran_num ();
-  if (opt->tran >= new_tran || opt->tran < 0) {
-    printf ("\n***Error: do_rm(), line %d: Invalid tran_id %d\n", __LINE__, opt->tran);
+  if (! opt->is_cat && ! opt->is_catt) {
+    printf ("\n***Error in do_add(), line %d: no category entered on the command-line\n", __LINE__);
     return -1;
   }
-  /* first, update the status to show removed. */
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET status = 'RMVD' WHERE num = %d;\nCOMMIT;\n", opt->tran);
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
+  if (! opt->is_to) {
+    printf ("\n***Error in do_add(), line %d: no To: field entered in transaction\n", __LINE__);
+    return -1;
   }
-  /* then, copy to the archive table */
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO arch SELECT * FROM tran WHERE num = %d;\nCOMMIT;\n", opt->tran);
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    ret = -1;
-    return ret;
+  if (! opt->is_cmt) {
+    printf ("\n***Error in do_add(), line %d: no comment entered in transaction\n", __LINE__);
+    return -1;
+  }
+
+  if (opt->is_catt) {
+    cat = get_cat_num_from_name (opt->catt);
+    strcpy (catt, opt->catt);
+  }
+  else {
+    cat = opt->cat;
+    ret = get_cat_name_from_num (cat, catt);
+    if (ret == -1)
+      cat = -1;
+  }
+  if (cat == -1) {
+    printf ("\n***Error in do_add(), line %d: Invalid category name or number\n", __LINE__);
+    return -1;
+  }
+
+  if (! verify_number (opt->amt))
+    return -1;
+
+  if (db_begin ())
+    return -1;
+  tran_num = get_next_tran_num ();
+  if (tran_num == -1)
+    goto AddRollback;
+
+  if (opt->is_date)
+    opt->date[SIZE_TSTMP] = '\0';
+  stmt = stmt_get (STMT_ADD_TRAN);
+  if (stmt == 0)
+    goto AddRollback;
+  sqlite3_bind_int (stmt, 1, tran_num);
+  sqlite3_bind_int (stmt, 2, cat);
+  if (opt->is_date)
+    sqlite3_bind_text (stmt, 3, opt->date, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 4, opt->amt, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 5, opt->to, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 6, opt->cmt, -1, SQLITE_STATIC);
+  if (stmt_exec (stmt))
+    goto AddRollback;
+  stmt = stmt_get (STMT_ADD_ACT);
+  if (stmt == 0)
+    goto AddRollback;
+  sqlite3_bind_text (stmt, 1, "TRN", -1, SQLITE_STATIC);
+  sqlite3_bind_int (stmt, 2, cat);
+  sqlite3_bind_int (stmt, 3, tran_num);
+  if (opt->is_date)
+    sqlite3_bind_text (stmt, 4, opt->date, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 5, opt->amt, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 6, opt->to, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 7, opt->cmt, -1, SQLITE_STATIC);
+  if (stmt_exec (stmt))
+    goto AddRollback;
+  if (db_commit ())
+    return -1;
+  opt->cats.posted = FALSE;
+  printf ("Journalized %s for the %d (%s) category.\n", opt->amt, cat, catt);
+
+  return 0;
+
+AddRollback:
+  db_rollback ();
+  return -1;
+}
+
+/*
+ * do_new_cat
+ *
+ * This function adds a category to a budget.
+ */
+static int do_new_cat (void)
+{
+  int ret;
+  int new_cat;
+  sqlite3_stmt *stmt;
+  char tmp1[SIZE_ARB+1];
+
+  if (! opt->is_catt) {
+    printf ("\n***Error in do_new_cat (), line %d: Called without --catt having been entered.\n", __LINE__);
+    return -1;
+  }
+  if (db_begin ())
+    return -1;
+  ret = get_cat_num_from_name (opt->catt);
+  if (ret != -1) {
+    printf ("\n***Error in do_new_cat(), line %d: Trying to create a category with a name that already exists: '%s'\n", __LINE__, opt->catt);
+    goto NewCatRollback;
+  }
+  new_cat = get_next_cat_num ();
+  if (new_cat == -1)
+    goto NewCatRollback;
+  stmt = stmt_get (STMT_ADD_CAT);
+  if (stmt == 0)
+    goto NewCatRollback;
+  sqlite3_bind_int (stmt, 1, new_cat);
+  sqlite3_bind_text (stmt, 2, opt->catt, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 3, (opt->is_cmt ? opt->cmt : "Create a new Category."), -1, SQLITE_STATIC);
+  if (stmt_exec (stmt))
+    goto NewCatRollback;
+  snprintf (tmp1, SIZE_ARB, "Add cat %d, %s", new_cat, opt->catt);
+  stmt = stmt_get (STMT_ADD_ACT);
+  if (stmt == 0)
+    goto NewCatRollback;
+  sqlite3_bind_text (stmt, 1, "CAT", -1, SQLITE_STATIC);
+  sqlite3_bind_int (stmt, 2, new_cat);
+  sqlite3_bind_text (stmt, 6, opt->catt, -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 7, tmp1, -1, SQLITE_STATIC);
+  if (stmt_exec (stmt))
+    goto NewCatRollback;
+  if (db_commit ())
+    return -1;
+  /* the registry doesn't know about the new category yet */
+  opt->cats.loaded = FALSE;
+  snprintf (tmp1, SIZE_ARB, "Created cat %d named '%s'\n", new_cat, opt->catt);
+  printf ("%s\n", tmp1);
+  return 0;
+
+NewCatRollback:
+  db_rollback ();
+  return -1;
+}
+
+/*
+ * do_cedit
+ *
+ * This function allows the user to edit a category.
+ */
+#if 0
+static int do_cedit (void)
+{
+  int ret;
+  int new_cat;
+  char *errmsg = 0;
+  char tmp[SIZE_ARB+1];
+  char tmp1[SIZE_ARB+1];
+
+  if (! opt->is_cat) {
+    printf ("\n***Error in do_cedit (), line %d: Called without --cat having been entered.\n", __LINE__);
+    return -1;
+  }
+  if (opt->is_catt) {
+    ret = get_cat_num_from_name (opt->catt);
+    if (ret != -1) {
+      printf ("\n***Error in do_cedit(), line %d: Trying to update a category with a name that already exists: '%s'\n", __LINE__, opt->catt);
+      return -1;
+    }
   }
-  /* finally, remove it */
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nDELETE FROM tran WHERE num = %d;\nCOMMIT;\n", opt->tran);
+  // FIXME
+  // Continue here
+  // FIXME
+  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO cat VALUES (%d, datetime('now','localtime'), '%s', 0, '%s');\nCOMMIT;\n", new_cat, opt->catt,
+      (opt->is_cmt ? opt->cmt : "Create a new Category."));
   ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
   if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+    printf ("\n\n***Error in do_cedit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
     sqlite3_free (errmsg);
     ret = -1;
     return ret;
   }
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('RMV',NULL,%d,datetime('now','localtime'),NULL,NULL,NULL);\nCOMMIT;\n",
-      opt->tran);
+  snprintf (tmp1, SIZE_ARB, "Add cat %d, %s", new_cat, opt->catt);
+  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('CAT',%d,NULL,datetime('now','localtime'),NULL,'%s','%s');\nCOMMIT;\n", 
+      new_cat, opt->catt, tmp1);
   ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
   if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_edit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+    printf ("\n\n***Error in do_cedit(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
     sqlite3_free (errmsg);
     ret = -1;
     return ret;
   }
-  return (do_post (1)); // need to repost everything
+  snprintf (tmp1, SIZE_ARB, "Updated cat %d named '%s'\n", new_cat, opt->catt);
+  printf ("%s\n", tmp1);
+  return 0;
 }
+#endif
 
 /*
- * do_exp
+ * post_sum
  *
- * This function processes the exp command.  This looks at only expenses in the tran table, not including ones with adjust in the to or cmt field.
+ * This function applies one category's sum from a posting or a recalc to its balance, and adds its count to num_trans.
  */
-static int do_exp (void)
+static int post_sum (int cat_num, long long cents, int count, int *num_trans)
 {
-  char *errmsg = 0;
-  c_item *c;
-  int ret;
-  int i;
-  int num_cats;
-  int num_trans;
-  char tmp[SIZE_ARB+1];
-  char *cp;
-  tran_dat *td;
-  char tot[SIZE_AMT+1];
+  cat_ls *cl;
 
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,amt FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
+  if (cat_num < 0) {
+    printf ("\n***Error in post_sum(), line %d: Transaction has an invalid category number %d\n", __LINE__, cat_num);
     return -1;
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
-    del_cb_data();
-    return -1;
-  }
-  num_cats = c_head->num_items;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_exp(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
+  *num_trans += count;
+  cl = cat_find_num (cat_num);
+  if (cl == 0)
+    /* the category is gone - the rows still get flagged, but there is no balance to apply them to */
+    return 0;
+  /* apply each delta once and update the category it touches */
+  return cat_apply (cl, cents, "do_post");
+}
+
+/*
+ * recalc_part - one recalc thread's range of transaction numbers, lo < num <= hi, and the per-category sums it found there.
+ */
+typedef struct _cat_sum {
+  int cat_num;
+  long long cents;
+  int count;
+} cat_sum;
+
+typedef struct _recalc_part {
+  int lo;
+  int hi;
+  cat_sum *sums;
+  int num_sums;
+  int error;
+  char errmsg[FIELD_ARB+1];
+} recalc_part;
+
+/*
+ * recalc_worker
+ *
+ * The body of a recalc thread.  It opens its own read-only connection, since a connection can't be shared between threads, and
+ * sums its range by category.  It only fills in its own recalc_part; the registry and opt->db belong to the main thread.
+ */
+static void *recalc_worker (void *arg)
+{
+  recalc_part *rp = arg;
+  sqlite3 *db = 0;
+  sqlite3_stmt *stmt = 0;
+  cat_sum *p;
+  int size = 0;
+  int ret;
+
+  if (sqlite3_open_v2 (opt->db_name, &db, SQLITE_OPEN_READONLY, 0) != SQLITE_OK ||
+      sqlite3_prepare_v2 (db, stmt_sql[STMT_RANGE_SUMS], -1, &stmt, 0) != SQLITE_OK) {
+    snprintf (rp->errmsg, FIELD_ARB, "%s", db ? sqlite3_errmsg (db) : "out of memory");
+    rp->error = TRUE;
+    goto WorkerDone;
+  }
+  sqlite3_busy_timeout (db, 5000);
+  sqlite3_bind_int (stmt, 1, rp->lo);
+  sqlite3_bind_int (stmt, 2, rp->hi);
+  while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+    if (rp->num_sums == size) {
+      size = size ? size * 2 : 64;
+      p = realloc (rp->sums, size * sizeof (cat_sum));
+      if (p == 0) {
+        snprintf (rp->errmsg, FIELD_ARB, "out of memory");
+        rp->error = TRUE;
+        goto WorkerDone;
+      }
+      rp->sums = p;
     }
-    opt->catList[cat].cat = cat;
-    strncpy (opt->catList[cat].dtime, c->item[1], SIZE_TSTMP);
-    strncpy (opt->catList[cat].name, c->item[2], FIELD_ARB);
-    /* set category amounts to 0 */
-    strcpy (opt->catList[cat].amt, "0.00");
+    p = &rp->sums[rp->num_sums++];
+    p->cat_num = sqlite3_column_type (stmt, 0) == SQLITE_NULL ? -1 : sqlite3_column_int (stmt, 0);
+    p->cents = sqlite3_column_int64 (stmt, 1);
+    p->count = sqlite3_column_int (stmt, 2);
   }
-  del_cb_data();
-  /* now, let's grab the transactions that we need to process */
-  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
-    /* process beg and end limits */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt LIKE '%%-%%' AND num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg, opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
+  if (ret != SQLITE_DONE) {
+    snprintf (rp->errmsg, FIELD_ARB, "%s", sqlite3_errmsg (db));
+    rp->error = TRUE;
   }
-  else if (opt->is_beg == TRUE) {
-    /* only opt->beg */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt LIKE '%%-%%' AND num >= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
+
+WorkerDone:
+  sqlite3_finalize (stmt);
+  sqlite3_close (db);
+  return 0;
+}
+
+/*
+ * recalc_parallel
+ *
+ * This function sums the transactions after hwm with opt->threads threads, each over its own range of transaction numbers, then
+ * applies the partial sums in range order.  The sums are whole cents, so the balances come out exactly as a serial recalc's.
+ * It returns 1, having changed nothing, when the caller should do it serially instead: too few transactions to be worth it, or a
+ * thread that couldn't read the database.
+ */
+static int recalc_parallel (int hwm, int *num_trans)
+{
+  pthread_t tid[MAX_THREADS];
+  recalc_part part[MAX_THREADS];
+  sqlite3_stmt *stmt;
+  long long lo;
+  long long span;
+  int rows;
+  int n;
+  int i;
+  int j;
+  int ret = 0;
+
+  /* the threads read what is committed, so this transaction must not have written anything yet - do_post's own is fine */
+  if (opt->tx_depth != 1 || ! sqlite3_threadsafe ())
+    return 1;
+  stmt = stmt_get (STMT_RANGE_SPAN);
+  if (stmt == 0)
+    return -1;
+  sqlite3_bind_int (stmt, 1, hwm);
+  if (sqlite3_step (stmt) != SQLITE_ROW) {
+    printf ("\n\n***Error in recalc_parallel(), line %d: SQLite Error entering '%s': %s\n", __LINE__, stmt_sql[STMT_RANGE_SPAN], sqlite3_errmsg (opt->db));
+    sqlite3_reset (stmt);
+    return -1;
   }
-  else if (opt->is_end == TRUE) {
-    /* only opt->end */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt LIKE '%%-%%' AND num <= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
+  lo = sqlite3_column_int64 (stmt, 0) - 1;
+  span = sqlite3_column_int64 (stmt, 1) - lo;
+  rows = sqlite3_column_int (stmt, 2);
+  sqlite3_reset (stmt);
+  n = MIN (opt->threads, rows / PAR_MIN_ROWS);
+  if (n < 2)
+    return 1;
+
+  /* the threads prepare it on their own connections, so show it here */
+  explain (stmt_sql[STMT_RANGE_SUMS]);
+  memset (part, 0, sizeof (part));
+  for (i = 0; i < n; i++) {
+    part[i].lo = (int)(lo + span * i / n);
+    part[i].hi = (int)(lo + span * (i + 1) / n);
+    if (pthread_create (&tid[i], 0, recalc_worker, &part[i]) != 0) {
+      part[i].error = TRUE;
+      snprintf (part[i].errmsg, FIELD_ARB, "%s", strerror (errno));
+      break;
     }
   }
-  else {
-    /* otherwise, there are no limits - calculate everything */
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt FROM tran WHERE amt LIKE '%%-%%' AND to_who NOT LIKE '%%adjust%%';");
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
+  for (j = 0; j < i; j++)
+    pthread_join (tid[j], 0);
+  for (j = 0; j < n && ret == 0; j++) {
+    if (part[j].error) {
+      if (! opt->is_quiet)
+        printf ("\n***Warning in recalc_parallel(), line %d: %s; recalculating with one thread\n", __LINE__, part[j].errmsg);
+      ret = 1;
     }
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\nNothing to consider.\n");
-    del_cb_data();
-    return 0;
-  }
-  num_trans = c_head->num_items;
-  td = malloc (sizeof (tran_dat));
-  if (0 == td) {
-    printf ("\n***Error in do_exp(), line %d: Fatal memory error allocating %d bytes.", __LINE__, sizeof (tran_dat));
-    del_cb_data();
-    return -1;
-  }
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    memset (td, 0, sizeof(tran_dat));
-    td->num = atoi (c->item[0]);
-    td->cat_num = atoi (c->item[1]);
-    strncpy (td->dtime, c->item[2], SIZE_TSTMP);
-    strncpy (td->amt, c->item[3], SIZE_AMT);
-    cp = bcnum_add (opt->catList[td->cat_num].amt, td->amt, 2);
-    strncpy (opt->catList[td->cat_num].amt, cp, SIZE_AMT);
-  }
-  /* now, print the data */
-  strcpy (tot, "0.00");
-  printf ("==========================================================================================\n");
-  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-    cp = bcnum_add (tot, opt->catList[i].amt, 2);
-    strncpy (tot, cp, SIZE_AMT);
-  }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
-
-  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
-  return 0;
+  /* merge in range order, so the result never depends on which thread finished first */
+  for (j = 0; j < n && ret == 0; j++)
+    for (i = 0; i < part[j].num_sums && ret == 0; i++)
+      if (post_sum (part[j].sums[i].cat_num, part[j].sums[i].cents, part[j].sums[i].count, num_trans))
+        ret = -1;
+  for (j = 0; j < n; j++)
+    free (part[j].sums);
+  return ret;
 }
 
+typedef struct _tran_dat {
+  int num;
+  int cat_num;
+  char dtime[SIZE_TSTMP+1];
+  char amt[SIZE_AMT+1];
+} tran_dat;
+
 /*
- * do_inc
+ * do_post
  *
- * This function processes the inc command.  This looks at only income in the tran table, not including ones with adjust in the to or cmt field.
+ * This function posts transactions.  If recalc is 0, only the transactions that haven't been posted before get changed.  If recalc is 1, do_post
+ * recalculates everything from the beginning of the trans table.
+ *
+ * All of the posting happens inside one SQL transaction.  SQLite sums the amounts into a per-category delta with one GROUP BY, each delta is
+ * applied to its category balance once, and the tran rows are flagged with one set-based UPDATE rather than one per row.
  */
-static int do_inc (void)
+static int do_post (int recalc)
 {
-  char *errmsg = 0;
-  c_item *c;
+  sqlite3_stmt *stmt = 0;
+  cat_ls *cl;
   int ret;
   int i;
   int num_cats;
   int num_trans;
-  char tmp[SIZE_ARB+1];
-  char *cp;
-  tran_dat *td;
-  char tot[SIZE_AMT+1];
-
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,amt FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
+  int cat_num;
+  int hwm = -1;
+  int count = 0;
+
+  /* in a long-running bgt, there is nothing to post if this process hasn't added anything and nobody else has committed */
+  if (recalc == 0 && opt->tx_depth == 0 && opt->cats.loaded && opt->cats.posted) {
+    cat_check ();
+    if (opt->cats.loaded) {
+      if (opt->cats.reformat) {
+        for (i = 0; i < opt->cats.num_cats; i++)
+          bcmoney_fmt (opt->cats.cats[i].cents, opt->cats.cats[i].amt, SIZE_AMT+1);
+        opt->cats.reformat = FALSE;
+      }
+      if (! opt->is_quiet)
+        printf ("\nNothing to post.\n");
+      return 0;
+    }
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
-    del_cb_data();
+  /* take the write lock up front so nothing can slip in between reading and flagging the rows */
+  if (db_begin ())
     return -1;
-  }
-  num_cats = c_head->num_items;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_exp(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
+  /* first, make sure the category registry is loaded */
+  if (cat_load ())
+    goto PostRollback;
+  num_cats = opt->cats.num_cats;
+  if (num_cats == 0) {
+    printf ("\n***Error in do_post(), line %d: The SQL query '%s' generated no data and it should have.\n", __LINE__, stmt_sql[STMT_CAT_LOAD]);
+    printf ("This probably means that the default bgt database has not been initialized properly.\n");
+    printf ("If there are no categories in the default budget, add some and try again.\n");
+    printf ("Worst case, remove the budget directory (rm -rf ~/.bgt) and try again.\n");
+    printf ("See the man page for more information.\n");
+    goto PostRollback;
+  }
+  /* a recalc starts from the latest good checkpoint, or from nothing with --full */
+  if (recalc && ! opt->is_full && ckpt_find (&hwm, &count))
+    goto PostRollback;
+  for (i = 0; i < num_cats; i++) {
+    cl = &opt->cats.cats[i];
+    if (recalc)
+      /* recalculating - category amounts start back at 0 */
+      cl->cents = 0;
+    /* otherwise posting - do not reset category amounts back to 0 */
+    bcmoney_fmt (cl->cents, cl->amt, SIZE_AMT+1);
+  }
+  if (hwm >= 0 && ckpt_load (hwm))
+    goto PostRollback;
+  /* the transactions in the checkpoint count as recalculated */
+  num_trans = count;
+  /* a recalc with --threads sums ranges of the tran table at the same time; it comes back 1 if it left the job to us */
+  ret = recalc && opt->threads > 1 ? recalc_parallel (hwm, &num_trans) : 1;
+  if (ret < 0)
+    goto PostRollback;
+  if (ret > 0) {
+    /* now, let SQLite sum the transactions that we need to process */
+    if (recalc == 0)
+      /* not doing a recalc - just grab what hasn't been posted yet. */
+      stmt = stmt_get (STMT_POST_SUMS);
+    else if (hwm >= 0) {
+      /* doing a recalc from a checkpoint - grab everything after it */
+      stmt = stmt_get (STMT_CKPT_SUMS);
+      if (stmt != 0)
+        sqlite3_bind_int (stmt, 1, hwm);
     }
-    opt->catList[cat].cat = cat;
-    strncpy (opt->catList[cat].dtime, c->item[1], SIZE_TSTMP);
-    strncpy (opt->catList[cat].name, c->item[2], FIELD_ARB);
-    /* set category amounts to 0 */
-    strcpy (opt->catList[cat].amt, "0.00");
-  }
-  del_cb_data();
-  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
-    /* process beg and end limits */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt NOT LIKE '%%-%%' AND num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg, opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
+    else
+      /* doing a recalc - grab everything */
+      stmt = stmt_get (STMT_RECALC_SUMS);
+    if (stmt == 0)
+      goto PostRollback;
+    while ((ret = sqlite3_step (stmt)) == SQLITE_ROW) {
+      cat_num = sqlite3_column_type (stmt, 0) == SQLITE_NULL ? -1 : sqlite3_column_int (stmt, 0);
+      if (post_sum (cat_num, sqlite3_column_int64 (stmt, 1), sqlite3_column_int (stmt, 2), &num_trans))
+        goto PostRollback;
+    }
+    if (ret != SQLITE_DONE) {
+      printf ("\n\n***Error in do_post(), line %d: SQLite Error entering '%s': %s\n", __LINE__, sqlite3_sql (stmt), sqlite3_errmsg (opt->db));
+      goto PostRollback;
     }
+    sqlite3_reset (stmt);
   }
-  else if (opt->is_beg == TRUE) {
-    /* only opt->beg */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt NOT LIKE '%%-%%' AND num >= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
+  opt->cats.reformat = FALSE;
+  if (recalc) {
+    /* a category with nothing left in the tran table still has to be written back as 0 */
+    for (i = 0; i < num_cats; i++)
+      if (cat_set_amt (&opt->cats.cats[i]))
+        goto PostRollback;
+  }
+  if (recalc && opt->is_full && ckpt_verify ())
+    goto PostRollback;
+  if (num_trans == 0) {
+    if (! opt->is_quiet)
+      printf ("\nNothing to post.\n");
+    if (db_commit ())
       return -1;
-    }
+    opt->cats.posted = TRUE;
+    return 0;
   }
-  else if (opt->is_end == TRUE) {
-    /* only opt->end */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE amt NOT LIKE '%%-%%' AND num <= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
+  /* flag the records in the transaction table as posted */
+  if (stmt_exec (stmt_get (recalc == 0 ? STMT_POST_FLAG : STMT_RECALC_FLAG)))
+    goto PostRollback;
+  /* a recalc always leaves a checkpoint at the end; a posting does every CKPT_ROWS transactions */
+  if (ckpt_write (recalc))
+    goto PostRollback;
+  if (db_commit ())
+    return -1;
+  opt->cats.posted = TRUE;
+  if (! opt->is_quiet)
+    printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
+  return 0;
+
+PostRollback:
+  if (stmt != 0)
+    sqlite3_reset (stmt);
+  db_rollback ();
+  return -1;
+}
+
+/*
+ * proc_nclr_file
+ *
+ * This function opens an nclr file, parses it, and alters the totals according to what was in it.
+ */
+static int proc_nclr_file (void)
+{
+  nclr_dat *nd;
+  FILE *fp;
+  int lnctr = 0;
+  char *cp, *cp1;
+  int cat;
+  char line[SIZE_ARB+1];
+
+  fp = fopen (opt->nclr, "rb");
+  if (fp == 0) {
+    printf ("\n***Warning in proc_nclr_file(), line %d: could not open %s to read.\n", __LINE__, opt->nclr);
+    printf ("\tNot processing nclr data.\n");
+    return -1;
+  }
+  while (fgets (line, SIZE_ARB, fp) != 0) {
+    lnctr ++;
+    if (line[0] == '\n')
+      continue;
+    if (line[0] == '#')
+      continue;
+    if (line[0] == '/' && line[1] == '/')
+      continue;
+    nd = malloc (sizeof(nclr_dat));
+    if (nd == 0) {
+      printf ("\n***Warning in proc_nclr_file(), line %d: Allocating %d bytes of memory.\n", __LINE__, sizeof(nclr_dat));
+      printf ("\tNot processing nclr data.\n");
+      fclose (fp);
+      return -1;
+    }
+    memset (nd, 0, sizeof(nclr_dat));
+    cp = strchr (line, '\n');
+    if (0 != cp)
+      *cp = '\0';
+    cp1 = strchr (line, ':');
+    if (cp1 == 0) {
+      printf ("\n***Warning in proc_nclr_file(), line %d: Syntax error (no ':'), line %d, '%s'.\n", __LINE__, lnctr, line);
+      printf ("\tNot processing nclr data.\n");
+      free (nd);
+      do {
+        nd = ndlist;
+        ndlist = ndlist->next;
+        if (nd != 0)
+          free (nd);
+      } while (ndlist != NULL);
+      ndlist = 0;
+      fclose (fp);
+      return -1;
+    }
+    *cp1 = '\0';
+    cp = cp1+1;
+    if (verify_number (cp) == FALSE) {
+      printf ("\n***Warning in proc_nclr_file(), line %d: Invalid number in %s, line %d, '%s'\n", __LINE__, opt->nclr, lnctr, cp);
+      printf ("\tNot processing nclr data.\n");
+      do {
+        nd = ndlist;
+        ndlist = ndlist->next;
+        if (nd != 0)
+          free (nd);
+      } while (ndlist != NULL);
+      ndlist = 0;
+      fclose (fp);
+      return -1;
+    }
+    cat = get_cat_num_from_name (line);
+    if (cat == -1) {
+      printf ("\n***Warning in proc_nclr_file(), line %d: Invalid category name in %s, line %d, '%s'\n", __LINE__, opt->nclr, lnctr, cp);
+      printf ("\tNot processing nclr data.\n");
+      do {
+        nd = ndlist;
+        ndlist = ndlist->next;
+        if (nd != 0)
+          free (nd);
+      } while (ndlist != NULL);
+      ndlist = 0;
+      fclose (fp);
       return -1;
     }
+    nd->line = lnctr;
+    nd->cat = cat;
+    nd->next = 0;
+    strncpy (nd->amt, cp, SIZE_AMT);
+    if (ndlist == 0) {
+      ndlist = nd;
+      lastnd = nd;
+    }
+    else {
+      lastnd->next = nd;
+      lastnd = nd;
+    }
+  }
+  fclose (fp);
+  return 0;
+}
+
+/*
+ * do_nclr
+ *
+ * This function is the high-level function that sets up for an nclr call.
+ */
+static int do_nclr (void)
+{
+  nclr_dat *nd;
+  cat_ls *cl;
+  int ret;
+  int i;
+  char *cat_ary;
+  bcmoney *bal;
+
+  ret = proc_nclr_file ();
+  if (ret)
+    /* ignore the error and return */
+    return 0;
+
+  /* one running balance per registry slot */
+  cat_ary = calloc (opt->cats.num_cats + 1, 1);
+  bal = calloc (opt->cats.num_cats + 1, sizeof (bcmoney));
+  if (cat_ary == 0 || bal == 0) {
+    printf ("\n***Warning in do_nclr(), line %d: Allocating memory for %d categories.\n", __LINE__, opt->cats.num_cats);
+    printf ("\tNot processing nclr data.\n");
+    free (cat_ary);
+    free (bal);
+    goto NclrCleanup;
+  }
+  for (nd = ndlist; nd != 0; nd = nd->next) {
+    cl = cat_find_num (nd->cat);
+    if (cl == 0)
+      continue;
+    i = cl - opt->cats.cats;
+    if (cat_ary[i] == 2)
+      /* this category's balance is already left as it was */
+      continue;
+    if (cat_ary[i] == 0) {
+      cat_ary[i] = 1;
+      if (bcmoney_set (&bal[i], cl->amt) != 0) {
+        printf ("\n***Warning in do_nclr(), line %d: Can't use the balance %s of category %d: %s\n", __LINE__, cl->amt, nd->cat,
+            bcnumErrMsg[bcnumError]);
+        printf ("\tNot processing nclr data for category %d.\n", nd->cat);
+        cat_ary[i] = 2;
+        continue;
+      }
+    }
+    if (bcmoney_add_str (&bal[i], nd->amt) != 0) {
+      printf ("\n***Warning in do_nclr(), line %d: Can't add %s to category %d: %s\n", __LINE__, nd->amt, nd->cat, bcnumErrMsg[bcnumError]);
+      printf ("\tNot processing nclr data for category %d.\n", nd->cat);
+      cat_ary[i] = 2;
+    }
+  }
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    if (cat_ary[i] == 1)
+      put_amt (opt->cats.cats[i].amt, &bal[i]);
+    bcmoney_free (&bal[i]);
+  }
+  opt->cats.reformat = TRUE;
+  free (cat_ary);
+  free (bal);
+
+NclrCleanup:
+  /* Clean up the nclr file data */
+  do {
+    nd = ndlist;
+    ndlist = ndlist->next;
+    if (nd != 0)
+      free (nd);
+  } while (ndlist != NULL);
+  ndlist = 0;
+
+  return 0;
+}
+
+static int do_ls (void)
+{
+  cat_ls *cl;
+  int ret;
+  int i;
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  ret = do_post(0);
+  if (ret)
+    return ret;
+
+  if (opt->is_nclr) {
+    ret = do_nclr();
+    if (ret)
+      return ret;
+  }
+  if (opt->is_tot && ! opt->is_catt) {
+    printf ("\n***Error in do_ls(), line %d: Need --catt CAT with --ls --tot\n", __LINE__);
+    return (-1);
+  }
+
+  if (! opt->is_tot) {
+    strcpy (tot, "0.00");
+    printf ("==========================================================================================\n");
+    printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+    printf ("------------------------------------------------------------------------------------------\n");
   }
   else {
-    /* now, let's grab the transactions that we need to process */
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt FROM tran WHERE amt NOT LIKE '%%-%%' AND to_who NOT LIKE '%%adjust%%';");
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
+    cl = cat_find_name (opt->catt);
+    if (cl == 0) {
+      printf ("\n***Error in do_ls(), line %d: No category named '%s'\n", __LINE__, opt->catt);
+      return -1;
+    }
+    printf ("%s\n", cl->amt);
+    return 0;
+  }
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+  return 0;
+}
+/*
+ * do_recalc
+ *
+ * This function forces a recalculation of all the transactions in the tran table.
+ */
+static int do_recalc ()
+{
+  int ret;
+  int i;
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  ret = do_post (1);
+  if (ret)
+    return ret;
+  strcpy (tot, "0.00");
+  printf ("==========================================================================================\n");
+  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+  return 0;
+}
+
+/*
+ * do_explain
+ *
+ * This function prints the query plan of every statement bgt prepares, for --explain on its own.  With an action, --explain shows the
+ * plans of that action's statements as it runs them instead.
+ */
+static int do_explain (void)
+{
+  int id;
+  int num_plans = 0;
+
+  for (id = 0; id < STMT_MAX; id++)
+    num_plans += explain (stmt_sql[id]) > 0;
+  printf ("Explained %d statements\n", num_plans);
+  return 0;
+}
+
+/*
+ * do_qry
+ *
+ * This function parses out the query string and does the specified query.
+ */
+static int do_qry(void)
+{
+  int ret;
+  char *errmsg = 0;
+  result_set res = RESULT_SET_INIT;
+  char **c;
+  int len;
+  int num_trans;
+  char tmp[SIZE_ARB+1];
+
+  if (opt->qry[0] == 'd' && opt->qry[1] == 't' && opt->qry[2] == ':') {
+    /* query on the date */
+    len = strlen (opt->qry);
+    if (len <= 3) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.dtime like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
+        &(opt->qry[3]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
     if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
       sqlite3_free (errmsg);
-      del_cb_data();
+      del_cb_data (&res);
       return -1;
     }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 's' && opt->qry[1] == 't' && opt->qry[2] == ':') {
+    /* query on the status */
+    len = strlen (opt->qry);
+    if (len <= 3) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.status like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
+        &(opt->qry[3]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 't' && opt->qry[1] == 'o' && opt->qry[2] == ':') {
+    /* query on the date */
+    len = strlen (opt->qry);
+    if (len <= 3) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.to_who like '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
+        &(opt->qry[3]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 'c' && opt->qry[1] == 'a' && opt->qry[2] == 't' && opt->qry[3] == ':') {
+    /* query on the date */
+    len = strlen (opt->qry);
+    if (len <= 4) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE c.name LIKE '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
+        &(opt->qry[4]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 'c' && opt->qry[1] == 'm' && opt->qry[2] == 't' && opt->qry[3] == ':') {
+    /* query on the date */
+    len = strlen (opt->qry);
+    if (len <= 4) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.comment LIKE '%%%s%%' AND t.cat_num = c.num ORDER BY t.dtime;",
+        &(opt->qry[4]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 'a' && opt->qry[1] == 'm' && opt->qry[2] == 't' && opt->qry[3] == ':') {
+    /* query on the date */
+    len = strlen (opt->qry);
+    if (len <= 4) {
+      printf ("\n***Error in do_qry(), line %d: a query string of %s is invalid\n", __LINE__, opt->qry);
+      return -1;
+    }
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE bgt_amt(t.amt) LIKE '%%%s%%' ORDER BY t.dtime;",
+        &(opt->qry[4]));
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table matching query string %s\n", __LINE__, opt->qry);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  if (opt->qry[0] == 'm' && opt->qry[1] == 'r') {
+    /* Machine readable dump of everything */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
+    explain (tmp);
+    ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+    if (ret != SQLITE_OK) {
+      printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+      sqlite3_free (errmsg);
+      del_cb_data (&res);
+      return -1;
+    }
+    if (res.num_rows == 0) {
+      printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table\n", __LINE__);
+      del_cb_data (&res);
+      return 0;
+    }
+    num_trans = res.num_rows;
+    for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+      if (c[0])
+        printf ("%s:%s:%s:%s:%s:%s:%s\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+    }
+    printf ("Processed %d items\n", num_trans);
+    del_cb_data (&res);
+    return 0;
+  }
+  /* anything else => do all, in human readable form */
+  snprintf (tmp, SIZE_ARB,
+      "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
+  explain (tmp);
+  ret = sqlite3_exec (opt->db, tmp, cbitem, &res, &errmsg); 
+  if (ret != SQLITE_OK) {
+    printf ("\n\n***Error in do_qry(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
+    sqlite3_free (errmsg);
+    del_cb_data (&res);
+    return -1;
+  }
+  if (res.num_rows == 0) {
+    printf ("\n***Warning in do_qry(), line %d: There aren't any items in the tran table\n", __LINE__);
+    del_cb_data (&res);
+    return 0;
+  }
+  num_trans = res.num_rows;
+  for (c = RS_FIRST (&res); c != RS_END (&res); c = RS_NEXT (&res, c)) {
+    if (c[0])
+      printf ("%-10s%-15s |%-19s| %15s (%s) To:'%s'  Cmt:'%s'\n",c[0],c[1],c[2],c[3],c[4],c[5],c[6]);
+  }
+  printf ("Processed %d items\n", num_trans);
+  del_cb_data (&res);
+  return 0;
+}
+
+/*
+ * do_edit
+ *
+ * This function processes an edit command.
+ */
+static int do_edit (void)
+{
+  int ret;
+  int new_tran;
+  int posted = 0;
+  int old_cat = 0;
+  int cat;
+  long long old_cents = 0;
+  long long cents;
+  cat_ls *cl;
+  sqlite3_stmt *stmt;
+
+  if (! opt->is_tran) {
+    printf ("\n***Error in do_edit(), line %d: Must specify a transaction number\n", __LINE__);
+    return -1;
+  }
+  if (!opt->is_to && !opt->is_amt && !opt->is_cat && !opt->is_catt && !opt->is_cmt && !opt->is_date) {
+    printf ("\n***Error in do_edit(), line %d: User must specify something to change for transaction %d\n", __LINE__, opt->tran);
+    return -1;
+  }
+  if (db_begin ())
+    return -1;
+  new_tran = get_next_tran_num ();
+  if (opt->tran > new_tran-1 || opt->tran < 0) {
+    printf ("\n***Error in do_edit(), line %d: Invalid transaction number %d\n", __LINE__, opt->tran);
+    goto EditRollback;
+  }
+  /* if it was posted, its old amount is in its old category's balance */
+  if (opt->is_amt || opt->is_cat) {
+    posted = tran_posted (opt->tran, &old_cat, &old_cents);
+    if (posted < 0 || ckpt_drop (opt->tran))
+      goto EditRollback;
+  }
+  if (opt->is_amt) {
+    ret = verify_number (opt->amt);
+    if (!ret)
+      goto EditRollback;
+    stmt = stmt_get (STMT_EDIT_AMT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, opt->amt, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+    stmt = stmt_get (STMT_ADD_ACT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, "EDT", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 3, opt->tran);
+    sqlite3_bind_text (stmt, 5, opt->amt, -1, SQLITE_STATIC);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+  }
+  if (opt->is_cat) {
+    if (cat_load () || cat_find_num (opt->cat) == 0) {
+      printf ("\n***Error in do_edit(), line %d: Invalid category number %d\n", __LINE__, opt->cat);
+      goto EditRollback;
+    }
+    stmt = stmt_get (STMT_EDIT_CAT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_int (stmt, 1, opt->cat);
+    sqlite3_bind_int (stmt, 2, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+    stmt = stmt_get (STMT_ADD_ACT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, "EDT", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, opt->cat);
+    sqlite3_bind_int (stmt, 3, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+  }
+  if (opt->is_to) {
+    stmt = stmt_get (STMT_EDIT_TO);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, opt->to, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+    stmt = stmt_get (STMT_ADD_ACT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, "EDT", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 3, opt->tran);
+    sqlite3_bind_text (stmt, 6, opt->to, -1, SQLITE_STATIC);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+  }
+  if (opt->is_cmt) {
+    stmt = stmt_get (STMT_EDIT_CMT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, opt->cmt, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+    stmt = stmt_get (STMT_ADD_ACT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, "EDT", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 3, opt->tran);
+    sqlite3_bind_text (stmt, 7, opt->cmt, -1, SQLITE_STATIC);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+  }
+  if (opt->is_date) {
+    stmt = stmt_get (STMT_EDIT_DATE);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, opt->date, -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 2, opt->tran);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+    stmt = stmt_get (STMT_ADD_ACT);
+    if (stmt == 0)
+      goto EditRollback;
+    sqlite3_bind_text (stmt, 1, "EDT", -1, SQLITE_STATIC);
+    sqlite3_bind_int (stmt, 3, opt->tran);
+    sqlite3_bind_text (stmt, 7, opt->date, -1, SQLITE_STATIC);
+    if (stmt_exec (stmt))
+      goto EditRollback;
+  }
+
+  if (posted) {
+    /* move the posted amount from the old balance to the new one - in the same transaction as the edit */
+    if (cat_load () || tran_posted (opt->tran, &cat, &cents) != 1)
+      goto EditRollback;
+    if (cat != old_cat || cents != old_cents) {
+      cl = cat_find_num (old_cat);
+      if (cl != 0 && cat_apply (cl, -old_cents, "do_edit"))
+        goto EditRollback;
+      cl = cat_find_num (cat);
+      if (cl != 0 && cat_apply (cl, cents, "do_edit"))
+        goto EditRollback;
+    }
+  }
+  return db_commit ();
+
+EditRollback:
+  db_rollback ();
+  return -1;
+}
+
+/*
+ * do_rm
+ *
+ * This function processes an rm command.  It replicates a transaction into the journal table and then removes it from the tran table.
+ * If the transaction was posted, only its own category's balance changes; nothing else is reposted.
+ */
+static int do_rm (void)
+{
+  int new_tran;
+  int posted;
+  int cat;
+  long long cents;
+  cat_ls *cl;
+  stmt_id id;
+  sqlite3_stmt *stmt;
+
+  if (! opt->is_tran) {
+    printf ("\n***Error in do_rm(), line %d: Must specify a transaction number\n", __LINE__);
+    return -1;
+  }
+  if (db_begin ())
+    return -1;
+  new_tran = get_next_tran_num ();
+  if (opt->tran >= new_tran || opt->tran < 0) {
+    printf ("\n***Error: do_rm(), line %d: Invalid tran_id %d\n", __LINE__, opt->tran);
+    goto RmRollback;
+  }
+  posted = tran_posted (opt->tran, &cat, &cents);
+  if (posted < 0 || ckpt_drop (opt->tran))
+    goto RmRollback;
+  /* update the status to show removed, copy it to the archive table, then remove it */
+  for (id = STMT_RM_FLAG; id <= STMT_RM_DELETE; id++) {
+    stmt = stmt_get (id);
+    if (stmt == 0)
+      goto RmRollback;
+    sqlite3_bind_int (stmt, 1, opt->tran);
+    if (stmt_exec (stmt))
+      goto RmRollback;
+  }
+  stmt = stmt_get (STMT_ADD_ACT);
+  if (stmt == 0)
+    goto RmRollback;
+  sqlite3_bind_text (stmt, 1, "RMV", -1, SQLITE_STATIC);
+  sqlite3_bind_int (stmt, 3, opt->tran);
+  if (stmt_exec (stmt))
+    goto RmRollback;
+  /* take a posted amount back out of its category; an unposted one never got there */
+  if (posted) {
+    if (cat_load ())
+      goto RmRollback;
+    cl = cat_find_num (cat);
+    if (cl != 0 && cat_apply (cl, -cents, "do_rm"))
+      goto RmRollback;
+  }
+  return db_commit ();
+
+RmRollback:
+  db_rollback ();
+  return -1;
+}
+
+/*
+ * visit_cat_total
+ *
+ * Row visitor for "SELECT cat_num,SUM(amt),COUNT(*) ... GROUP BY cat_num".  It formats the category's total into the registry and adds
+ * the count to the int that arg points at.
+ */
+static int visit_cat_total (void *arg, int argc, const char **row)
+{
+  int *num_trans = arg;
+  cat_ls *cl;
+
+  if (argc < 3) {
+    printf ("\n***Error in visit_cat_total(), line %d: The query gave %d columns; 3 are needed\n", __LINE__, argc);
+    return -1;
+  }
+  cl = row[0] ? cat_find_num (atoi (row[0])) : 0;
+  if (cl == 0 || row[1] == 0)
+    return 0;
+  bcmoney_fmt (strtoll (row[1], 0, 10), cl->amt, SIZE_AMT+1);
+  *num_trans += atoi (row[2]);
+  return 0;
+}
+
+/*
+ * do_exp
+ *
+ * This function processes the exp command.  This looks at only expenses in the tran table, not including ones with adjust in the to or cmt field.
+ */
+static int do_exp (void)
+{
+  int ret;
+  int i;
+  int num_cats;
+  int num_trans;
+  char tmp[SIZE_ARB+1];
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  /* first, make sure the category registry is loaded, and start each category's amount at 0 */
+  if (cat_load ())
+    return -1;
+  num_cats = opt->cats.num_cats;
+  if (num_cats == 0) {
+    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, stmt_sql[STMT_CAT_LOAD]);
+    return -1;
+  }
+  for (i = 0; i < num_cats; i++)
+    bcmoney_fmt (0, opt->cats.cats[i].amt, SIZE_AMT+1);
+  opt->cats.reformat = TRUE;
+  /* now, let's grab the transactions that we need to process */
+  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
+    /* process beg and end limits */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt < 0 AND num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg, opt->end);
+  }
+  else if (opt->is_beg == TRUE) {
+    /* only opt->beg - likelihood() keeps SQLite on the rowids, as with STMT_CKPT_SUMS */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt < 0 AND likelihood(num >= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg);
+  }
+  else if (opt->is_end == TRUE) {
+    /* only opt->end */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt < 0 AND likelihood(num <= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->end);
+  }
+  else {
+    /* otherwise, there are no limits - calculate everything */
+    snprintf (tmp, SIZE_ARB, "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt < 0 AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;");
+  }
+  /* SQLite does the summing; the visitor just formats each category's total */
+  num_trans = 0;
+  ret = exec_rows (tmp, visit_cat_total, &num_trans);
+  if (ret < 0)
+    return -1;
+  if (ret == 0) {
+    printf ("\nNothing to consider.\n");
+    return 0;
+  }
+  /* now, print the data */
+  strcpy (tot, "0.00");
+  printf ("==========================================================================================\n");
+  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+
+  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
+  return 0;
+}
+
+/*
+ * do_inc
+ *
+ * This function processes the inc command.  This looks at only income in the tran table, not including ones with adjust in the to or cmt field.
+ */
+static int do_inc (void)
+{
+  int ret;
+  int i;
+  int num_cats;
+  int num_trans;
+  char tmp[SIZE_ARB+1];
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  /* first, make sure the category registry is loaded, and start each category's amount at 0 */
+  if (cat_load ())
+    return -1;
+  num_cats = opt->cats.num_cats;
+  if (num_cats == 0) {
+    printf ("\n***Error in do_inc(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, stmt_sql[STMT_CAT_LOAD]);
+    return -1;
+  }
+  for (i = 0; i < num_cats; i++)
+    bcmoney_fmt (0, opt->cats.cats[i].amt, SIZE_AMT+1);
+  opt->cats.reformat = TRUE;
+  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
+    /* process beg and end limits */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt >= 0 AND num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg, opt->end);
+  }
+  else if (opt->is_beg == TRUE) {
+    /* only opt->beg */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt >= 0 AND likelihood(num >= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg);
+  }
+  else if (opt->is_end == TRUE) {
+    /* only opt->end */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt >= 0 AND likelihood(num <= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->end);
+  }
+  else {
+    /* now, let's grab the transactions that we need to process */
+    snprintf (tmp, SIZE_ARB, "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE amt >= 0 AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;");
+  }
+  /* SQLite does the summing; the visitor just formats each category's total */
+  num_trans = 0;
+  ret = exec_rows (tmp, visit_cat_total, &num_trans);
+  if (ret < 0)
+    return -1;
+  if (ret == 0) {
+    printf ("\nNothing to consider.\n");
+    return 0;
+  }
+  /* now, print the data */
+  strcpy (tot, "0.00");
+  printf ("==========================================================================================\n");
+  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+
+  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
+  return 0;
+}
+
+/*
+ * do_net
+ *
+ * This function processes the net command.  This adds up all transactions, excluding the ones with adjust in the to or cmt fields.
+ */
+static int do_net (void)
+{
+  int ret;
+  int i;
+  int num_cats;
+  int num_trans;
+  char tmp[SIZE_ARB+1];
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  /* first, make sure the category registry is loaded, and start each category's amount at 0 */
+  if (cat_load ())
+    return -1;
+  num_cats = opt->cats.num_cats;
+  if (num_cats == 0) {
+    printf ("\n***Error in do_net(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, stmt_sql[STMT_CAT_LOAD]);
+    return -1;
+  }
+  for (i = 0; i < num_cats; i++)
+    bcmoney_fmt (0, opt->cats.cats[i].amt, SIZE_AMT+1);
+  opt->cats.reformat = TRUE;
+  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
+    /* process beg and end limits */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg, opt->end);
+  }
+  else if (opt->is_beg == TRUE) {
+    /* only opt->beg */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE likelihood(num >= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->beg);
+  }
+  else if (opt->is_end == TRUE) {
+    /* only opt->end */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE likelihood(num <= %d, 0.001) AND to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;",
+        opt->end);
+  }
+  else {
+    /* now, let's grab the transactions that we need to process */
+    snprintf (tmp, SIZE_ARB, "SELECT cat_num,SUM(amt),COUNT(*) FROM tran WHERE to_who NOT LIKE '%%adjust%%' GROUP BY cat_num;");
+  }
+  /* SQLite does the summing; the visitor just formats each category's total */
+  num_trans = 0;
+  ret = exec_rows (tmp, visit_cat_total, &num_trans);
+  if (ret < 0)
+    return -1;
+  if (ret == 0) {
+    printf ("\nNothing to consider.\n");
+    return 0;
+  }
+  /* now, print the data */
+  strcpy (tot, "0.00");
+  printf ("==========================================================================================\n");
+  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+
+  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
+  return 0;
+}
+
+/*
+ * shell_quote
+ *
+ * This function copies str into buf so it can go between single quotes in a shell command: each ' becomes '\''.  A null str
+ * comes back empty.  It returns buf.
+ */
+static char *shell_quote (const char *str, char *buf, size_t size)
+{
+  size_t i = 0;
+
+  for (; str != 0 && *str != '\0' && i + 5 < size; str++) {
+    if (*str == '\'') {
+      memcpy (&buf[i], "'\\''", 4);
+      i += 4;
+    }
+    else
+      buf[i++] = *str;
+  }
+  buf[i] = '\0';
+  return buf;
+}
+
+/*
+ * visit_scr_cat
+ *
+ * Row visitor that writes the command to recreate one category.  arg is the "--bgt DIR " prefix, or "".
+ */
+static int visit_scr_cat (void *arg, int argc, const char **row)
+{
+  const char *bgt = arg;
+  char name[2*FIELD_ARB+1];
+  char cmt[2*FIELD_ARB+1];
+
+  if (argc < 4) {
+    printf ("\n***Error in visit_scr_cat(), line %d: The query gave %d columns; 4 are needed\n", __LINE__, argc);
+    return -1;
+  }
+  printf ("# cat '%s', dtime '%s'\n", row[0], row[1]);
+  printf ("bgt %s--catt '%s' --cmt '%s'\n", bgt, shell_quote (row[2], name, sizeof (name)), shell_quote (row[3], cmt, sizeof (cmt)));
+  return 0;
+}
+
+/*
+ * visit_scr_tran
+ *
+ * Row visitor that writes the command to re-enter one transaction.  arg is the "--bgt DIR " prefix, or "".
+ */
+static int visit_scr_tran (void *arg, int argc, const char **row)
+{
+  const char *bgt = arg;
+  char name[2*FIELD_ARB+1];
+  char to[2*FIELD_ARB+1];
+  char cmt[2*FIELD_ARB+1];
+
+  if (argc < 7) {
+    printf ("\n***Error in visit_scr_tran(), line %d: The query gave %d columns; 7 are needed\n", __LINE__, argc);
+    return -1;
+  }
+  if (row[0] == 0)
+    return 0;
+  printf ("# tran '%s', dtime '%s', status '%s'\n", row[0], row[2], row[4]);
+  printf ("bgt %s--add --catt '%s' --date '%s' --amt '%s' --to '%s' --cmt '%s'\n", bgt, shell_quote (row[1], name, sizeof (name)), row[2], row[3],
+      shell_quote (row[5], to, sizeof (to)), shell_quote (row[6], cmt, sizeof (cmt)));
+  return 0;
+}
+
+/*
+ * do_scr
+ *
+ * This function generates the commands that would be necessary to replicate the contents of the bgt tran table.
+ */
+static int do_scr (void)
+{
+  int ret;
+  char tmp[SIZE_ARB+1];
+  char bgt[SIZE_ARB+1];
+
+  if (opt->is_bgt == TRUE)
+    snprintf (bgt, SIZE_ARB, "--bgt %s ", opt->bgt);
+  else
+    bgt[0] = '\0';
+
+  /* first, the commands to create the categories */
+  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,comment FROM cat ORDER BY num;");
+  ret = exec_rows (tmp, visit_scr_cat, bgt);
+  if (ret < 0)
+    return -1;
+  if (ret == 0) {
+    printf ("\n***Error in do_scr(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
+    return -1;
+  }
+  /* then one --add per transaction, written as each row comes back */
+  snprintf (tmp, SIZE_ARB,
+      "SELECT t.num,c.name,t.dtime,bgt_amt(t.amt),t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
+  ret = exec_rows (tmp, visit_scr_tran, bgt);
+  if (ret < 0)
+    return -1;
+  return 0;
+}
+
+/*
+ * do_arch
+ *
+ * This function archives everything in the tran table, and then places the minimal transactions into tran to get the balances of the accounts where they
+ * were before the archive was called.
+ */
+static int do_arch (void)
+{
+  int ret;
+  int trnum;
+  int i;
+  stmt_id id;
+  sqlite3_stmt *stmt;
+  char tot[SIZE_AMT+1];
+  bcnum_sum total = BCNUM_SUM_INIT (2);
+
+  ret = inputline ("Are you sure you want to archive everything? (Enter 'yes' to proceed) >> ");
+  if (opt->inputline[0] != 'y' && opt->inputline[0] != 'Y' &&
+      opt->inputline[1] != 'e' && opt->inputline[1] != 'Y' &&
+      opt->inputline[2] != 's' && opt->inputline[2] != 'S') {
+    printf ("Cancelled by user.\n");
+    return 0;
+  }
+  /* the posting, the archive and the new balances all go in one transaction */
+  if (db_begin ())
+    return -1;
+  /* OK to proceed - First, do a posting */
+  ret = do_post(1);
+  if (ret)
+    goto ArchRollback;
+  /* Next, archive the transactions. */
+  for (id = STMT_ARCH_FLAG; id <= STMT_ARCH_CLEAR; id++) {
+    if (stmt_exec (stmt_get (id)))
+      goto ArchRollback;
+  }
+  /* Now, enter transactions to get balances where they should be. */
+  strcpy (tot, "0.00");
+  printf ("==========================================================================================\n");
+  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
+  for (i = 0, trnum = 1; i < opt->cats.num_cats; i++) {
+    printf ("%-12d%-22s%-40s%16s\n", opt->cats.cats[i].cat, opt->cats.cats[i].dtime, opt->cats.cats[i].name, opt->cats.cats[i].amt);
+    bcnum_sum_add (&total, opt->cats.cats[i].amt);
+    stmt = stmt_get (STMT_ARCH_BALANCE);
+    if (stmt == 0)
+      goto ArchRollback;
+    sqlite3_bind_int (stmt, 1, trnum++);
+    sqlite3_bind_int (stmt, 2, opt->cats.cats[i].cat);
+    sqlite3_bind_int64 (stmt, 3, opt->cats.cats[i].cents);
+    if (stmt_exec (stmt))
+      goto ArchRollback;
+  }
+  printf ("==========================================================================================\n");
+  put_sum (tot, &total);
+  bcnum_sum_free (&total);
+  printf ("                                                                   Total: %16s\n", tot);
+  printf ("==========================================================================================\n");
+  /* the old checkpoints cover transactions that are gone; start over from the opening balances */
+  if (ckpt_drop (-1) || ckpt_write (TRUE))
+    goto ArchRollback;
+  /* Finally, indicate the activity that occurred. */
+  stmt = stmt_get (STMT_ADD_ACT);
+  if (stmt == 0)
+    goto ArchRollback;
+  sqlite3_bind_text (stmt, 1, "ARC", -1, SQLITE_STATIC);
+  sqlite3_bind_text (stmt, 7, "Archived everything.", -1, SQLITE_STATIC);
+  if (stmt_exec (stmt))
+    goto ArchRollback;
+
+  return db_commit ();
+
+ArchRollback:
+  db_rollback ();
+  bcnum_sum_free (&total);
+  return -1;
+}
+
+/*
+ * visit_csv
+ *
+ * Row visitor that writes one transaction as a CSV line, with the amount repeated under its category's column.  The header line
+ * is written before the first row; arg points at the flag that records it.
+ */
+static int visit_csv (void *arg, int argc, const char **row)
+{
+  int *header = arg;
+  cat_ls *cl;
+  int slot;
+  int i;
+
+  if (argc < 7) {
+    printf ("\n***Error in visit_csv(), line %d: The query gave %d columns; 7 are needed\n", __LINE__, argc);
+    return -1;
+  }
+  if (! *header) {
+    printf ("\"Transaction\",\"Date/time\",\"To field\",\"Comment\",\"Amount\"");
+    for (i = 0; i < opt->cats.num_cats; i++)
+      printf (",\"%s\"", opt->cats.cats[i].name);
+    printf ("\n");
+    *header = TRUE;
+  }
+  cl = row[1] ? cat_find_num (atoi (row[1])) : 0;
+  slot = cl ? cl - opt->cats.cats : -1;
+  printf ("\"%s\",\"%s\",\"%s\",\"%s\",%s", row[0], row[2], row[5], row[6], row[3]);
+  for (i = 0; i < opt->cats.num_cats; i++) {
+    if (i == slot)
+      printf (",%s", row[3]);
+    else
+      printf (",");
+  }
+  printf ("\n");
+  return 0;
+}
+
+/*
+ * do_csv
+ *
+ * Generate a CSV output of the data.
+ */
+static int do_csv (void)
+{
+  int header = FALSE;
+  int num_cats;
+  int num_trans;
+  char tmp[SIZE_ARB+1];
+
+  /* first, make sure the category registry is loaded */
+  if (cat_load ())
+    return -1;
+  num_cats = opt->cats.num_cats;
+  if (num_cats == 0) {
+    printf ("\n***Error in do_csv(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, stmt_sql[STMT_CAT_LOAD]);
+    return -1;
+  }
+  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
+    /* process beg and end limits */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT num,cat_num,dtime,bgt_amt(amt),status,to_who,comment FROM tran WHERE num BETWEEN %d AND %d;",
+        opt->beg, opt->end);
+  }
+  else if (opt->is_beg == TRUE) {
+    /* only opt->beg */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT num,cat_num,dtime,bgt_amt(amt),status,to_who,comment FROM tran WHERE num >= %d;",
+        opt->beg);
+  }
+  else if (opt->is_end == TRUE) {
+    /* only opt->end */
+    snprintf (tmp, SIZE_ARB,
+        "SELECT num,cat_num,dtime,bgt_amt(amt),status,to_who,comment FROM tran WHERE num <= %d;",
+        opt->end);
+  }
+  else {
+    /* get them all*/
+    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,bgt_amt(amt),status,to_who,comment FROM tran;");
+  }
+  /* the header goes out with the first row, and each row is written as soon as SQLite hands it over */
+  num_trans = exec_rows (tmp, visit_csv, &header);
+  if (num_trans < 0)
+    return -1;
+  if (num_trans == 0)
+    printf ("\nNothing to consider.\n");
+  return 0;
+}
+
+static int do_qif (void)
+{
+  int ret;
+  FILE *fp;
+  FILE *outfp;
+  char *data, *cp;
+  qifItem *qi;
+  int i;
+  int lnctr = 0;
+  static char *rqda[QIF_SIZE_RQDA];
+
+  if (! fexists (opt->qif)) {
+    printf ("***Error in do_qif(), line %d: The qif file '%s' does not exist.\n", __LINE__, opt->qif);
+    return -1;
+  }
+  // The outfp is there so you could specify a file to output to on the command-line, if you wanted to.
+  outfp = stdout;
+  for (i = 0; i < QIF_SIZE_RQDA; i++) {
+    rqda[i] = malloc (QIF_SIZE_DESC+1);
+    if (0 == rqda[i]) {
+      printf ("***Error in do_qif(), line %d: fatal allocation error allocating %d bytes.\n", __LINE__, QIF_SIZE_DESC+1);
+      return -1;
+    }
+    memset (rqda[i], 0, QIF_SIZE_DESC+1);
+  }
+  data = malloc (DESCR_ARB+1);
+  if (0 == data) {
+    printf ("***Error in do_qif(), line %d: fatal allocation error allocting %d bytes.\n", __LINE__, DESCR_ARB+1);
+    for (i = 0; i < QIF_SIZE_RQDA; i++) {
+      free (rqda[i]);
+    }
+    return -1;
+  }
+  memset (data, 0, DESCR_ARB+1);
+  fp = fopen (opt->qif, "rb");
+  if (0 == fp) {
+    printf ("***Error in do_qif(), line %d: Couldn't open %s\n", __LINE__, opt->qif);
+    for (i = 0; i < QIF_SIZE_RQDA; i++) {
+      free (rqda[i]);
+    }
+    return -1;
+  }
+  while (TRUE) {
+    cp = fgets (data, DESCR_ARB, fp);
+    if (feof (fp))
+      break;
+    if (cp == 0)
+      break;
+    lnctr++;
+    if (data[0] == '\0' || data[0] == '\n' || data[0] == '\r')
+      continue;
+
+    cp = strchr (data, '\n');
+    if (0 != cp)
+      *cp = '\0';
+    cp = strchr (data, '\r');
+    if (0 != cp)
+      *cp = '\0';
+
+    if (data[0] != '!') {
+      printf ("***Error in do_qif(), line %d: file \"%s\", line %d: invalid qif file\n", __LINE__, opt->qif, lnctr);
+      fclose (fp);
+      for (i = 0; i < QIF_SIZE_RQDA; i++) {
+        free (rqda[i]);
+      }
+      return -1;
+    }
+    /* Should be: !Type:XXXX */
+    cp = strchr (data, ':');
+    if (cp != 0 && strncmp (cp+1, "Bank", 4)) {
+      /* skip through anything but Bank */
+      while (TRUE) {
+        lnctr++;
+        cp = fgets (data, DESCR_ARB+1, fp);
+        if (feof (fp))
+          goto CloseHerOut;
+        if (cp == 0)
+          goto CloseHerOut;
+        if (data[0] == '\0')
+          break;
+        if (data[0] == '!') {
+          cp = strchr (data, ':');
+          if (cp != 0)
+            break;
+          else
+            continue;
+        }
+      }
+      cp = strchr (data, ':');
+    }
+    else {
+      /* OK, here's the meat of the processing */
+      while (TRUE) {
+        int isFinished;
+        isFinished = FALSE;
+        for (i = 0; i < QIF_SIZE_RQDA; i++) {
+          lnctr++;
+          cp = fgets (data, DESCR_ARB+1, fp);
+          if (feof (fp))
+            goto CloseHerOut;
+          if (cp == 0)
+            goto CloseHerOut;
+          if (data[0] == '\0')
+            break;
+          cp = strchr (data, '\n');
+          if (0 != cp)
+            *cp = '\0';
+          cp = strchr (data, '\r');
+          if (0 != cp)
+            *cp = '\0';
+          if (data[0] == '\0')
+            continue;
+
+          if (data[0] != '^') {
+            snprintf (rqda[i], QIF_SIZE_DESC, "%s", data);
+            rqda[i+1][0] = '\0';
+          }
+          else {
+            isFinished = TRUE;
+            break;
+          }
+        }
+        if (isFinished == FALSE) {
+          printf ("***Error in do_qif(), line %d: file \"%s\", line %d: QIF_SIZE_RQDA (%d) is not big enough\n",
+              __LINE__, opt->qif, lnctr, QIF_SIZE_RQDA);
+          for (i = 0; i < QIF_SIZE_RQDA; i++) {
+            free (rqda[i]);
+          }
+          return -1;
+        }
+        /*
+         * OK, parse the data in rqda and return a qifItem.  Then, print out the 
+         * data in the qifItem per the needs of the application.  We need to
+         * free the memory that the qifItem is using.
+         */
+        qi = parseQIFItem (&rqda[0], opt->qif, lnctr);
+        if (qi == 0) {
+          fprintf (stdout, "***Warning in do_qif(), line %d: qif item invalid around line %d\n", __LINE__, lnctr);
+          continue;
+        }
+        else {
+          if (strcmp (qi->category, "[Checking]") == 0) {
+            free (qi);
+            continue;
+          }
+          /* split item */
+          if (qi->isSplit) {
+            /* print it out as separate line items */
+            int i;
+            for (i = 0; i < 30 && qi->sia[i] != 0; i++) {
+              remove_chr (qi->memo, '\'');
+              remove_chr (qi->memo, '&');
+              remove_chr (qi->payee, '\'');
+              remove_chr (qi->payee, '&');
+              ret = get_cat_num_from_name (qi->sia[i]->split_cat);
+              if (ret == -1) {
+                printf ("***Warning in do_qif(), line %d: qif category '%s' invalid around line %d\n", __LINE__, qi->sia[i]->split_cat, lnctr);
+                continue;
+              }
+              if (opt->is_bgt) {
+                printf ("bgt --bgt %s --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s-%d'\n",
+                    opt->bgt, qi->sia[i]->amt, qi->sia[i]->split_cat, qi->payee, qi->date, qi->check, qi->memo, i);
+              }
+              else {
+                printf ("bgt --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s-%d'\n",
+                    qi->sia[i]->amt, qi->sia[i]->split_cat, qi->payee, qi->date, qi->check, qi->memo, i);
+              }
+            }
+          }
+          /* non-split item */
+          else {
+            remove_chr (qi->memo, '\'');
+            remove_chr (qi->memo, '&');
+            remove_chr (qi->payee, '\'');
+            remove_chr (qi->payee, '&');
+            ret = get_cat_num_from_name (qi->category);
+            if (ret == -1) {
+              printf ("***Warning in do_qif(), line %d: qif category '%s' invalid around line %d\n", __LINE__, qi->category, lnctr);
+              continue;
+            }
+            if (opt->is_bgt) {
+              printf ("bgt --bgt %s --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s'\n",
+                  opt->bgt, qi->tran, qi->category, qi->payee, qi->date, qi->check, qi->memo);
+            }
+            else {
+              printf ("bgt --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s'\n",
+                  qi->tran, qi->category, qi->payee, qi->date, qi->check, qi->memo);
+            }
+          }
+        }
+        free (qi);
+      }
+    }
+    /* should be done... */
+  }
+CloseHerOut:
+  fclose (fp);
+  free (data);
+  for (i = 0; i < QIF_SIZE_RQDA; i++) {
+    free (rqda[i]);
+  }
+  return 0;
+}
+
+
+/******************************************
+ * main function.
+ * ****************************************/
+/*
+ * split_args
+ *
+ * This function splits a command into words the way the shell would for the commands that --scr writes.  Words are separated by
+ * blanks, '...' quotes anything, "..." quotes anything but \" and \\, a backslash quotes the next character, and an unquoted # at
+ * the start of a word starts a comment.  The words are written back into line and argv[1] on point at them; argv[0] is left for
+ * the program name.  A first word without dashes is taken as the switch of that name, for the shell.  It returns the number of
+ * entries in argv, or -1 if a quote isn't closed or there are too many words.
+ */
+static int split_args (char *line, char *argv[], int max)
+{
+  static char cmd[FIELD_ARB+1];
+  char *src = line;
+  char *dst = line;
+  int argc = 1;
+
+  argv[0] = "bgt";
+  for (;;) {
+    while (*src != '\0' && isspace ((unsigned char)*src))
+      src++;
+    if (*src == '\0' || *src == '#')
+      break;
+    if (argc == max)
+      return -1;
+    argv[argc++] = dst;
+    while (*src != '\0' && ! isspace ((unsigned char)*src)) {
+      if (*src == '\'') {
+        for (src++; *src != '\''; )
+          if (*src == '\0')
+            return -1;
+          else
+            *dst++ = *src++;
+        src++;
+      }
+      else if (*src == '"') {
+        for (src++; *src != '"'; ) {
+          if (*src == '\0')
+            return -1;
+          if (*src == '\\' && (src[1] == '"' || src[1] == '\\'))
+            src++;
+          *dst++ = *src++;
+        }
+        src++;
+      }
+      else if (*src == '\\' && src[1] != '\0') {
+        src++;
+        *dst++ = *src++;
+      }
+      else
+        *dst++ = *src++;
+    }
+    /* dst never passes src, so ending the word can't clobber what is still to be read */
+    if (*src != '\0')
+      src++;
+    *dst++ = '\0';
+  }
+  /* lines written by --scr start with the program name */
+  if (argc > 1 && (! strcmp (argv[1], "bgt") || (strlen (argv[1]) > 4 && ! strcmp (argv[1] + strlen (argv[1]) - 4, "/bgt")))) {
+    memmove (&argv[1], &argv[2], (argc - 2) * sizeof (char *));
+    argc--;
+  }
+  /* a command can be given as a bare word: "ls" is "--ls", "add --catt Food ..." is "--add --catt Food ..." */
+  if (argc > 1 && argv[1][0] != '-') {
+    snprintf (cmd, FIELD_ARB, "--%s", argv[1]);
+    argv[1] = cmd;
+  }
+  return argc;
+}
+
+/*
+ * do_batch
+ *
+ * This function runs the commands in opt->batch (or standard input, for -), one per line in the same option syntax as the
+ * command-line, against the database that is already open.  The commands run inside one SQL transaction, or one per opt->chunk
+ * commands.  The first command that fails stops the batch and rolls back the commands since the last commit.  At the end it reports
+ * how many commands ran and how fast.
+ */
+static int do_batch (void)
+{
+  FILE *fp;
+  char line[SIZE_ARB+1];
+  char *argv[SIZE_ARGV];
+  int argc;
+  int lnctr = 0;
+  int num_cmds = 0;
+  int num_commits = 0;
+  int in_chunk = 0;
+  int ret = 0;
+  struct timeval beg;
+  struct timeval end;
+  double secs;
+
+  if (! strcmp (opt->batch, "-"))
+    fp = stdin;
+  else
+    fp = fopen (opt->batch, "rb");
+  if (fp == 0) {
+    printf ("\n***Error in do_batch(), line %d: could not open %s to read.\n", __LINE__, opt->batch);
+    return -1;
+  }
+  gettimeofday (&beg, 0);
+  while (fgets (line, SIZE_ARB, fp) != 0) {
+    lnctr++;
+    if (strchr (line, '\n') == 0 && ! feof (fp)) {
+      printf ("\n***Error in do_batch(), line %d: %s, line %d is too long\n", __LINE__, opt->batch, lnctr);
+      ret = -1;
+      break;
+    }
+    argc = split_args (line, argv, SIZE_ARGV);
+    if (argc < 0) {
+      printf ("\n***Error in do_batch(), line %d: %s, line %d has an unclosed quote or too many words\n", __LINE__, opt->batch, lnctr);
+      ret = -1;
+      break;
+    }
+    if (argc == 1)
+      /* blank line or comment */
+      continue;
+    if (opt->tx_depth == 0 && db_begin ()) {
+      ret = -1;
+      break;
+    }
+    clear_cmd_opts ();
+    ret = parse_opts (argc, argv, FALSE);
+    if (ret == 0)
+      ret = run_opts ();
+    if (ret < 0) {
+      printf ("\n***Error in do_batch(), line %d: %s, line %d failed\n", __LINE__, opt->batch, lnctr);
+      break;
+    }
+    ret = 0;
+    num_cmds++;
+    in_chunk++;
+    if (opt->chunk > 0 && in_chunk >= opt->chunk) {
+      if (db_commit ()) {
+        ret = -1;
+        break;
+      }
+      num_commits++;
+      in_chunk = 0;
+    }
+  }
+  if (fp != stdin)
+    fclose (fp);
+  if (ret == 0 && opt->tx_depth > 0) {
+    if (db_commit ())
+      ret = -1;
+    else
+      num_commits++;
+  }
+  if (ret != 0) {
+    db_rollback ();
+    printf ("The commands since the last commit were rolled back.\n");
+  }
+  gettimeofday (&end, 0);
+  secs = (end.tv_sec - beg.tv_sec) + (end.tv_usec - beg.tv_usec) / 1e6;
+  printf ("Ran %d commands from %s in %.3f seconds (%.0f commands/sec), %d commit%s\n", num_cmds, opt->batch, secs,
+      secs > 0 ? num_cmds / secs : 0.0, num_commits, num_commits == 1 ? "" : "s");
+  return ret;
+}
+
+/*
+ * long_options - the switches bgt takes, for getopt_long() and for the shell's completion.
+ */
+static struct option long_options[] = {
+  {"bgt",        1, 0, 'b'},
+  {"cat",        1, 0, 'c'},
+  {"catt",       1, 0, 'C'},
+  {"tran",       1, 0, 't'},
+  {"ls",         0, 0, 'l'},
+  {"add",        0, 0, 'a'},
+  {"to",         1, 0, 'T'},
+  {"amt",        1, 0, 'A'},
+  {"cmt",        1, 0, 'm'},
+  {"cedit",      0, 0, 'd'},
+  {"crm",        0, 0, 'G'},
+  {"edit",       0, 0, 'e'},
+  {"rm",         0, 0, 'r'},
+  {"split",      0, 0, 's'},
+  {"adj",        0, 0, 'j'},
+  {"src_cat",    1, 0, 'R'},
+  {"dst_cat",    1, 0, 'S'},
+  {"qry",        1, 0, 'q'},
+  {"recalc",     0, 0, 'L'},
+  {"full",       0, 0, 'F'},
+  {"threads",    1, 0, 'W'},
+  {"explain",    0, 0, 'X'},
+  {"arch",       0, 0, 'H'},
+  {"pr",         0, 0, 'p'},
+  {"exp",        0, 0, 'x'},
+  {"inc",        0, 0, 'N'},
+  {"net",        0, 0, 'n'},
+  {"beg",        1, 0, 'B'},
+  {"end",        1, 0, 'E'},
+  {"scr",        0, 0, 'o'},
+  {"csv",        0, 0, 'v'},
+  {"date",       1, 0, 'D'},
+  {"nclr",       1, 0, 'P'},
+  {"tot",        0, 0, 'O'},
+  {"qif",        1, 0, 'Q'},
+  {"batch",      1, 0, 'K'},
+  {"chunk",      1, 0, 'k'},
+  {"shell",      0, 0, 'i'},
+  {"daemon",     0, 0, 'y'},
+  {"client",     0, 0, 'z'},
+  {"sock",       1, 0, 'Y'},
+  {"profile",    1, 0, 'M'},
+  {"help",       0, 0, 'h'},
+  {0,0,0,0}
+};
+
+/*
+ * parse_opts
+ *
+ * This function parses one command line into opt.  cmdline is TRUE for the real command-line and FALSE for a line of a batch,
+ * where the options that pick the database or start a batch are left alone.  It returns 0 if there is something to run, 1 if the
+ * help screen was shown, and -1 on error.
+ */
+static int parse_opts (int argc, char *argv[], int cmdline)
+{
+  int ch;
+  int option_index = 0;
+
+  opterr = 1; /* tell getopt() to hush */
+  optind = 0; /* start over - a batch parses many command lines */
+  while ( (ch = getopt_long (argc, argv, "b:c:C:t:laT:A:m:dGersjR:S:q:LFW:XHpxNnB:E:ovDPOQ:K:k:iyzY:M:h", long_options, &option_index)) != EOF) {
+    switch (ch) {
+      case 'b': /* --bgt */
+        if (! cmdline)
+          /* a batch runs against the database it was started on; --scr output has --bgt on every line */
+          break;
+        opt->is_bgt = TRUE;
+        strncpy (opt->bgt, optarg, DESCR_ARB);
+        break;
+      case 'K': /* --batch */
+        if (! cmdline) {
+          printf ("\n***Error in parse_opts(), line %d: --batch can't be used inside a batch or the shell\n", __LINE__);
+          return -1;
+        }
+        opt->is_batch = TRUE;
+        strncpy (opt->batch, optarg, SIZE_ARB);
+        break;
+      case 'i': /* --shell */
+        if (! cmdline) {
+          printf ("\n***Error in parse_opts(), line %d: --shell can't be used inside a batch or the shell\n", __LINE__);
+          return -1;
+        }
+        opt->is_shell = TRUE;
+        break;
+      case 'y': /* --daemon */
+        if (! cmdline) {
+          printf ("\n***Error in parse_opts(), line %d: --daemon can't be used inside a batch or the shell\n", __LINE__);
+          return -1;
+        }
+        opt->is_daemon = TRUE;
+        break;
+      case 'z': /* --client */
+        if (! cmdline) {
+          printf ("\n***Error in parse_opts(), line %d: --client can't be used inside a batch or the shell\n", __LINE__);
+          return -1;
+        }
+        opt->is_client = TRUE;
+        break;
+      case 'Y': /* --sock */
+        if (! cmdline)
+          break;
+        strncpy (opt->sock, optarg, PATH_MAX-1);
+        break;
+      case 'M': /* --profile */
+        if (! cmdline)
+          /* the database is already open */
+          break;
+        strncpy (opt->profile, optarg, SM_ARY);
+        break;
+      case 'k': /* --chunk */
+        if (! cmdline)
+          break;
+        opt->chunk = atoi (optarg);
+        if (opt->chunk < 0) {
+          printf ("\n***Error in parse_opts(), line %d: --chunk needs a number of commands, not '%s'\n", __LINE__, optarg);
+          return -1;
+        }
+        break;
+      case 'c': /* --cat */
+        opt->is_cat = TRUE;
+        opt->cat = atoi (optarg);
+        break;
+      case 'C': /* --catt */
+        opt->is_catt = TRUE;
+        strncpy (opt->catt, optarg, FIELD_ARB);
+        break;
+      case 't': /* --tran */
+        opt->is_tran = TRUE;
+        opt->tran = atoi (optarg);
+        break;
+      case 'l': /* --ls */
+        opt->is_ls = TRUE;
+        break;
+      case 'a': /* --add */
+        opt->is_add = TRUE;
+        break;
+      case 'T': /* --to */
+        opt->is_to = TRUE;
+        strncpy (opt->to, optarg, FIELD_ARB);
+        break;
+      case 'A': /* --amt */
+        opt->is_amt = TRUE;
+        strncpy (opt->amt, optarg, SIZE_AMT);
+        break;
+      case 'm': /* --cmt */
+        opt->is_cmt = TRUE;
+        strncpy (opt->cmt, optarg, FIELD_ARB);
+        break;
+      case 'd': /* --cedit */
+        opt->is_cedit = TRUE;
+        break;
+      case 'G': /* --crm */
+        opt->is_crm = TRUE;
+        strncpy (opt->crm, optarg, FIELD_ARB);
+        break;
+      case 'e': /* --edit */
+        opt->is_edit = TRUE;
+        break;
+      case 'r': /* --rm */
+        opt->is_rm = TRUE;
+        break;
+      case 's': /* --split */
+        opt->is_split = TRUE;
+        break;
+      case 'j': /* --adj */
+        opt->is_adj = TRUE;
+        break;
+      case 'R': /* --src_cat */
+        opt->is_src_cat = TRUE;
+        opt->src_cat = atoi (optarg);
+        break;
+      case 'S': /* --dst_cat */
+        opt->is_dst_cat = TRUE;
+        opt->dst_cat = atoi (optarg);
+        break;
+      case 'q': /* --qry */
+        opt->is_qry = TRUE;
+        strncpy (opt->qry, optarg, DESCR_ARB);
+        break;
+      case 'L': /* --recalc */
+        opt->is_recalc = TRUE;
+        break;
+      case 'F': /* --full */
+        opt->is_full = TRUE;
+        break;
+      case 'X': /* --explain */
+        opt->is_explain = TRUE;
+        break;
+      case 'W': /* --threads */
+        opt->threads = atoi (optarg);
+        if (opt->threads < 1 || opt->threads > MAX_THREADS) {
+          printf ("\n***Error in parse_opts(), line %d: --threads takes a number from 1 to %d, not '%s'\n", __LINE__, MAX_THREADS, optarg);
+          return -1;
+        }
+        break;
+      case 'H': /* --arch */
+        opt->is_arch = TRUE;
+        break;
+      case 'p': /* --pr */
+        opt->is_pr = TRUE;
+        break;
+      case 'x': /* --exp */
+        opt->is_exp = TRUE;
+        break;
+      case 'N': /* --inc */
+        opt->is_inc = TRUE;
+        break;
+      case 'n': /* --net */
+        opt->is_net = TRUE;
+        break;
+      case 'B': /* --beg */
+        opt->is_beg = TRUE;
+        opt->beg = atoi (optarg);
+        break;
+      case 'E': /* --end */
+        opt->is_end = TRUE;
+        opt->end = atoi (optarg);
+        break;
+      case 'o': /* --scr */
+        opt->is_scr = TRUE;
+        break;
+      case 'v': /* --csv */
+        opt->is_csv = TRUE;
+        break;
+      case 'P': /* --nclr */
+        opt->is_nclr = TRUE;
+        strncpy (opt->nclr, optarg, SIZE_ARB);
+        break;
+      case 'D': /* --date */
+        opt->is_date = TRUE;
+        strncpy (opt->date, optarg, FIELD_ARB);
+        {
+          char *cp = optarg;
+          int len = strlen (optarg);
+          if (len > SIZE_TSTMP) {
+            printf ("\n***Warning in parse_opts(), line %d: invalid date '%s' in command-line option: too long\n", __LINE__, optarg);
+            opt->is_date = FALSE;
+            opt->date[0] = '\0';
+            break;
+          }
+          len = 0;
+          while (cp[len] != '\0' && len < SIZE_TSTMP) {
+            if (! isdigit (cp[len]) && cp[len] != '-' && cp[len] != ' ' && cp[len] != ':') {
+              printf ("\n***Warning in parse_opts(), line %d: invalid date '%s' in command-line option: too long\n", __LINE__, optarg);
+              opt->is_date = FALSE;
+              opt->date[0] = '\0';
+              break;
+            }
+            len++;
+          }
+        }
+        break;
+      case 'O': /* --tot */
+        opt->is_tot = TRUE;
+        opt->is_quiet = TRUE;
+        break;
+      case 'Q': /* --qif */
+        opt->is_qif = TRUE;
+        strncpy (opt->qif, optarg, SIZE_ARB);
+        break;
+      case 'h': /* --help */
+        usage();
+        return 1;
+      default:
+        if (ch == '?') {
+          printf ("\n\n***Error in parse_opts(), line %d: incorrect command-line option\n", __LINE__);
+          if (cmdline)
+            /* not again and again in a batch or the shell */
+            usage();
+          return -1;
+        }
+        else {
+          printf ("\n***Error in parse_opts(), line %d: unknown command-line error: ch = %c", __LINE__, ch);
+          usage();
+          return -1;
+        }
+    }
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\nNothing to consider.\n");
-    del_cb_data();
-    return 0;
-  }
-  num_trans = c_head->num_items;
-  td = malloc (sizeof (tran_dat));
-  if (0 == td) {
-    printf ("\n***Error in do_exp(), line %d: Fatal memory error allocating %d bytes.", __LINE__, sizeof (tran_dat));
-    del_cb_data();
-    return -1;
-  }
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    memset (td, 0, sizeof(tran_dat));
-    td->num = atoi (c->item[0]);
-    td->cat_num = atoi (c->item[1]);
-    strncpy (td->dtime, c->item[2], SIZE_TSTMP);
-    strncpy (td->amt, c->item[3], SIZE_AMT);
-    cp = bcnum_add (opt->catList[td->cat_num].amt, td->amt, 2);
-    strncpy (opt->catList[td->cat_num].amt, cp, SIZE_AMT);
-  }
-  /* now, print the data */
-  strcpy (tot, "0.00");
-  printf ("==========================================================================================\n");
-  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-    cp = bcnum_add (tot, opt->catList[i].amt, 2);
-    strncpy (tot, cp, SIZE_AMT);
-  }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
 
-  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
   return 0;
 }
 
 /*
- * do_net
+ * clear_cmd_opts
  *
- * This function processes the net command.  This adds up all transactions, excluding the ones with adjust in the to or cmt fields.
+ * This function clears the command options in opt (everything from is_cat on) before the next command of a batch is parsed.  The
+ * database handle, the statement cache, the category registry and the process options are kept.
  */
-static int do_net (void)
+static void clear_cmd_opts (void)
 {
-  char *errmsg = 0;
-  c_item *c;
-  int ret;
-  int i;
-  int num_cats;
-  int num_trans;
-  char tmp[SIZE_ARB+1];
-  char *cp;
-  tran_dat *td;
-  char tot[SIZE_AMT+1];
-
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,amt FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
-    del_cb_data();
-    return -1;
-  }
-  num_cats = c_head->num_items;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_exp(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
-    }
-    opt->catList[cat].cat = cat;
-    strncpy (opt->catList[cat].dtime, c->item[1], SIZE_TSTMP);
-    strncpy (opt->catList[cat].name, c->item[2], FIELD_ARB);
-    /* set category amounts to 0 */
-    strcpy (opt->catList[cat].amt, "0.00");
-  }
-  del_cb_data();
-  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
-    /* process beg and end limits */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE num BETWEEN %d AND %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg, opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else if (opt->is_beg == TRUE) {
-    /* only opt->beg */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE num >= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->beg);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else if (opt->is_end == TRUE) {
-    /* only opt->end */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt FROM tran WHERE num <= %d AND to_who NOT LIKE '%%adjust%%';",
-        opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else {
-    /* now, let's grab the transactions that we need to process */
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt FROM tran WHERE to_who NOT LIKE '%%adjust%%';");
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\nNothing to consider.\n");
-    del_cb_data();
-    return 0;
-  }
-  num_trans = c_head->num_items;
-  td = malloc (sizeof (tran_dat));
-  if (0 == td) {
-    printf ("\n***Error in do_exp(), line %d: Fatal memory error allocating %d bytes.", __LINE__, sizeof (tran_dat));
-    del_cb_data();
-    return -1;
-  }
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    memset (td, 0, sizeof(tran_dat));
-    td->num = atoi (c->item[0]);
-    td->cat_num = atoi (c->item[1]);
-    strncpy (td->dtime, c->item[2], SIZE_TSTMP);
-    strncpy (td->amt, c->item[3], SIZE_AMT);
-    cp = bcnum_add (opt->catList[td->cat_num].amt, td->amt, 2);
-    strncpy (opt->catList[td->cat_num].amt, cp, SIZE_AMT);
-  }
-  /* now, print the data */
-  strcpy (tot, "0.00");
-  printf ("==========================================================================================\n");
-  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-    cp = bcnum_add (tot, opt->catList[i].amt, 2);
-    strncpy (tot, cp, SIZE_AMT);
-  }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
-
-  printf ("Posted %d transactions to %d categories\n", num_trans, num_cats);
-  return 0;
+  memset ((char *)opt + offsetof (optObject, is_cat), 0, sizeof (optObject) - offsetof (optObject, is_cat));
 }
 
 /*
- * do_scr
+ * run_opts
  *
- * This function generates the commands that would be necessary to replicate the contents of the bgt tran table.
+ * This function runs the action that parse_opts() found.
  */
-static int do_scr (void)
+static int run_opts (void)
 {
-  char *errmsg = 0;
-  c_item *c;
-  int ret;
-  char tmp[SIZE_ARB+1];
-  int is_bgt = 0;
-  char bgt[SIZE_ARB+1];
+  if (opt->is_catt && ! opt->is_add && ! opt->is_ls && ! opt->is_tot && ! opt->is_edit) {
+    return do_new_cat ();
+  }
 
-  if (opt->is_bgt == TRUE) {
-    snprintf (bgt, SIZE_ARB, "--bgt %s", opt->bgt);
-    is_bgt = TRUE;
+  if (opt->is_add) {
+    return do_add ();
   }
-  else
-    bgt[0] = '\0';
 
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,comment FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_scr(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
+  if (opt->is_ls) {
+    return do_ls();
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
-    del_cb_data();
-    return -1;
+
+  if (opt->is_recalc) {
+    return do_recalc ();
   }
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_scr(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
-    }
-    printf ("# cat '%d', dtime '%s'\n", cat, c->item[1]);
-    if (is_bgt == TRUE)
-      printf ("bgt %s --catt '%s' --cmt '%s'\n", bgt, c->item[2], c->item[3]);
-    else
-      printf ("bgt --catt '%s' --cmt '%s'\n", c->item[2], c->item[3]);
+
+  if (opt->is_qry) {
+    return do_qry ();
   }
-  del_cb_data();
-  snprintf (tmp, SIZE_ARB,
-      "SELECT t.num,c.name,t.dtime,t.amt,t.status,t.to_who,t.comment FROM tran t,cat c WHERE t.cat_num = c.num ORDER BY t.dtime;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_scr(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
+
+  if (opt->is_edit) {
+    return do_edit();
   }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    del_cb_data();
-    return 0;
+
+  if (opt->is_rm) {
+    return do_rm ();
   }
-  for (c = c_head; c != c_tail; c = c->next) {
-    if (c->item[0]) {
-      printf ("# tran '%s', dtime '%s', status '%s'\n", c->item[0], c->item[2], c->item[4]);
-      if (is_bgt == TRUE)
-        printf ("bgt %s --add --catt '%s' --date '%s' --amt '%s' --to '%s' --cmt '%s'\n", bgt, c->item[1], c->item[2], c->item[3], c->item[5], c->item[6]);
-      else
-        printf ("bgt --add --catt '%s' --date '%s' --amt '%s' --to '%s' --cmt '%s'\n", c->item[1], c->item[2], c->item[3], c->item[5], c->item[6]);
-    }
+
+  if (opt->is_exp) {
+    return do_exp();
   }
-  del_cb_data();
-  return 0;
-}
 
-/*
- * do_arch
- *
- * This function archives everything in the tran table, and then places the minimal transactions into tran to get the balances of the accounts where they
- * were before the archive was called.
- */
-static int do_arch (void)
-{
-  int ret;
-  int trnum;
-  int i;
-  char *errmsg = 0;
-  char *cp;
-  char tmp[SIZE_ARB+1];
-  char tot[SIZE_AMT+1];
+  if (opt->is_inc) {
+    return do_inc();
+  }
 
-  ret = inputline ("Are you sure you want to archive everything? (Enter 'yes' to proceed) >> ");
-  if (opt->inputline[0] != 'y' && opt->inputline[0] != 'Y' &&
-      opt->inputline[1] != 'e' && opt->inputline[1] != 'Y' &&
-      opt->inputline[2] != 's' && opt->inputline[2] != 'S') {
-    printf ("Cancelled by user.\n");
-    return 0;
+  if (opt->is_net) {
+    return do_net();
   }
-  /* OK to proceed - First, do a posting */
-  ret = do_post(1);
-  if (ret)
-    return ret;
-  /* Next, archive the transactions. */
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nUPDATE tran SET status = 'ARCH';\nCOMMIT;\n");
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_arch(), line %d: SQLite Error executing '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    return -1;
+
+  if (opt->is_scr) {
+    return do_scr();
   }
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO arch SELECT * FROM tran;\nCOMMIT;\n");
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_arch(), line %d: SQLite Error executing '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    return -1;
+
+  if (opt->is_arch) {
+    return do_arch();
   }
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nDELETE FROM tran;\nCOMMIT;\n");
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_arch(), line %d: SQLite Error executing '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    return -1;
+
+  if (opt->is_csv) {
+    return do_csv();
   }
-  /* Now, enter transactions to get balances where they should be. */
-  strcpy (tot, "0.00");
-  printf ("==========================================================================================\n");
-  printf ("CATEGORY    DATE/TIME             CATEGORY NAME                                     AMOUNT\n");
-  for (i = 0, trnum = 1; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf ("%-12d%-22s%-40s%16s\n", opt->catList[i].cat, opt->catList[i].dtime, opt->catList[i].name, opt->catList[i].amt);
-    cp = bcnum_add (tot, opt->catList[i].amt, 2);
-    strncpy (tot, cp, SIZE_AMT);
-    snprintf (tmp, SIZE_ARB,\
-        "BEGIN TRANSACTION;\nINSERT INTO tran VALUES (%d,%d,datetime('now','localtime'),'%s','PSTD','Initial','Initial Balance for account.');\nCOMMIT;\n",
-        trnum++, opt->catList[i].cat, opt->catList[i].amt);
-    ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_arch(), line %d: SQLite Error executing '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
+
+  if (opt->is_nclr) {
+    if (!opt->is_ls) {
+      printf ("\n***Error, run_opts(), line %d: --nclr should be used with --ls.\n", __LINE__);
       return -1;
     }
   }
-  printf ("==========================================================================================\n");
-  printf ("                                                                   Total: %16s\n", tot);
-  printf ("==========================================================================================\n");
-  /* Finally, indicate the activity that occurred. */
-  snprintf (tmp, SIZE_ARB, "BEGIN TRANSACTION;\nINSERT INTO act VALUES ('ARC',NULL,NULL,datetime('now','localtime'),NULL,NULL,'Archived everything.');\nCOMMIT;\n");
-  ret = sqlite3_exec (opt->db, tmp, 0, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_arch(), line %d: SQLite Error executing '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    return -1;
+
+  if (opt->is_qif) {
+    return do_qif();
+  }
+
+  if (opt->is_explain) {
+    return do_explain ();
   }
 
   return 0;
 }
-
-/*
- * do_csv
- *
- * Generate a CSV output of the data.
- */
-static int do_csv (void)
-{
-  char *errmsg = 0;
-  c_item *c;
-  int ret;
-  int i;
-  int cat_max;
-  int num_cats;
-  int num_trans;
-  char tmp[SIZE_ARB+1];
-
-  /* first, grab everything from the cat table that we need and populate opt->catList */
-  snprintf (tmp, SIZE_ARB, "SELECT num,dtime,name,amt FROM cat ORDER BY num;");
-  ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-  if (ret != SQLITE_OK) {
-    printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-    sqlite3_free (errmsg);
-    del_cb_data();
-    return -1;
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-    printf ("\n***Error in do_exp(), line %d: The SQL query '%s' generated no data and it should have.", __LINE__, tmp);
-    del_cb_data();
-    return -1;
-  }
-  num_cats = c_head->num_items;
-  cat_max = 0;
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int cat = atoi (c->item[0]);
-    if (cat > MD_ARY) {
-      printf ("\n***Error in do_exp(), line %d: You have more categories in %s than are allowed (max %d, you have %d)\n", __LINE__, opt->db_name, MD_ARY, cat);
-      del_cb_data();
-      return -1;
-    }
-    if (cat > cat_max)
-      cat_max = cat;
-    opt->catList[cat].cat = cat;
-    strncpy (opt->catList[cat].dtime, c->item[1], SIZE_TSTMP);
-    strncpy (opt->catList[cat].name, c->item[2], FIELD_ARB);
-    /* set category amounts to 0 */
-    strcpy (opt->catList[cat].amt, "0.00");
-  }
-  del_cb_data();
-  if (opt->is_beg == TRUE && opt->is_end == TRUE) {
-    /* process beg and end limits */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt,status,to_who,comment FROM tran WHERE num BETWEEN %d AND %d;",
-        opt->beg, opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else if (opt->is_beg == TRUE) {
-    /* only opt->beg */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt,status,to_who,comment FROM tran WHERE num >= %d;",
-        opt->beg);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else if (opt->is_end == TRUE) {
-    /* only opt->end */
-    snprintf (tmp, SIZE_ARB,
-        "SELECT num,cat_num,dtime,amt,status,to_who,comment FROM tran WHERE num <= %d;",
-        opt->end);
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
-    }
-  }
-  else {
-    /* get them all*/
-    snprintf (tmp, SIZE_ARB, "SELECT num,cat_num,dtime,amt,status,to_who,comment FROM tran;");
-    ret = sqlite3_exec (opt->db, tmp, cbitem, 0, &errmsg); 
-    if (ret != SQLITE_OK) {
-      printf ("\n\n***Error in do_exp(), line %d: SQLite Error entering '%s': %s\n", __LINE__, tmp, errmsg);
-      sqlite3_free (errmsg);
-      del_cb_data();
-      return -1;
+
+/*
+ * shell_complete_word
+ *
+ * The readline generator for the shell.  Depending on shell_complete() it offers command words, switches, or category names
+ * from the registry.
+ */
+static int complete_what;               /* 0 - the command word, 1 - a switch, 2 - a category name */
+
+static char *shell_complete_word (const char *text, int state)
+{
+  static int idx;
+  static size_t len;
+  const char *name;
+  char buf[FIELD_ARB+1];
+
+  if (state == 0) {
+    idx = 0;
+    len = strlen (text);
+  }
+  if (complete_what == 2) {
+    while (idx < opt->cats.num_cats) {
+      name = opt->cats.cats[idx++].name;
+      if (! strncmp (name, text, len))
+        return strdup (name);
     }
-  }
-  if (c_head == 0 || c_tail == 0 || c_head->next == c_tail || c_tail->prev == c_head) {
-      printf ("\nNothing to consider.\n");
-    del_cb_data();
     return 0;
   }
-  num_trans = c_head->num_items;
-  if (num_trans == 0) {
-    printf ("No transactions to process\n");
-    return 0;
+  while (long_options[idx].name != 0) {
+    name = long_options[idx++].name;
+    if (complete_what == 0)
+      snprintf (buf, FIELD_ARB, "%s", name);
+    else
+      snprintf (buf, FIELD_ARB, "--%s", name);
+    if (! strncmp (buf, text, len))
+      return strdup (buf);
   }
-  printf ("\"Transaction\",\"Date/time\",\"To field\",\"Comment\",\"Amount\"");
-  for (i = 0; i < MD_ARY; i++) {
-    if (opt->catList[i].cat == 0)
-      continue;
-    printf (",\"%s\"", opt->catList[i].name);
+  return 0;
+}
+
+/*
+ * shell_complete
+ *
+ * The readline completion hook for the shell.  The first word completes to a command, the word after --catt to a category name,
+ * and any other word starting with - to a switch.  Everything else (like the file for --nclr) gets readline's file names.
+ */
+static char **shell_complete (const char *text, int start, int end)
+{
+  int i = start;
+  int j;
+
+  (void)end;
+  /* step back over an opening quote and the blanks to the end of the previous word */
+  if (i > 0 && (rl_line_buffer[i-1] == '\'' || rl_line_buffer[i-1] == '"'))
+    i--;
+  while (i > 0 && isspace ((unsigned char)rl_line_buffer[i-1]))
+    i--;
+  for (j = i; j > 0 && ! isspace ((unsigned char)rl_line_buffer[j-1]); j--)
+    ;
+  if (i == 0)
+    complete_what = 0;
+  else if ((i - j == 6 && ! strncmp (&rl_line_buffer[j], "--catt", 6)) || (j == 0 && i == 4 && ! strncmp (rl_line_buffer, "catt", 4))) {
+    complete_what = 2;
+    cat_check ();
+    if (cat_load ())
+      return 0;
   }
-  printf ("\n");
+  else if (text[0] == '-')
+    complete_what = 1;
+  else
+    return 0;
+  rl_attempted_completion_over = 1;
+  return rl_completion_matches (text, shell_complete_word);
+}
 
-  for (c = c_head->next; c != c_tail; c = c->next) {
-    int c_num = atoi(c->item[1]);
-    printf ("\"%s\",\"%s\",\"%s\",\"%s\",%s", c->item[0], c->item[2], c->item[5], c->item[6], c->item[3]);
-    for (i = 0; i < MD_ARY; i++) {
-      if (opt->catList[i].cat == 0)
-        continue;
-      if (c_num == opt->catList[i].cat)
-        printf (",%s", c->item[3]);
-      else
-        printf (",");
-      /* continue here */
+/*
+ * do_shell
+ *
+ * This function runs an interactive shell on the open database.  Each line is a command with the same switches as the
+ * command-line, and the switch for the action can be given as a bare word (ls, add --catt Food ..., qry dt:2012).  The database,
+ * the prepared statements and the category registry stay open between commands, so they run warm.  History is kept in the
+ * budget directory, and Tab completes commands, switches and, after --catt, category names.
+ */
+static int do_shell (void)
+{
+  char *line;
+  char *argv[SIZE_ARGV];
+  char hist[PATH_MAX];
+  int is_hist;
+  int argc;
+
+  /* a budget path too long for the history file just goes without history */
+  is_hist = snprintf (hist, PATH_MAX, "%s/history", opt->bgt) < PATH_MAX;
+  using_history ();
+  stifle_history (500);
+  if (is_hist)
+    read_history (hist);
+  rl_readline_name = "bgt";
+  rl_attempted_completion_function = shell_complete;
+  rl_completer_quote_characters = "'\"";
+  printf ("bgt shell on %s.  Enter help for the commands, quit to leave.\n", opt->db_name);
+  while ((line = readline ("bgt> ")) != 0) {
+    if (line[0] != '\0')
+      add_history (line);
+    argc = split_args (line, argv, SIZE_ARGV);
+    if (argc < 0)
+      printf ("\n***Error in do_shell(), line %d: unclosed quote or too many words\n", __LINE__);
+    else if (argc > 1) {
+      if (! strcmp (argv[1], "--quit") || ! strcmp (argv[1], "--exit")) {
+        free (line);
+        break;
+      }
+      /* pick up categories that another process added since the last command */
+      cat_check ();
+      clear_cmd_opts ();
+      if (parse_opts (argc, argv, FALSE) == 0)
+        run_opts ();
     }
+    free (line);
+  }
+  if (line == 0)
     printf ("\n");
+  if (is_hist)
+    write_history (hist);
+  return 0;
+}
+
+/*
+ * send_all
+ *
+ * This function writes all of buf to the socket fd, retrying short writes.  It returns 0, or -1 if the other end went away.
+ */
+static int send_all (int fd, const char *buf, size_t len)
+{
+  ssize_t n;
+
+  while (len > 0) {
+    n = write (fd, buf, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    buf += n;
+    len -= n;
   }
   return 0;
 }
 
-static int do_qif (void)
+/*
+ * serve_line
+ *
+ * This function runs one request line for the daemon, with standard output sent to the client on fd.  The answer is the output
+ * of the command, a NUL byte, and the command's return value on a line of its own.  It returns 1 if the client asked to quit or
+ * went away, and 0 otherwise.
+ */
+static int serve_line (int fd, char *line)
 {
+  char *argv[SIZE_ARGV];
+  char status[32];
+  int argc;
+  int saved;
   int ret;
-  FILE *fp;
-  FILE *outfp;
-  char *data, *cp;
-  qifItem *qi;
+
+  argc = split_args (line, argv, SIZE_ARGV);
+  if (argc > 1 && (! strcmp (argv[1], "--quit") || ! strcmp (argv[1], "--exit")))
+    return 1;
+  fflush (stdout);
+  saved = dup (STDOUT_FILENO);
+  if (saved < 0 || dup2 (fd, STDOUT_FILENO) < 0) {
+    printf ("\n***Error in serve_line(), line %d: could not send output to the client: %s\n", __LINE__, strerror (errno));
+    if (saved >= 0)
+      close (saved);
+    return 1;
+  }
+  if (argc < 0) {
+    printf ("\n***Error in serve_line(), line %d: unclosed quote or too many words\n", __LINE__);
+    ret = -1;
+  }
+  else if (argc == 1)
+    ret = 0;
+  else {
+    /* pick up anything another process committed since the last request */
+    cat_check ();
+    clear_cmd_opts ();
+    ret = parse_opts (argc, argv, FALSE);
+    if (ret == 0 && opt->is_arch) {
+      /* it asks on the terminal before it archives */
+      printf ("\n***Error in serve_line(), line %d: --arch isn't served by the daemon; run it directly\n", __LINE__);
+      ret = -1;
+    }
+    else if (ret == 0)
+      ret = run_opts ();
+    else if (ret > 0)
+      /* --help */
+      ret = 0;
+  }
+  fflush (stdout);
+  dup2 (saved, STDOUT_FILENO);
+  close (saved);
+  snprintf (status, sizeof (status), "%c%d\n", '\0', ret);
+  if (send_all (fd, status, strlen (status + 1) + 1))
+    return 1;
+  return 0;
+}
+
+/*
+ * daemon_signal
+ *
+ * SIGINT and SIGTERM stop the daemon after the request it is running.
+ */
+static volatile sig_atomic_t daemon_stop;
+
+static void daemon_signal (int sig)
+{
+  (void)sig;
+  daemon_stop = 1;
+}
+
+/*
+ * do_daemon
+ *
+ * This function serves the open budget on the Unix socket opt->sock until it gets SIGINT or SIGTERM.  Clients send one command
+ * per line in the same syntax as --batch, and serve_line() answers each one.  Requests from all the clients are run one at a
+ * time by this one process, which makes it the only writer, and the prepared statements and the category registry (with the
+ * posted balances) stay warm between them.
+ */
+static int do_daemon (void)
+{
+  static char buf[MAX_CLIENTS][SIZE_ARB+1];
+  struct pollfd fds[MAX_CLIENTS+1];
+  int len[MAX_CLIENTS];
+  struct sockaddr_un addr;
+  struct sigaction sa;
+  mode_t mask;
+  char *nl;
+  int lsn;
+  int fd;
+  int nfds = 1;
   int i;
-  int lnctr = 0;
-  static char *rqda[QIF_SIZE_RQDA];
+  ssize_t n;
 
-  if (! fexists (opt->qif)) {
-    printf ("***Error in do_qif(), line %d: The qif file '%s' does not exist.\n", __LINE__, opt->qif);
+  if (strlen (opt->sock) >= sizeof (addr.sun_path)) {
+    printf ("\n***Error in do_daemon(), line %d: the socket path %s is too long\n", __LINE__, opt->sock);
     return -1;
   }
-  // The outfp is there so you could specify a file to output to on the command-line, if you wanted to.
-  outfp = stdout;
-  for (i = 0; i < QIF_SIZE_RQDA; i++) {
-    rqda[i] = malloc (QIF_SIZE_DESC+1);
-    if (0 == rqda[i]) {
-      printf ("***Error in do_qif(), line %d: fatal allocation error allocating %d bytes.\n", __LINE__, QIF_SIZE_DESC+1);
-      return -1;
-    }
-    memset (rqda[i], 0, QIF_SIZE_DESC+1);
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, opt->sock);
+  lsn = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (lsn < 0) {
+    printf ("\n***Error in do_daemon(), line %d: socket(): %s\n", __LINE__, strerror (errno));
+    return -1;
   }
-  data = malloc (DESCR_ARB+1);
-  if (0 == data) {
-    printf ("***Error in do_qif(), line %d: fatal allocation error allocting %d bytes.\n", __LINE__, DESCR_ARB+1);
-    for (i = 0; i < QIF_SIZE_RQDA; i++) {
-      free (rqda[i]);
-    }
+  /* a socket file that nobody answers on is left over from a daemon that died */
+  if (connect (lsn, (struct sockaddr *)&addr, sizeof (addr)) == 0) {
+    printf ("\n***Error in do_daemon(), line %d: a daemon is already serving %s\n", __LINE__, opt->sock);
+    close (lsn);
     return -1;
   }
-  memset (data, 0, DESCR_ARB+1);
-  fp = fopen (opt->qif, "rb");
-  if (0 == fp) {
-    printf ("***Error in do_qif(), line %d: Couldn't open %s\n", __LINE__, opt->qif);
-    for (i = 0; i < QIF_SIZE_RQDA; i++) {
-      free (rqda[i]);
-    }
+  close (lsn);
+  unlink (opt->sock);
+  lsn = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (lsn < 0) {
+    printf ("\n***Error in do_daemon(), line %d: socket(): %s\n", __LINE__, strerror (errno));
     return -1;
   }
-  while (TRUE) {
-    cp = fgets (data, DESCR_ARB, fp);
-    if (feof (fp))
-      break;
-    if (cp == 0)
+  mask = umask (077);
+  if (bind (lsn, (struct sockaddr *)&addr, sizeof (addr)) || listen (lsn, MAX_CLIENTS)) {
+    printf ("\n***Error in do_daemon(), line %d: could not listen on %s: %s\n", __LINE__, opt->sock, strerror (errno));
+    umask (mask);
+    close (lsn);
+    return -1;
+  }
+  umask (mask);
+
+  memset (&sa, 0, sizeof (sa));
+  sa.sa_handler = SIG_IGN;
+  sigaction (SIGPIPE, &sa, 0);
+  sa.sa_handler = daemon_signal;
+  sigaction (SIGINT, &sa, 0);
+  sigaction (SIGTERM, &sa, 0);
+
+  fds[0].fd = lsn;
+  fds[0].events = POLLIN;
+  printf ("bgt daemon on %s, listening on %s\n", opt->db_name, opt->sock);
+  fflush (stdout);
+  while (! daemon_stop) {
+    if (poll (fds, nfds, -1) < 0) {
+      if (errno == EINTR)
+        continue;
+      printf ("\n***Error in do_daemon(), line %d: poll(): %s\n", __LINE__, strerror (errno));
       break;
-    lnctr++;
-    if (data[0] == '\0' || data[0] == '\n' || data[0] == '\r')
-      continue;
-
-    cp = strchr (data, '\n');
-    if (0 != cp)
-      *cp = '\0';
-    cp = strchr (data, '\r');
-    if (0 != cp)
-      *cp = '\0';
-
-    if (data[0] != '!') {
-      printf ("***Error in do_qif(), line %d: file \"%s\", line %d: invalid qif file\n", __LINE__, opt->qif, lnctr);
-      fclose (fp);
-      for (i = 0; i < QIF_SIZE_RQDA; i++) {
-        free (rqda[i]);
-      }
-      return -1;
     }
-    /* Should be: !Type:XXXX */
-    cp = strchr (data, ':');
-    if (cp != 0 && strncmp (cp+1, "Bank", 4)) {
-      /* skip through anything but Bank */
-      while (TRUE) {
-        lnctr++;
-        cp = fgets (data, DESCR_ARB+1, fp);
-        if (feof (fp))
-          goto CloseHerOut;
-        if (cp == 0)
-          goto CloseHerOut;
-        if (data[0] == '\0')
-          break;
-        if (data[0] == '!') {
-          cp = strchr (data, ':');
-          if (cp != 0)
-            break;
-          else
-            continue;
-        }
+    if (fds[0].revents & POLLIN) {
+      fd = accept (lsn, 0, 0);
+      if (fd >= 0 && nfds > MAX_CLIENTS)
+        close (fd);
+      else if (fd >= 0) {
+        fds[nfds].fd = fd;
+        fds[nfds].events = POLLIN;
+        fds[nfds].revents = 0;
+        len[nfds-1] = 0;
+        nfds++;
       }
-      cp = strchr (data, ':');
     }
-    else {
-      /* OK, here's the meat of the processing */
-      while (TRUE) {
-        int isFinished;
-        isFinished = FALSE;
-        for (i = 0; i < QIF_SIZE_RQDA; i++) {
-          lnctr++;
-          cp = fgets (data, DESCR_ARB+1, fp);
-          if (feof (fp))
-            goto CloseHerOut;
-          if (cp == 0)
-            goto CloseHerOut;
-          if (data[0] == '\0')
-            break;
-          cp = strchr (data, '\n');
-          if (0 != cp)
-            *cp = '\0';
-          cp = strchr (data, '\r');
-          if (0 != cp)
-            *cp = '\0';
-          if (data[0] == '\0')
-            continue;
-
-          if (data[0] != '^') {
-            snprintf (rqda[i], QIF_SIZE_DESC, "%s", data);
-            rqda[i+1][0] = '\0';
-          }
+    for (i = 1; i < nfds; i++) {
+      if (fds[i].revents == 0)
+        continue;
+      fd = fds[i].fd;
+      n = read (fd, buf[i-1] + len[i-1], SIZE_ARB - len[i-1]);
+      if (n > 0) {
+        len[i-1] += n;
+        buf[i-1][len[i-1]] = '\0';
+        while (fd >= 0 && (nl = strchr (buf[i-1], '\n')) != 0) {
+          *nl++ = '\0';
+          if (serve_line (fd, buf[i-1]))
+            fd = -1;
           else {
-            isFinished = TRUE;
-            break;
-          }
-        }
-        if (isFinished == FALSE) {
-          printf ("***Error in do_qif(), line %d: file \"%s\", line %d: QIF_SIZE_RQDA (%d) is not big enough\n",
-              __LINE__, opt->qif, lnctr, QIF_SIZE_RQDA);
-          for (i = 0; i < QIF_SIZE_RQDA; i++) {
-            free (rqda[i]);
+            len[i-1] -= nl - buf[i-1];
+            memmove (buf[i-1], nl, len[i-1] + 1);
           }
-          return -1;
-        }
-        /*
-         * OK, parse the data in rqda and return a qifItem.  Then, print out the 
-         * data in the qifItem per the needs of the application.  We need to
-         * free the memory that the qifItem is using.
-         */
-        qi = parseQIFItem (&rqda[0], opt->qif, lnctr);
-        if (qi == 0) {
-          fprintf (stdout, "***Warning in do_qif(), line %d: qif item invalid around line %d\n", __LINE__, lnctr);
-          continue;
         }
-        else {
-          if (strcmp (qi->category, "[Checking]") == 0) {
-            free (qi);
-            continue;
-          }
-          /* split item */
-          if (qi->isSplit) {
-            /* print it out as separate line items */
-            int i;
-            for (i = 0; i < 30 && qi->sia[i] != 0; i++) {
-              remove_chr (qi->memo, '\'');
-              remove_chr (qi->memo, '&');
-              remove_chr (qi->payee, '\'');
-              remove_chr (qi->payee, '&');
-              ret = get_cat_num_from_name (qi->sia[i]->split_cat);
-              if (ret == -1) {
-                printf ("***Warning in do_qif(), line %d: qif category '%s' invalid around line %d\n", __LINE__, qi->sia[i]->split_cat, lnctr);
-                continue;
-              }
-              if (opt->is_bgt) {
-                printf ("bgt --bgt %s --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s-%d'\n",
-                    opt->bgt, qi->sia[i]->amt, qi->sia[i]->split_cat, qi->payee, qi->date, qi->check, qi->memo, i);
-              }
-              else {
-                printf ("bgt --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s-%d'\n",
-                    qi->sia[i]->amt, qi->sia[i]->split_cat, qi->payee, qi->date, qi->check, qi->memo, i);
-              }
-            }
-          }
-          /* non-split item */
-          else {
-            remove_chr (qi->memo, '\'');
-            remove_chr (qi->memo, '&');
-            remove_chr (qi->payee, '\'');
-            remove_chr (qi->payee, '&');
-            ret = get_cat_num_from_name (qi->category);
-            if (ret == -1) {
-              printf ("***Warning in do_qif(), line %d: qif category '%s' invalid around line %d\n", __LINE__, qi->category, lnctr);
-              continue;
-            }
-            if (opt->is_bgt) {
-              printf ("bgt --bgt %s --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s'\n",
-                  opt->bgt, qi->tran, qi->category, qi->payee, qi->date, qi->check, qi->memo);
-            }
-            else {
-              printf ("bgt --add --amt %s --catt '%s' --to '%s' --cmt '%s:%s:%s'\n",
-                  qi->tran, qi->category, qi->payee, qi->date, qi->check, qi->memo);
-            }
-          }
+        if (fd >= 0 && len[i-1] == SIZE_ARB) {
+          fd = -1;
+          printf ("\n***Error in do_daemon(), line %d: a request is longer than %d bytes; dropped the client\n", __LINE__, SIZE_ARB);
         }
-        free (qi);
       }
-    }
-    /* should be done... */
-  }
-CloseHerOut:
-  fclose (fp);
-  free (data);
-  for (i = 0; i < QIF_SIZE_RQDA; i++) {
-    free (rqda[i]);
+      else if (n < 0 && errno == EINTR)
+        continue;
+      else
+        fd = -1;
+      if (fd < 0) {
+        /* the last client takes the closed one's slot */
+        close (fds[i].fd);
+        nfds--;
+        fds[i] = fds[nfds];
+        len[i-1] = len[nfds-1];
+        memcpy (buf[i-1], buf[nfds-1], len[i-1] + 1);
+        i--;
+      }
+    }
   }
+  for (i = 1; i < nfds; i++)
+    close (fds[i].fd);
+  close (lsn);
+  unlink (opt->sock);
+  printf ("bgt daemon on %s stopped\n", opt->db_name);
   return 0;
 }
 
+/*
+ * do_client
+ *
+ * This function sends the command-line, less --client, to the daemon on opt->sock and copies the answer to standard output.  It
+ * returns the command's return value as the daemon reported it, or -1 if the daemon couldn't be reached.
+ */
+static int do_client (int argc, char *argv[])
+{
+  char line[SIZE_ARB+1];
+  char word[SIZE_ARB+1];
+  char buf[SIZE_ARB+1];
+  char status[32];
+  struct sockaddr_un addr;
+  size_t used = 0;
+  size_t slen = 0;
+  int in_status = FALSE;
+  int fd;
+  int i;
+  ssize_t n;
+  char *nul;
+
+  line[0] = '\0';
+  for (i = 1; i < argc; i++) {
+    if (! strcmp (argv[i], "--client") || ! strcmp (argv[i], "-z"))
+      continue;
+    /* --bgt and --sock go along too; the daemon ignores them */
+    used += snprintf (line + used, SIZE_ARB - used, "'%s' ", shell_quote (argv[i], word, sizeof (word)));
+    if (used >= SIZE_ARB - 1) {
+      printf ("\n***Error in do_client(), line %d: the command-line is too long to send\n", __LINE__);
+      return -1;
+    }
+  }
+  line[used++] = '\n';
+
+  if (strlen (opt->sock) >= sizeof (addr.sun_path)) {
+    printf ("\n***Error in do_client(), line %d: the socket path %s is too long\n", __LINE__, opt->sock);
+    return -1;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, opt->sock);
+  fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect (fd, (struct sockaddr *)&addr, sizeof (addr))) {
+    printf ("\n***Error in do_client(), line %d: could not connect to the daemon on %s: %s\n", __LINE__, opt->sock, strerror (errno));
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+  signal (SIGPIPE, SIG_IGN);
+  if (send_all (fd, line, used)) {
+    printf ("\n***Error in do_client(), line %d: the daemon on %s hung up\n", __LINE__, opt->sock);
+    close (fd);
+    return -1;
+  }
+  while ((n = read (fd, buf, SIZE_ARB)) != 0) {
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    if (in_status) {
+      if (slen + n >= sizeof (status))
+        n = sizeof (status) - slen - 1;
+      memcpy (status + slen, buf, n);
+      slen += n;
+    }
+    else if ((nul = memchr (buf, '\0', n)) != 0) {
+      fwrite (buf, 1, nul - buf, stdout);
+      in_status = TRUE;
+      slen = n - (nul - buf) - 1;
+      if (slen >= sizeof (status))
+        slen = sizeof (status) - 1;
+      memcpy (status, nul + 1, slen);
+    }
+    else
+      fwrite (buf, 1, n, stdout);
+    status[slen] = '\0';
+    if (in_status && strchr (status, '\n') != 0)
+      break;
+  }
+  close (fd);
+  if (! in_status || strchr (status, '\n') == 0) {
+    printf ("\n***Error in do_client(), line %d: the daemon on %s hung up before answering\n", __LINE__, opt->sock);
+    return -1;
+  }
+  return atoi (status);
+}
 
-/******************************************
- * main function.
- * ****************************************/
 int main (int argc, char *argv[])
 {
-  int ch;
   int ret = 0;
   int status;
-  int option_index = 0;
-  struct option long_options[] = {
-    {"bgt",        1, 0, 'b'},
-    {"cat",        1, 0, 'c'},
-    {"catt",       1, 0, 'C'},
-    {"tran",       1, 0, 't'},
-    {"ls",         0, 0, 'l'},
-    {"add",        0, 0, 'a'},
-    {"to",         1, 0, 'T'},
-    {"amt",        1, 0, 'A'},
-    {"cmt",        1, 0, 'm'},
-    {"cedit",      0, 0, 'd'},
-    {"crm",        0, 0, 'G'},
-    {"edit",       0, 0, 'e'},
-    {"rm",         0, 0, 'r'},
-    {"split",      0, 0, 's'},
-    {"adj",        0, 0, 'j'},
-    {"src_cat",    1, 0, 'R'},
-    {"dst_cat",    1, 0, 'S'},
-    {"qry",        1, 0, 'q'},
-    {"recalc",     0, 0, 'L'},
-    {"arch",       0, 0, 'H'},
-    {"pr",         0, 0, 'p'},
-    {"exp",        0, 0, 'x'},
-    {"inc",        0, 0, 'N'},
-    {"net",        0, 0, 'n'},
-    {"beg",        1, 0, 'B'},
-    {"end",        1, 0, 'E'},
-    {"scr",        0, 0, 'o'},
-    {"csv",        0, 0, 'v'},
-    {"date",       1, 0, 'D'},
-    {"nclr",       1, 0, 'P'},
-    {"tot",        0, 0, 'O'},
-    {"qif",        1, 0, 'Q'},
-    {"help",       0, 0, 'h'},
-    {0,0,0,0}
-  };
+  char **args;
 
   opt = malloc (sizeof (optObject));
-  if (opt == 0) {
+  /* getopt_long() reorders argv, and --client sends it on as it was given */
+  args = malloc ((argc + 1) * sizeof (char *));
+  if (opt == 0 || args == 0) {
     printf ("\n\n***Error in main(), line %d: fatal memory error allocating an option object.\n", __LINE__);
-    ret = -1;
-    goto CleanupAndQuit;
+    free (opt);
+    free (args);
+    return -1;
   }
+  memcpy (args, argv, (argc + 1) * sizeof (char *));
   memset (opt, 0, sizeof(optObject));
-  opterr = 1; /* tell getopt() to hush */
-  while ( (ch = getopt_long (argc, argv, "b:c:C:t:laT:A:m:dGersjR:S:q:LHpxNnB:E:ovDPOQ:h", long_options, &option_index)) != EOF) {
-    switch (ch) {
-      case 'b': /* --bgt */
-        opt->is_bgt = TRUE;
-        strncpy (opt->bgt, optarg, DESCR_ARB);
-        break;
-      case 'c': /* --cat */
-        opt->is_cat = TRUE;
-        opt->cat = atoi (optarg);
-        break;
-      case 'C': /* --catt */
-        opt->is_catt = TRUE;
-        strncpy (opt->catt, optarg, FIELD_ARB);
-        break;
-      case 't': /* --tran */
-        opt->is_tran = TRUE;
-        opt->tran = atoi (optarg);
-        break;
-      case 'l': /* --ls */
-        opt->is_ls = TRUE;
-        break;
-      case 'a': /* --add */
-        opt->is_add = TRUE;
-        break;
-      case 'T': /* --to */
-        opt->is_to = TRUE;
-        strncpy (opt->to, optarg, FIELD_ARB);
-        break;
-      case 'A': /* --amt */
-        opt->is_amt = TRUE;
-        strncpy (opt->amt, optarg, SIZE_AMT);
-        break;
-      case 'm': /* --cmt */
-        opt->is_cmt = TRUE;
-        strncpy (opt->cmt, optarg, FIELD_ARB);
-        break;
-      case 'd': /* --cedit */
-        opt->is_cedit = TRUE;
-        break;
-      case 'G': /* --crm */
-        opt->is_crm = TRUE;
-        strncpy (opt->crm, optarg, FIELD_ARB);
-        break;
-      case 'e': /* --edit */
-        opt->is_edit = TRUE;
-        break;
-      case 'r': /* --rm */
-        opt->is_rm = TRUE;
-        break;
-      case 's': /* --split */
-        opt->is_split = TRUE;
-        break;
-      case 'j': /* --adj */
-        opt->is_adj = TRUE;
-        break;
-      case 'R': /* --src_cat */
-        opt->is_src_cat = TRUE;
-        opt->src_cat = atoi (optarg);
-        break;
-      case 'S': /* --dst_cat */
-        opt->is_dst_cat = TRUE;
-        opt->dst_cat = atoi (optarg);
-        break;
-      case 'q': /* --qry */
-        opt->is_qry = TRUE;
-        strncpy (opt->qry, optarg, DESCR_ARB);
-        break;
-      case 'L': /* --recalc */
-        opt->is_recalc = TRUE;
-        break;
-      case 'H': /* --arch */
-        opt->is_arch = TRUE;
-        break;
-      case 'p': /* --pr */
-        opt->is_pr = TRUE;
-        break;
-      case 'x': /* --exp */
-        opt->is_exp = TRUE;
-        break;
-      case 'N': /* --inc */
-        opt->is_inc = TRUE;
-        break;
-      case 'n': /* --net */
-        opt->is_net = TRUE;
-        break;
-      case 'B': /* --beg */
-        opt->is_beg = TRUE;
-        opt->beg = atoi (optarg);
-        break;
-      case 'E': /* --end */
-        opt->is_end = TRUE;
-        opt->end = atoi (optarg);
-        break;
-      case 'o': /* --scr */
-        opt->is_scr = TRUE;
-        break;
-      case 'v': /* --csv */
-        opt->is_csv = TRUE;
-        break;
-      case 'P': /* --nclr */
-        opt->is_nclr = TRUE;
-        strncpy (opt->nclr, optarg, SIZE_ARB);
-        break;
-      case 'D': /* --date */
-        opt->is_date = TRUE;
-        strncpy (opt->date, optarg, FIELD_ARB);
-        {
-          char *cp = optarg;
-          int len = strlen (optarg);
-          if (len > SIZE_TSTMP) {
-            printf ("\n***Warning in main(), line %d: invalid date '%s' in command-line option: too long\n", __LINE__, optarg);
-            opt->is_date = FALSE;
-            opt->date[0] = '\0';
-            break;
-          }
-          len = 0;
-          while (cp[len] != '\0' && len < SIZE_TSTMP) {
-            if (! isdigit (cp[len]) && cp[len] != '-' && cp[len] != ' ' && cp[len] != ':') {
-              printf ("\n***Warning in main(), line %d: invalid date '%s' in command-line option: too long\n", __LINE__, optarg);
-              opt->is_date = FALSE;
-              opt->date[0] = '\0';
-              break;
-            }
-            len++;
-          }
-        }
-        break;
-      case 'O': /* --tot */
-        opt->is_tot = TRUE;
-        opt->is_quiet = TRUE;
-        break;
-      case 'Q': /* --qif */
-        opt->is_qif = TRUE;
-        strncpy (opt->qif, optarg, SIZE_ARB);
-        break;
-      case 'h': /* --help */
-        usage();
-        ret = 0;
-        goto CleanupAndQuit;
-      default:
-        if (ch == '?') {
-          printf ("\n\n***Error in main(), line %d: incorrect command-line option\n", __LINE__);
-          usage();
-          ret = -1;
-          goto CleanupAndQuit;
-        }
-        else {
-          printf ("\n***Error in main(), line %d: unknown command-line error: ch = %c", __LINE__, ch);
-          usage();
-          ret = -1;
-          goto CleanupAndQuit;
-        }
-    }
+  ret = parse_opts (argc, argv, TRUE);
+  if (ret) {
+    if (ret > 0)
+      /* --help */
+      ret = 0;
+    goto CleanupAndQuit;
   }
 
   strncpy (opt->home_dir, getenv ("HOME"), PATH_MAX-1);
@@ -3353,7 +5467,21 @@ int main (int argc, char *argv[])
     else 
       snprintf (opt->bgt, PATH_MAX-1, "%s/.bgt", opt->home_dir);
   }
-  snprintf (opt->db_name, PATH_MAX-1, "%s/%s", opt->bgt, "bgt.db");
+  if (snprintf (opt->db_name, PATH_MAX, "%s/%s", opt->bgt, "bgt.db") >= PATH_MAX) {
+    printf ("\n***Error in main(), line %d: The budget path %s is too long\n", __LINE__, opt->bgt);
+    ret = -1;
+    goto CleanupAndQuit;
+  }
+  if (opt->sock[0] == '\0' && snprintf (opt->sock, PATH_MAX, "%s/%s", opt->bgt, "bgt.sock") >= PATH_MAX) {
+    printf ("\n***Error in main(), line %d: The budget path %s is too long for its socket\n", __LINE__, opt->bgt);
+    ret = -1;
+    goto CleanupAndQuit;
+  }
+  if (opt->is_client) {
+    /* the daemon has the database open; don't touch it here */
+    ret = do_client (argc, args);
+    goto CleanupAndQuit;
+  }
   if (! fexists (opt->bgt)) {
     status = mkdir (opt->bgt, 0755);
     if (status != 0) {
@@ -3378,89 +5506,30 @@ int main (int argc, char *argv[])
       goto CleanupAndQuit;
     }
   }
-
-  if (opt->is_catt && ! opt->is_add && ! opt->is_ls && ! opt->is_tot && ! opt->is_edit) {
-    ret = do_new_cat ();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_add) {
-    ret = do_add ();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_ls) {
-    ret = do_ls();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_recalc) {
-    ret = do_recalc ();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_qry) {
-    ret = do_qry ();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_edit) {
-    ret = do_edit();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_rm) {
-    ret = do_rm ();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_exp) {
-    ret = do_exp();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_inc) {
-    ret = do_inc();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_net) {
-    ret = do_net();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_scr) {
-    ret = do_scr();
-    goto CleanupAndQuit;
-  }
-
-  if (opt->is_arch) {
-    ret = do_arch();
+  ret = set_profile ();
+  if (ret)
     goto CleanupAndQuit;
-  }
-
-  if (opt->is_csv) {
-    ret = do_csv();
+  ret = migrate_db ();
+  if (ret)
     goto CleanupAndQuit;
-  }
-
-  if (opt->is_nclr) {
-    if (!opt->is_ls) {
-      printf ("\n***Error, main(), line %d: --nclr should be used with --ls.\n", __LINE__);
-      ret = -1;
-      goto CleanupAndQuit;
-    }
-  }
 
-  if (opt->is_qif) {
-    ret = do_qif();
-    goto CleanupAndQuit;
-  }
+  if (opt->is_batch)
+    ret = do_batch ();
+  else if (opt->is_shell)
+    ret = do_shell ();
+  else if (opt->is_daemon)
+    ret = do_daemon ();
+  else
+    ret = run_opts ();
 
 CleanupAndQuit:
 
-  if (opt->db != 0)
+  cat_free ();
+  if (opt->db != 0) {
+    stmt_free_all ();
     sqlite3_close(opt->db);
+  }
   free (opt);
+  free (args);
   return ret;
 }
@@ -48,6 +48,7 @@
  */
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <number.h>
 #include <assert.h>
 #include <stdlib.h>
@@ -68,6 +69,7 @@ char *bcnumErrMsg[] = {
   "no bcnum error",                    /* BCNUM_NOERROR */
   "memory exhausted",                  /* BCNUM_MEMORY */
   "output string is too small",        /* BCNUM_TOOSMALL */
+  "division by zero",                  /* BCNUM_DIVZERO */
   /*
    * new ones here 
    */
@@ -75,21 +77,78 @@ char *bcnumErrMsg[] = {
   NULL
 };
 
-/* Storage used for special numbers. */
-bc_num _zero_;
-bc_num _one_;
-bc_num _two_;
+/*
+ * The default context, used by the bcnum_* functions and by anyone calling
+ * the bc_* routines without picking a context of their own.
+ */
+static bcnum_ctx bc_default;
+
+/* The context the bc_* routines work in.  Each thread has its own. */
+#ifdef __GNUC__
+static __thread bcnum_ctx *bc_ctx = &bc_default;
+#else
+static bcnum_ctx *bc_ctx = &bc_default;
+#endif
 
-static bc_num _bc_Free_list = NULL;
+/* Storage used for special numbers. */
+#define _zero_ (bc_ctx->zero)
+#define _one_ (bc_ctx->one)
+#define _two_ (bc_ctx->two)
 
-/* new_num allocates a number and sets fields to known values. */
+#define _bc_Free_list (bc_ctx->free_list)
 
 void rt_warn (char *mesg, ...);
 void rt_error (char *mesg, ...);
 void out_of_memory (void);
-char *num2str (bc_num num);
 void pn (bc_num num);
 
+/* Digit buffers come from the context's pool.  A buffer is rounded up to
+   the next size class and goes back on that class's list when its number
+   is freed, so steady-state arithmetic doesn't call malloc() at all.
+   Buffers bigger than the largest class are malloc()ed and free()d. */
+
+static char *bc_get_digits (int size, int *cap)
+{
+  char *ptr;
+  int cls = 0;
+  int bytes = BC_POOL_MIN;
+
+  while (cls < BC_POOL_CLASSES && bytes < size) {
+    cls++;
+    bytes <<= 1;
+  }
+  if (cls == BC_POOL_CLASSES) {
+    *cap = size;
+    return (char *) malloc ((size_t)size);
+  }
+  *cap = bytes;
+  ptr = bc_ctx->pool[cls];
+  if (ptr == NULL)
+    return (char *) malloc ((size_t)bytes);
+  memcpy (&bc_ctx->pool[cls], ptr, sizeof (char *));
+  return ptr;
+}
+
+static void bc_put_digits (char *ptr, int cap)
+{
+  int cls = 0;
+  int bytes = BC_POOL_MIN;
+
+  while (cls < BC_POOL_CLASSES && bytes != cap) {
+    cls++;
+    bytes <<= 1;
+  }
+  if (cls == BC_POOL_CLASSES) {
+    free (ptr);
+    return;
+  }
+  /* the link to the next free buffer is kept in the buffer itself */
+  memcpy (ptr, &bc_ctx->pool[cls], sizeof (char *));
+  bc_ctx->pool[cls] = ptr;
+}
+
+/* new_num allocates a number and sets fields to known values. */
+
 bc_num bc_new_num (int length, int scale)
 {
   bc_num temp;
@@ -107,7 +166,7 @@ bc_num bc_new_num (int length, int scale)
   temp->n_len = length;
   temp->n_scale = scale;
   temp->n_refs = 1;
-  temp->n_ptr = (char *) malloc ((size_t)length + scale);
+  temp->n_ptr = bc_get_digits (length + scale, &temp->n_size);
   if (temp->n_ptr == NULL)
     bc_out_of_memory ();
   temp->n_value = temp->n_ptr;
@@ -125,7 +184,7 @@ void bc_free_num (bc_num *num)
   (*num)->n_refs--;
   if ((*num)->n_refs == 0) {
     if ((*num)->n_ptr)
-      free ((*num)->n_ptr);
+      bc_put_digits ((*num)->n_ptr, (*num)->n_size);
     (*num)->n_next = _bc_Free_list;
     _bc_Free_list = *num;
   }
@@ -376,6 +435,240 @@ char bc_is_near_zero (bc_num num, int scale)
 }
 
 
+/* Digit kernels for _bc_do_add and _bc_do_sub.  Each one works on COUNT
+   digits of two operands of the same shape, from the pointers (at the
+   last digit) backwards, and returns the carry or borrow out.  The SIMD
+   versions do 16 or 32 digits a step: the digits are added (or
+   subtracted) bytewise, the places that generate a carry (>9) or pass
+   one on (==9) become bit masks, and one integer addition resolves the
+   carries of the whole step, the way a carry-lookahead adder does.  The
+   results are exactly those of the scalar loops. */
+
+static int bc_add_run_scalar (char *sumptr, const char *n1ptr, const char *n2ptr,
+                              int count, int carry)
+{
+  int val;
+
+  while (count-- > 0) {
+    val = *n1ptr-- + *n2ptr-- + carry;
+    if (val > (BASE - 1)) {
+      carry = 1;
+      val -= BASE;
+    }
+    else
+      carry = 0;
+    *sumptr-- = (char) val;
+  }
+  return carry;
+}
+
+static int bc_sub_run_scalar (char *diffptr, const char *n1ptr, const char *n2ptr,
+                              int count, int borrow)
+{
+  int val;
+
+  while (count-- > 0) {
+    val = *n1ptr-- - *n2ptr-- - borrow;
+    if (val < 0) {
+      val += BASE;
+      borrow = 1;
+    }
+    else
+      borrow = 0;
+    *diffptr-- = (char) val;
+  }
+  return borrow;
+}
+
+#if defined(__GNUC__) && defined(__SSE2__) && (defined(__x86_64__) || defined(__i386__))
+#define BC_HAVE_SIMD 1
+#include <immintrin.h>
+
+/* Reverse the bits of a movemask, so the last digit (the lowest place)
+   is bit 0 and carries run towards the high bits. */
+static unsigned int bc_rev16 (unsigned int m)
+{
+  m = ((m >> 1) & 0x5555) | ((m & 0x5555) << 1);
+  m = ((m >> 2) & 0x3333) | ((m & 0x3333) << 2);
+  m = ((m >> 4) & 0x0f0f) | ((m & 0x0f0f) << 4);
+  return ((m >> 8) & 0x00ff) | ((m & 0x00ff) << 8);
+}
+
+static unsigned int bc_rev32 (unsigned int m)
+{
+  return (bc_rev16 (m & 0xffff) << 16) | bc_rev16 (m >> 16);
+}
+
+/* Turn bit j of M into 0xff in byte j. */
+static __m128i bc_bits_to_bytes16 (unsigned int m)
+{
+  const __m128i sel = _mm_set_epi8 (-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+  __m128i v;
+
+  v = _mm_unpacklo_epi64 (_mm_set1_epi8 ((char) m), _mm_set1_epi8 ((char) (m >> 8)));
+  return _mm_cmpeq_epi8 (_mm_and_si128 (v, sel), sel);
+}
+
+/* The carries into each place of a step, given the places that generate
+   one (G) and pass one on (P), and the carry into the step.  Bit N of the
+   result is the carry out of the step. */
+#define BC_CARRIES(g, p, c) (((g) + ((g) | (p)) + (c)) ^ (g) ^ ((g) | (p)))
+
+static int bc_add_run_sse2 (char *sumptr, const char *n1ptr, const char *n2ptr,
+                            int count, int carry)
+{
+  const __m128i nine = _mm_set1_epi8 (BASE - 1);
+  const __m128i ten = _mm_set1_epi8 (BASE);
+  __m128i s;
+  unsigned int g, p, c;
+
+  for (; count >= 16; count -= 16) {
+    sumptr -= 16;
+    n1ptr -= 16;
+    n2ptr -= 16;
+    s = _mm_add_epi8 (_mm_loadu_si128 ((const __m128i *) (n1ptr + 1)),
+                      _mm_loadu_si128 ((const __m128i *) (n2ptr + 1)));
+    g = bc_rev16 ((unsigned int) _mm_movemask_epi8 (_mm_cmpgt_epi8 (s, nine)));
+    p = bc_rev16 ((unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (s, nine)));
+    c = BC_CARRIES (g, p, (unsigned int) carry);
+    carry = (int) ((c >> 16) & 1);
+    /* add the carries in (the mask is -1), then take 10 from the places over 9 */
+    s = _mm_sub_epi8 (s, bc_bits_to_bytes16 (bc_rev16 (c & 0xffff)));
+    s = _mm_sub_epi8 (s, _mm_and_si128 (_mm_cmpgt_epi8 (s, nine), ten));
+    _mm_storeu_si128 ((__m128i *) (sumptr + 1), s);
+  }
+  return bc_add_run_scalar (sumptr, n1ptr, n2ptr, count, carry);
+}
+
+static int bc_sub_run_sse2 (char *diffptr, const char *n1ptr, const char *n2ptr,
+                            int count, int borrow)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  const __m128i ten = _mm_set1_epi8 (BASE);
+  __m128i d;
+  unsigned int g, p, c;
+
+  for (; count >= 16; count -= 16) {
+    diffptr -= 16;
+    n1ptr -= 16;
+    n2ptr -= 16;
+    d = _mm_sub_epi8 (_mm_loadu_si128 ((const __m128i *) (n1ptr + 1)),
+                      _mm_loadu_si128 ((const __m128i *) (n2ptr + 1)));
+    g = bc_rev16 ((unsigned int) _mm_movemask_epi8 (_mm_cmpgt_epi8 (zero, d)));
+    p = bc_rev16 ((unsigned int) _mm_movemask_epi8 (_mm_cmpeq_epi8 (d, zero)));
+    c = BC_CARRIES (g, p, (unsigned int) borrow);
+    borrow = (int) ((c >> 16) & 1);
+    d = _mm_add_epi8 (d, bc_bits_to_bytes16 (bc_rev16 (c & 0xffff)));
+    d = _mm_add_epi8 (d, _mm_and_si128 (_mm_cmpgt_epi8 (zero, d), ten));
+    _mm_storeu_si128 ((__m128i *) (diffptr + 1), d);
+  }
+  return bc_sub_run_scalar (diffptr, n1ptr, n2ptr, count, borrow);
+}
+
+__attribute__ ((target ("avx2")))
+static __m256i bc_bits_to_bytes32 (unsigned int m)
+{
+  const __m256i idx = _mm256_set_epi8 (3, 3, 3, 3, 3, 3, 3, 3, 2, 2, 2, 2, 2, 2, 2, 2,
+                                       1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0, 0);
+  const __m256i sel = _mm256_set1_epi64x ((long long) 0x8040201008040201ULL);
+  __m256i v;
+
+  v = _mm256_shuffle_epi8 (_mm256_set1_epi32 ((int) m), idx);
+  return _mm256_cmpeq_epi8 (_mm256_and_si256 (v, sel), sel);
+}
+
+__attribute__ ((target ("avx2")))
+static int bc_add_run_avx2 (char *sumptr, const char *n1ptr, const char *n2ptr,
+                            int count, int carry)
+{
+  const __m256i nine = _mm256_set1_epi8 (BASE - 1);
+  const __m256i ten = _mm256_set1_epi8 (BASE);
+  __m256i s;
+  unsigned long long g, p, c;
+
+  for (; count >= 32; count -= 32) {
+    sumptr -= 32;
+    n1ptr -= 32;
+    n2ptr -= 32;
+    s = _mm256_add_epi8 (_mm256_loadu_si256 ((const __m256i *) (n1ptr + 1)),
+                         _mm256_loadu_si256 ((const __m256i *) (n2ptr + 1)));
+    g = bc_rev32 ((unsigned int) _mm256_movemask_epi8 (_mm256_cmpgt_epi8 (s, nine)));
+    p = bc_rev32 ((unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (s, nine)));
+    c = BC_CARRIES (g, p, (unsigned long long) carry);
+    carry = (int) ((c >> 32) & 1);
+    s = _mm256_sub_epi8 (s, bc_bits_to_bytes32 (bc_rev32 ((unsigned int) c)));
+    s = _mm256_sub_epi8 (s, _mm256_and_si256 (_mm256_cmpgt_epi8 (s, nine), ten));
+    _mm256_storeu_si256 ((__m256i *) (sumptr + 1), s);
+  }
+  return bc_add_run_sse2 (sumptr, n1ptr, n2ptr, count, carry);
+}
+
+__attribute__ ((target ("avx2")))
+static int bc_sub_run_avx2 (char *diffptr, const char *n1ptr, const char *n2ptr,
+                            int count, int borrow)
+{
+  const __m256i zero = _mm256_setzero_si256 ();
+  const __m256i ten = _mm256_set1_epi8 (BASE);
+  __m256i d;
+  unsigned long long g, p, c;
+
+  for (; count >= 32; count -= 32) {
+    diffptr -= 32;
+    n1ptr -= 32;
+    n2ptr -= 32;
+    d = _mm256_sub_epi8 (_mm256_loadu_si256 ((const __m256i *) (n1ptr + 1)),
+                         _mm256_loadu_si256 ((const __m256i *) (n2ptr + 1)));
+    g = bc_rev32 ((unsigned int) _mm256_movemask_epi8 (_mm256_cmpgt_epi8 (zero, d)));
+    p = bc_rev32 ((unsigned int) _mm256_movemask_epi8 (_mm256_cmpeq_epi8 (d, zero)));
+    c = BC_CARRIES (g, p, (unsigned long long) borrow);
+    borrow = (int) ((c >> 32) & 1);
+    d = _mm256_add_epi8 (d, bc_bits_to_bytes32 (bc_rev32 ((unsigned int) c)));
+    d = _mm256_add_epi8 (d, _mm256_and_si256 (_mm256_cmpgt_epi8 (zero, d), ten));
+    _mm256_storeu_si256 ((__m256i *) (diffptr + 1), d);
+  }
+  return bc_sub_run_sse2 (diffptr, n1ptr, n2ptr, count, borrow);
+}
+#endif
+
+typedef int (*bc_run_fn) (char *, const char *, const char *, int, int);
+
+static int bc_add_run_init (char *sumptr, const char *n1ptr, const char *n2ptr, int count, int carry);
+static int bc_sub_run_init (char *diffptr, const char *n1ptr, const char *n2ptr, int count, int borrow);
+
+/* The kernels in use.  The first call picks them for this CPU. */
+static bc_run_fn bc_add_run = bc_add_run_init;
+static bc_run_fn bc_sub_run = bc_sub_run_init;
+
+static void bc_pick_runs (void)
+{
+#ifdef BC_HAVE_SIMD
+  __builtin_cpu_init ();
+  if (__builtin_cpu_supports ("avx2")) {
+    bc_add_run = bc_add_run_avx2;
+    bc_sub_run = bc_sub_run_avx2;
+  }
+  else {
+    bc_add_run = bc_add_run_sse2;
+    bc_sub_run = bc_sub_run_sse2;
+  }
+#else
+  bc_add_run = bc_add_run_scalar;
+  bc_sub_run = bc_sub_run_scalar;
+#endif
+}
+
+static int bc_add_run_init (char *sumptr, const char *n1ptr, const char *n2ptr, int count, int carry)
+{
+  bc_pick_runs ();
+  return bc_add_run (sumptr, n1ptr, n2ptr, count, carry);
+}
+
+static int bc_sub_run_init (char *diffptr, const char *n1ptr, const char *n2ptr, int count, int borrow)
+{
+  bc_pick_runs ();
+  return bc_sub_run (diffptr, n1ptr, n2ptr, count, borrow);
+}
+
 /* Perform addition: N1 is added to N2 and the value is
    returned.  The signs of N1 and N2 are ignored.
    SCALE_MIN is to set the minimum scale of the result. */
@@ -436,19 +729,13 @@ static bc_num _bc_do_add (bc_num n1, bc_num n2, int scale_min)
    */
   n1bytes += n1->n_len;
   n2bytes += n2->n_len;
-  carry = 0;
-  while ((n1bytes > 0) && (n2bytes > 0)) {
-    *sumptr = *n1ptr-- + *n2ptr-- + carry;
-    if (*sumptr > (BASE - 1)) {
-      carry = 1;
-      *sumptr -= BASE;
-    }
-    else
-      carry = 0;
-    sumptr--;
-    n1bytes--;
-    n2bytes--;
-  }
+  count = MIN (n1bytes, n2bytes);
+  carry = bc_add_run (sumptr, n1ptr, n2ptr, count, 0);
+  sumptr -= count;
+  n1ptr -= count;
+  n2ptr -= count;
+  n1bytes -= count;
+  n2bytes -= count;
 
   /*
    * Now add carry the longer integer part. 
@@ -557,16 +844,11 @@ static bc_num _bc_do_sub (bc_num n1, bc_num n2, int scale_min)
    * Now do the equal length scale and integer parts. 
    */
 
-  for (count = 0; count < min_len + min_scale; count++) {
-    val = *n1ptr-- - *n2ptr-- - borrow;
-    if (val < 0) {
-      val += BASE;
-      borrow = 1;
-    }
-    else
-      borrow = 0;
-    *diffptr-- = val;
-  }
+  count = min_len + min_scale;
+  borrow = bc_sub_run (diffptr, n1ptr, n2ptr, count, borrow);
+  diffptr -= count;
+  n1ptr -= count;
+  n2ptr -= count;
 
   /*
    * If n1 has more digits then n2, we now do that subtract. 
@@ -731,6 +1013,7 @@ static bc_num new_sub_num (int length, int scale, char *value)
   temp->n_scale = scale;
   temp->n_refs = 1;
   temp->n_ptr = NULL;
+  temp->n_size = 0;
   temp->n_value = value;
   return temp;
 }
@@ -955,6 +1238,525 @@ static void _bc_rec_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num * prod,
   bc_free_num (&d2);
 }
 
+/* Limb arithmetic.  For long operands, multiply and divide convert the
+   digits to limbs of nine decimal digits (base 10^9), least significant
+   limb first, do the work there with 64 bit intermediates, and convert
+   the result back.  That does about 1/81 of the inner-loop steps of the
+   digit-at-a-time loops.  The numbers themselves stay one digit per
+   char, so everything else, and bc_str2num/bc_num2str, sees no change. */
+
+typedef unsigned int bc_limb;
+#define BC_LIMB_BASE 1000000000U
+#define BC_LIMB_DIGITS 9
+
+/* Operands with at least this many digits use limbs.  Tunable, like
+   mul_base_digits. */
+int mul_limb_digits = 10;
+int div_limb_digits = 10;
+
+/* Limb products where both sides have at least this many limbs split
+   recursively, as _bc_rec_mul does with digits; and divisions where both
+   the divisor and the quotient have at least div_newton_limbs limbs use a
+   Newton reciprocal on top of that instead of algorithm D.  Measured with
+   "crossover" in the TEST_BCNUM build. */
+int mul_karatsuba_limbs = 32;
+int div_newton_limbs = 1024;
+
+/* The number of limbs that hold N digits. */
+#define BC_LIMBS(n) (((n) + BC_LIMB_DIGITS - 1) / BC_LIMB_DIGITS)
+
+/* Convert the N digits at DIGITS, most significant first, to limbs.
+   Returns the number of limbs written. */
+static int bc_to_limbs (const char *digits, int n, bc_limb *limbs)
+{
+  int nl = 0;
+  int i, j;
+  bc_limb v;
+
+  for (i = n; i > 0; i -= BC_LIMB_DIGITS) {
+    v = 0;
+    for (j = MAX (0, i - BC_LIMB_DIGITS); j < i; j++)
+      v = v * BASE + (bc_limb) digits[j];
+    limbs[nl++] = v;
+  }
+  return nl;
+}
+
+/* Write the low N digits of the NL limbs at LIMBS into DIGITS, most
+   significant first. */
+static void bc_from_limbs (const bc_limb *limbs, int nl, char *digits, int n)
+{
+  int i = n - 1;
+  int j, k;
+  bc_limb v;
+
+  for (k = 0; i >= 0; k++) {
+    v = k < nl ? limbs[k] : 0;
+    for (j = 0; j < BC_LIMB_DIGITS && i >= 0; j++, i--) {
+      digits[i] = (char) (v % BASE);
+      v /= BASE;
+    }
+  }
+}
+
+/* Drop the zero limbs at the top. */
+static int bc_limb_trim (const bc_limb *limbs, int nl)
+{
+  while (nl > 0 && limbs[nl - 1] == 0)
+    nl--;
+  return nl;
+}
+
+/* R = A * B.  R has room for NA + NB limbs and doesn't overlap A or B. */
+static void bc_limb_mul (const bc_limb *a, int na, const bc_limb *b, int nb, bc_limb *r)
+{
+  unsigned long long t, carry;
+  int i, j;
+
+  memset (r, 0, (size_t) (na + nb) * sizeof (bc_limb));
+  for (i = 0; i < na; i++) {
+    if (a[i] == 0)
+      continue;
+    carry = 0;
+    for (j = 0; j < nb; j++) {
+      t = (unsigned long long) a[i] * b[j] + r[i + j] + carry;
+      r[i + j] = (bc_limb) (t % BC_LIMB_BASE);
+      carry = t / BC_LIMB_BASE;
+    }
+    r[i + nb] = (bc_limb) carry;
+  }
+}
+
+/* Q = U / V, truncated, by Knuth's algorithm D.  U has NU limbs and is
+   overwritten; V has NV limbs, the top one not zero, and is overwritten
+   too.  Q has room for NU - NV + 1 limbs.  U needs one limb of room past
+   NU for the normalization. */
+static void bc_limb_div (bc_limb *u, int nu, bc_limb *v, int nv, bc_limb *q)
+{
+  unsigned long long num, qhat, rhat, p, carry, d;
+  long long t, borrow;
+  int i, j;
+
+  if (nv == 1) {
+    /* short division */
+    rhat = 0;
+    for (j = nu - 1; j >= 0; j--) {
+      num = rhat * BC_LIMB_BASE + u[j];
+      q[j] = (bc_limb) (num / v[0]);
+      rhat = num % v[0];
+    }
+    /* leave the remainder in U, as the long case does (times d) */
+    u[0] = (bc_limb) rhat;
+    return;
+  }
+
+  /* normalize so the top limb of V is at least BASE/2 */
+  d = BC_LIMB_BASE / ((unsigned long long) v[nv - 1] + 1);
+  carry = 0;
+  for (i = 0; i < nu; i++) {
+    p = u[i] * d + carry;
+    u[i] = (bc_limb) (p % BC_LIMB_BASE);
+    carry = p / BC_LIMB_BASE;
+  }
+  u[nu] = (bc_limb) carry;
+  carry = 0;
+  for (i = 0; i < nv; i++) {
+    p = v[i] * d + carry;
+    v[i] = (bc_limb) (p % BC_LIMB_BASE);
+    carry = p / BC_LIMB_BASE;
+  }
+
+  for (j = nu - nv; j >= 0; j--) {
+    /* guess the quotient limb from the top two limbs, then correct it */
+    num = (unsigned long long) u[j + nv] * BC_LIMB_BASE + u[j + nv - 1];
+    qhat = num / v[nv - 1];
+    rhat = num % v[nv - 1];
+    while (qhat >= BC_LIMB_BASE
+           || qhat * v[nv - 2] > rhat * BC_LIMB_BASE + u[j + nv - 2]) {
+      qhat--;
+      rhat += v[nv - 1];
+      if (rhat >= BC_LIMB_BASE)
+        break;
+    }
+
+    /* multiply and subtract */
+    carry = 0;
+    borrow = 0;
+    for (i = 0; i < nv; i++) {
+      p = qhat * v[i] + carry;
+      carry = p / BC_LIMB_BASE;
+      t = (long long) u[i + j] - (long long) (p % BC_LIMB_BASE) - borrow;
+      borrow = t < 0;
+      u[i + j] = (bc_limb) (t < 0 ? t + BC_LIMB_BASE : t);
+    }
+    t = (long long) u[j + nv] - (long long) carry - borrow;
+
+    /* the guess was one too big: add V back */
+    if (t < 0) {
+      qhat--;
+      carry = 0;
+      for (i = 0; i < nv; i++) {
+        p = (unsigned long long) u[i + j] + v[i] + carry;
+        u[i + j] = (bc_limb) (p % BC_LIMB_BASE);
+        carry = p / BC_LIMB_BASE;
+      }
+      t += (long long) carry;
+    }
+    u[j + nv] = (bc_limb) t;
+    q[j] = (bc_limb) qhat;
+  }
+}
+
+static const bc_limb bc_limb_one = 1;
+
+/* R += X.  R has NR limbs, NX of them lined up with X; the sum fits. */
+static void bc_limb_add_to (bc_limb *r, int nr, const bc_limb *x, int nx)
+{
+  bc_limb t, carry = 0;
+  int i;
+
+  for (i = 0; i < nx; i++) {
+    t = r[i] + x[i] + carry;
+    carry = t >= BC_LIMB_BASE;
+    r[i] = carry ? t - BC_LIMB_BASE : t;
+  }
+  for (; carry && i < nr; i++) {
+    t = r[i] + 1;
+    carry = t >= BC_LIMB_BASE;
+    r[i] = carry ? 0 : t;
+  }
+}
+
+/* R -= X.  R has NR limbs and is at least X, which has NX. */
+static void bc_limb_sub_from (bc_limb *r, int nr, const bc_limb *x, int nx)
+{
+  bc_limb sub, borrow = 0;
+  int i;
+
+  for (i = 0; i < nx; i++) {
+    sub = x[i] + borrow;
+    borrow = r[i] < sub;
+    r[i] = borrow ? r[i] + BC_LIMB_BASE - sub : r[i] - sub;
+  }
+  for (; borrow && i < nr; i++) {
+    borrow = r[i] == 0;
+    r[i] = borrow ? BC_LIMB_BASE - 1 : r[i] - 1;
+  }
+}
+
+/* Compare A and B: -1, 0 or 1. */
+static int bc_limb_cmp (const bc_limb *a, int na, const bc_limb *b, int nb)
+{
+  na = bc_limb_trim (a, na);
+  nb = bc_limb_trim (b, nb);
+  if (na != nb)
+    return na < nb ? -1 : 1;
+  while (--na >= 0)
+    if (a[na] != b[na])
+      return a[na] < b[na] ? -1 : 1;
+  return 0;
+}
+
+/* R = A * B, as bc_limb_mul, splitting long operands in halves so that
+   three half-size products do the work of four:
+     (A1 B^h + A0)(B1 B^h + B0)
+       = A1 B1 B^2h + ((A0 + A1)(B0 + B1) - A0 B0 - A1 B1) B^h + A0 B0
+   If memory runs short it just does the long multiplication. */
+static void bc_limb_kmul (const bc_limb *a, int na, const bc_limb *b, int nb, bc_limb *r)
+{
+  const bc_limb *t;
+  bc_limb *sa, *sb, *z1;
+  int h, i, len;
+
+  if (na < nb) {
+    t = a, a = b, b = t;
+    i = na, na = nb, nb = i;
+  }
+  if (nb < MAX (mul_karatsuba_limbs, 4)) {
+    bc_limb_mul (a, na, b, nb, r);
+    return;
+  }
+
+  if (na >= 2 * nb) {
+    /* lopsided: the long side in pieces the length of the short one */
+    sa = (bc_limb *) malloc ((size_t) (2 * nb) * sizeof (bc_limb));
+    if (sa == NULL) {
+      bc_limb_mul (a, na, b, nb, r);
+      return;
+    }
+    memset (r, 0, (size_t) (na + nb) * sizeof (bc_limb));
+    for (i = 0; i < na; i += nb) {
+      len = MIN (nb, na - i);
+      bc_limb_kmul (a + i, len, b, nb, sa);
+      bc_limb_add_to (r + i, na + nb - i, sa, len + nb);
+    }
+    free (sa);
+    return;
+  }
+
+  /* na < 2 nb, so B has at least h limbs */
+  h = (na + 1) / 2;
+  sa = (bc_limb *) malloc ((size_t) (4 * h + 4) * sizeof (bc_limb));
+  if (sa == NULL) {
+    bc_limb_mul (a, na, b, nb, r);
+    return;
+  }
+  sb = sa + h + 1;
+  z1 = sb + h + 1;
+
+  /* A0 B0 and A1 B1 go straight into R */
+  bc_limb_kmul (a, h, b, h, r);
+  memset (r + 2 * h, 0, (size_t) (na + nb - 2 * h) * sizeof (bc_limb));
+  if (nb > h)
+    bc_limb_kmul (a + h, na - h, b + h, nb - h, r + 2 * h);
+
+  /* the middle term */
+  memcpy (sa, a, (size_t) h * sizeof (bc_limb));
+  sa[h] = 0;
+  bc_limb_add_to (sa, h + 1, a + h, na - h);
+  memcpy (sb, b, (size_t) h * sizeof (bc_limb));
+  sb[h] = 0;
+  bc_limb_add_to (sb, h + 1, b + h, nb - h);
+  bc_limb_kmul (sa, h + 1, sb, h + 1, z1);
+  bc_limb_sub_from (z1, 2 * h + 2, r, 2 * h);
+  bc_limb_sub_from (z1, 2 * h + 2, r + 2 * h, na + nb - 2 * h);
+  bc_limb_add_to (r + h, na + nb - h, z1, bc_limb_trim (z1, 2 * h + 2));
+  free (sa);
+}
+
+/* X = B^2K / D, from below and within a few units, where D has K limbs,
+   the top one not zero.  X has room for K + 2 limbs.  Returns the number
+   of limbs in X, or -1 if memory runs out.
+
+   Small ones are divided out.  Otherwise the reciprocal of D's top h
+   limbs (plus one, so it stays an underestimate) gives about h limbs,
+   and a Newton step X += X (B^2K - D X) / B^2K doubles that.  Newton's
+   step for 1/D never overshoots, so X stays below B^2K / D. */
+static int bc_limb_recip (const bc_limb *d, int k, bc_limb *x)
+{
+  bc_limb *buf, *dh, *xh, *e, *p;
+  int h, nxh, ne, np, nx;
+
+  if (k <= 4) {
+    buf = (bc_limb *) calloc ((size_t) (3 * k + 2), sizeof (bc_limb));
+    if (buf == NULL)
+      return -1;
+    buf[2 * k] = 1;
+    memcpy (buf + 2 * k + 2, d, (size_t) k * sizeof (bc_limb));
+    bc_limb_div (buf, 2 * k + 1, buf + 2 * k + 2, k, x);
+    free (buf);
+    return bc_limb_trim (x, k + 2);
+  }
+
+  h = k / 2 + 2;
+  buf = (bc_limb *) malloc ((size_t) ((h + 1) + (h + 2) + (2 * k + 1) + (2 * k + h + 3)) * sizeof (bc_limb));
+  if (buf == NULL)
+    return -1;
+  dh = buf;
+  xh = dh + h + 1;
+  e = xh + h + 2;
+  p = e + 2 * k + 1;
+
+  /* the top of D, plus one */
+  memcpy (dh, d + k - h, (size_t) h * sizeof (bc_limb));
+  dh[h] = 0;
+  bc_limb_add_to (dh, h + 1, &bc_limb_one, 1);
+  if (dh[h] != 0) {
+    /* it was all nines: the reciprocal is B^h */
+    memset (xh, 0, (size_t) h * sizeof (bc_limb));
+    xh[h] = 1;
+    nxh = h + 1;
+  }
+  else if ((nxh = bc_limb_recip (dh, h, xh)) < 0) {
+    free (buf);
+    return -1;
+  }
+
+  /* X0 = xh B^(k-h); E = B^2k - D X0, the D xh part shifted up k-h limbs */
+  bc_limb_kmul (d, k, xh, nxh, p);
+  np = bc_limb_trim (p, k + nxh);
+  memset (e, 0, (size_t) (2 * k + 1) * sizeof (bc_limb));
+  e[2 * k] = 1;
+  bc_limb_sub_from (e + k - h, k + h + 1, p, np);
+  ne = bc_limb_trim (e, 2 * k + 1);
+
+  /* X = X0 + X0 E / B^2k = xh B^(k-h) + xh E / B^(k+h) */
+  bc_limb_kmul (xh, nxh, e, ne, p);
+  memset (x, 0, (size_t) (k + 2) * sizeof (bc_limb));
+  memcpy (x + k - h, xh, (size_t) nxh * sizeof (bc_limb));
+  np = bc_limb_trim (p, nxh + ne) - (k + h);
+  if (np > 0)
+    bc_limb_add_to (x, k + 2, p + k + h, np);
+  nx = bc_limb_trim (x, k + 2);
+  free (buf);
+  return nx;
+}
+
+/* Q = U / V, truncated, for long operands.  V's reciprocal, to as many
+   limbs as the quotient needs, times the top of U gives a quotient good
+   to a few units; U - QV then says how far off it is, and dividing that
+   by V (which is short work) makes it exact.  U has NU limbs and V has
+   NV, the top ones not zero; neither is changed.  Q has room for
+   NU - NV + 1 limbs.  Returns -1 if memory runs out. */
+static int bc_limb_newton_div (const bc_limb *u, int nu, const bc_limb *v, int nv, bc_limb *q)
+{
+  bc_limb *x, *qq, *p, *r, *vc, *cq;
+  int m, k, s, nx, nqq, np, nr, ncq, cmp, rem, i, size;
+
+  m = nu - nv + 1;
+  k = MIN (nv, m + 2);
+  s = MAX (nu - (m + 2), 0);
+  size = nu + k + nv + 8;
+  x = (bc_limb *) malloc ((size_t) (k + 2 + 5 * size) * sizeof (bc_limb));
+  if (x == NULL)
+    return -1;
+  qq = x + k + 2;
+  p = qq + size;
+  r = p + size;
+  vc = r + size;
+  cq = vc + size;
+
+  /* 1/V ~ X / B^(k+nv), so Q ~ (U / B^s) X / B^(k+nv-s) */
+  if ((nx = bc_limb_recip (v + nv - k, k, x)) < 0) {
+    free (x);
+    return -1;
+  }
+  bc_limb_kmul (u + s, nu - s, x, nx, p);
+  nqq = nu - s + nx - (k + nv - s);
+  memset (qq, 0, (size_t) size * sizeof (bc_limb));
+  if (nqq > 0)
+    memcpy (qq, p + k + nv - s, (size_t) nqq * sizeof (bc_limb));
+  nqq = bc_limb_trim (qq, MAX (nqq, 0));
+
+  /* how far off is it? */
+  np = 0;
+  if (nqq > 0) {
+    bc_limb_kmul (qq, nqq, v, nv, p);
+    np = bc_limb_trim (p, nqq + nv);
+  }
+  cmp = bc_limb_cmp (p, np, u, nu);
+  memset (r, 0, (size_t) size * sizeof (bc_limb));
+  if (cmp > 0) {
+    memcpy (r, p, (size_t) np * sizeof (bc_limb));
+    bc_limb_sub_from (r, np, u, nu);
+  }
+  else {
+    memcpy (r, u, (size_t) nu * sizeof (bc_limb));
+    bc_limb_sub_from (r, nu, p, np);
+  }
+  nr = bc_limb_trim (r, size - 1);
+
+  /* the correction is |U - QV| / V, rounded away from Q when Q is high */
+  memset (cq, 0, (size_t) size * sizeof (bc_limb));
+  ncq = 0;
+  rem = nr > 0;
+  if (nr >= nv) {
+    memcpy (vc, v, (size_t) nv * sizeof (bc_limb));
+    bc_limb_div (r, nr, vc, nv, cq);
+    ncq = bc_limb_trim (cq, nr - nv + 1);
+    for (i = 0, rem = 0; i < nv; i++)
+      rem |= r[i] != 0;
+  }
+  if (cmp > 0) {
+    if (rem) {
+      bc_limb_add_to (cq, size, &bc_limb_one, 1);
+      ncq = bc_limb_trim (cq, size);
+    }
+    bc_limb_sub_from (qq, size, cq, ncq);
+  }
+  else
+    bc_limb_add_to (qq, size, cq, ncq);
+
+  memcpy (q, qq, (size_t) m * sizeof (bc_limb));
+  free (x);
+  return 0;
+}
+
+/* The limb version of _bc_rec_mul: the ULEN digits of U times the VLEN
+   digits of V, as an integer with ULEN + VLEN + 1 digits. */
+static void _bc_limb_mul (bc_num u, int ulen, bc_num v, int vlen, bc_num *prod)
+{
+  bc_limb *a, *b, *r;
+  int na, nb, prodlen;
+
+  prodlen = ulen + vlen + 1;
+  *prod = bc_new_num (prodlen, 0);
+  a = (bc_limb *) malloc ((size_t) (2 * (BC_LIMBS (ulen) + BC_LIMBS (vlen))) * sizeof (bc_limb));
+  if (a == NULL) {
+    bc_out_of_memory ();
+    return;
+  }
+  na = bc_to_limbs (u->n_value, ulen, a);
+  b = a + na;
+  nb = bc_to_limbs (v->n_value, vlen, b);
+  r = b + nb;
+  bc_limb_kmul (a, na, b, nb, r);
+  bc_from_limbs (r, na + nb, (*prod)->n_value, prodlen);
+  free (a);
+}
+
+/* The limb version of the division in bc_divide: N1 / N2 truncated to
+   SCALE places.  The quotient is the integer A * 10^(SCALE + s2 - s1) / B,
+   where A and B are the digits of N1 and N2 as integers and s1 and s2
+   their scales (or A / (B * 10^-(...)) when that power is negative). */
+static bc_num _bc_limb_divide (bc_num n1, bc_num n2, int scale)
+{
+  bc_num qval;
+  char *digits;
+  bc_limb *u, *v, *q;
+  int alen, blen, shift, ndig, nu, nv, nq, qlen, i;
+  bc_limb top;
+
+  alen = n1->n_len + n1->n_scale;
+  blen = n2->n_len + n2->n_scale;
+  shift = scale + n2->n_scale - n1->n_scale;
+  ndig = MAX (alen + MAX (shift, 0), blen + MAX (-shift, 0));
+
+  digits = (char *) malloc ((size_t) ndig);
+  u = (bc_limb *) malloc ((size_t) (3 * BC_LIMBS (ndig) + 3) * sizeof (bc_limb));
+  if (digits == NULL || u == NULL) {
+    bc_out_of_memory ();
+    free (digits);
+    free (u);
+    return bc_copy_num (_zero_);
+  }
+
+  /* the dividend, shifted left when the power is positive */
+  memcpy (digits, n1->n_value, (size_t) alen);
+  memset (digits + alen, 0, (size_t) MAX (shift, 0));
+  nu = bc_to_limbs (digits, alen + MAX (shift, 0), u);
+  v = u + nu + 1;
+  /* the divisor, shifted left when it is negative */
+  memcpy (digits, n2->n_value, (size_t) blen);
+  memset (digits + blen, 0, (size_t) MAX (-shift, 0));
+  nv = bc_limb_trim (v, bc_to_limbs (digits, blen + MAX (-shift, 0), v));
+  q = v + nv;
+  nu = bc_limb_trim (u, nu);
+  free (digits);
+
+  if (nu < nv)
+    nq = 0;
+  else {
+    if (MIN (nv, nu - nv + 1) < div_newton_limbs
+        || bc_limb_newton_div (u, nu, v, nv, q) != 0)
+      bc_limb_div (u, nu, v, nv, q);
+    nq = bc_limb_trim (q, nu - nv + 1);
+  }
+
+  /* count the quotient's digits so its integer part has no leading zeros */
+  qlen = 0;
+  if (nq > 0) {
+    qlen = (nq - 1) * BC_LIMB_DIGITS;
+    for (top = q[nq - 1]; top != 0; top /= BASE)
+      qlen++;
+  }
+  i = MAX (qlen - scale, 1);
+  qval = bc_new_num (i, scale);
+  bc_from_limbs (q, nq, qval->n_value, i + scale);
+  free (u);
+  return qval;
+}
+
 /* The multiply routine.  N2 times N1 is put int PROD with the scale of
    the result being MIN(N2 scale+N1 scale, MAX (SCALE, N2 scale, N1 scale)).
    */
@@ -976,7 +1778,10 @@ void bc_multiply (bc_num n1, bc_num n2, bc_num *prod, int scale)
   /*
    * Do the multiply 
    */
-  _bc_rec_mul (n1, len1, n2, len2, &pval, full_scale);
+  if (len1 >= mul_limb_digits && len2 >= mul_limb_digits)
+    _bc_limb_mul (n1, len1, n2, len2, &pval);
+  else
+    _bc_rec_mul (n1, len1, n2, len2, &pval, full_scale);
 
   /*
    * Assign to prod and clean up the number. 
@@ -1068,6 +1873,20 @@ int bc_divide (bc_num n1, bc_num n2, bc_num *quot, int scale)
     }
   }
 
+  /*
+   * Long operands go to the limb divide. 
+   */
+  if (n1->n_len + scale >= div_limb_digits || n2->n_len + n2->n_scale >= div_limb_digits) {
+    qval = _bc_limb_divide (n1, n2, scale);
+    qval->n_sign = (n1->n_sign == n2->n_sign ? PLUS : MINUS);
+    if (bc_is_zero (qval))
+      qval->n_sign = PLUS;
+    _bc_rm_leading_zeros (qval);
+    bc_free_num (quot);
+    *quot = qval;
+    return 0;
+  }
+
   /*
    * Set up the divide.  Move the decimal point on n1 by n2's scale.
    * Remember, zeros on the end of num2 are wasted effort for dividing. 
@@ -1840,22 +2659,141 @@ void bc_int2num (bc_num *num, int val)
     *vptr++ = *--bptr;
 }
 
-/* Convert a numbers to a string.  Base 10 only.*/
+/*
+ * Word-at-a-time (SWAR) decimal conversion.  Converting between characters
+ * and digit values is a byte-wise add or subtract of '0' that never
+ * carries, so eight digits go at once.  Counting the digits at the front of
+ * a string, and parsing or formatting eight digits as one binary value,
+ * depend on byte order and are only done word-wise on little-endian GCC
+ * builds.  Otherwise the loops fall back to a character at a time.
+ */
+#if defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define BC_SWAR 1
+#endif
+
+#define BC_ONES 0x0101010101010101ULL
 
-char *num2str (bc_num num)
+/* Copy N digit characters at SRC into DST as digit values. */
+static void bc_unpack_digits (char *dst, const char *src, int n)
 {
-  char *str, *sptr;
-  char *nptr;
-  int index, signch;
+  unsigned long long x;
 
-  /*
-   * Allocate the string memory. 
-   */
-  signch = (num->n_sign == PLUS ? 0 : 1);       /* Number of sign chars. */
-  if (num->n_scale > 0)
-    str = (char *) malloc ((size_t)(num->n_len + num->n_scale + 2 + signch));
-  else
-    str = (char *) malloc ((size_t)(num->n_len + 1 + signch));
+  for (; n >= 8; n -= 8, src += 8, dst += 8) {
+    memcpy (&x, src, 8);
+    x -= 0x30 * BC_ONES;
+    memcpy (dst, &x, 8);
+  }
+  while (n-- > 0)
+    *dst++ = CH_VAL (*src++);
+}
+
+/* Copy N digit values at SRC into DST as characters. */
+static void bc_pack_digits (char *dst, const char *src, int n)
+{
+  unsigned long long x;
+
+  for (; n >= 8; n -= 8, src += 8, dst += 8) {
+    memcpy (&x, src, 8);
+    x += 0x30 * BC_ONES;
+    memcpy (dst, &x, 8);
+  }
+  while (n-- > 0)
+    *dst++ = BCD_CHAR (*src++);
+}
+
+#ifdef BC_SWAR
+/* The first N characters at P (all eight if there are that many) as a
+   word, zero filled.  Shorter loads overlap rather than go byte by byte. */
+static unsigned long long bc_load8 (const char *p, size_t n)
+{
+  unsigned long long x;
+  unsigned int lo, hi;
+  unsigned short lo2, hi2;
+
+  if (n >= 8)
+    memcpy (&x, p, 8);
+  else if (n >= 4) {
+    memcpy (&lo, p, 4);
+    memcpy (&hi, p + n - 4, 4);
+    x = lo | ((unsigned long long) hi << ((n - 4) * 8));
+  }
+  else if (n >= 2) {
+    memcpy (&lo2, p, 2);
+    memcpy (&hi2, p + n - 2, 2);
+    x = lo2 | ((unsigned long long) hi2 << ((n - 2) * 8));
+  }
+  else
+    x = n ? (unsigned char) *p : 0;
+  return x;
+}
+#endif
+
+/* The number of digits at the start of P.  END is the end of the string. */
+static int bc_digit_run (const char *p, const char *end)
+{
+#ifdef BC_SWAR
+  const char *start = p;
+  unsigned long long x, y, nd;
+
+  for (; p < end; p += 8) {
+    x = bc_load8 (p, (size_t) (end - p));
+    /* bit 7 of each byte of nd is set unless the byte is '0'..'9' */
+    y = x & (0x7f * BC_ONES);
+    nd = ~((y + 0x50 * BC_ONES) & ~(y + 0x46 * BC_ONES) & ~x) & (0x80 * BC_ONES);
+    if (nd != 0)
+      return (int) (p - start) + (__builtin_ctzll (nd) >> 3);
+  }
+  return (int) (end - start);
+#else
+  int n = 0;
+
+  while (p + n < end && isdigit ((int) p[n]))
+    n++;
+  return n;
+#endif
+}
+
+#ifdef BC_SWAR
+/* The value of the eight digit characters in X, the first one in memory
+   being the most significant. */
+static unsigned long long bc_parse8 (unsigned long long x)
+{
+  x -= 0x30 * BC_ONES;
+  x = (x * 10) + (x >> 8);
+  return (((x & 0x000000ff000000ffULL) * (100 + (1000000ULL << 32)))
+          + (((x >> 16) & 0x000000ff000000ffULL) * (1 + (10000ULL << 32)))) >> 32;
+}
+
+/* V (below 10^8) as eight digit characters, leading zeros included. */
+static unsigned long long bc_format8 (unsigned int v)
+{
+  unsigned long long x, q;
+
+  x = (v / 10000) | ((unsigned long long) (v % 10000) << 32);
+  q = ((x * 5243) >> 19) & 0x0000007f0000007fULL;        /* n / 100 */
+  x = q | ((x - q * 100) << 16);
+  q = ((x * 103) >> 10) & 0x000f000f000f000fULL;         /* n / 10 */
+  x = q | ((x - q * 10) << 8);
+  return x + 0x30 * BC_ONES;
+}
+#endif
+
+/* Convert a numbers to a string.  Base 10 only.*/
+
+char *bc_num2str (bc_num num)
+{
+  char *str, *sptr;
+  char *nptr;
+  int signch;
+
+  /*
+   * Allocate the string memory. 
+   */
+  signch = (num->n_sign == PLUS ? 0 : 1);       /* Number of sign chars. */
+  if (num->n_scale > 0)
+    str = (char *) malloc ((size_t)(num->n_len + num->n_scale + 2 + signch));
+  else
+    str = (char *) malloc ((size_t)(num->n_len + 1 + signch));
   if (str == NULL)
     bc_out_of_memory ();
 
@@ -1870,16 +2808,17 @@ char *num2str (bc_num num)
    * Load the whole number. 
    */
   nptr = num->n_value;
-  for (index = num->n_len; index > 0; index--)
-    *sptr++ = BCD_CHAR (*nptr++);
+  bc_pack_digits (sptr, nptr, num->n_len);
+  sptr += num->n_len;
+  nptr += num->n_len;
 
   /*
    * Now the fraction. 
    */
   if (num->n_scale > 0) {
     *sptr++ = '.';
-    for (index = 0; index < num->n_scale; index++)
-      *sptr++ = BCD_CHAR (*nptr++);
+    bc_pack_digits (sptr, nptr, num->n_scale);
+    sptr += num->n_scale;
   }
 
   /*
@@ -1894,7 +2833,7 @@ char *num2str (bc_num num)
 void bc_str2num (bc_num *num, char *str, int scale)
 {
   int digits, strscale;
-  char *ptr, *nptr;
+  char *ptr, *nptr, *end;
   char zero_int;
 
   /*
@@ -1906,19 +2845,18 @@ void bc_str2num (bc_num *num, char *str, int scale)
    * Check for valid number and count digits. 
    */
   ptr = str;
-  digits = 0;
-  strscale = 0;
+  end = str + strlen (str);
   zero_int = FALSE;
   if ((*ptr == '+') || (*ptr == '-'))
     ptr++;                             /* Sign */
   while (*ptr == '0')
     ptr++;                             /* Skip leading zeros. */
-  while (isdigit ((int) *ptr))
-    ptr++, digits++;                   /* digits */
+  digits = bc_digit_run (ptr, end);
+  ptr += digits;                       /* digits */
   if (*ptr == '.')
     ptr++;                             /* decimal point */
-  while (isdigit ((int) *ptr))
-    ptr++, strscale++;                 /* digits */
+  strscale = bc_digit_run (ptr, end);
+  ptr += strscale;                     /* digits */
   if ((*ptr != '\0') || (digits + strscale == 0)) {
     *num = bc_copy_num (_zero_);
     return;
@@ -1954,17 +2892,16 @@ void bc_str2num (bc_num *num, char *str, int scale)
     *nptr++ = 0;
     digits = 0;
   }
-  for (; digits > 0; digits--)
-    *nptr++ = CH_VAL (*ptr++);
-
+  bc_unpack_digits (nptr, ptr, digits);
+  nptr += digits;
+  ptr += digits;
 
   /*
    * Build the fractional part. 
    */
   if (strscale > 0) {
     ptr++;                             /* skip the decimal point! */
-    for (; strscale > 0; strscale--)
-      *nptr++ = CH_VAL (*ptr++);
+    bc_unpack_digits (nptr, ptr, strscale);
   }
 }
 
@@ -2002,20 +2939,57 @@ static void my_atexit (void)
 
 void out_char_str (int c)
 {
-  bcnum_outstr[bcnum_outstr_ptr] = (char) c;
-  bcnum_outstr_ptr++;
-  if (bcnum_outstr_ptr >= BCNUM_OUTSTRING_SIZE) {
-    bcnumError = BCNUM_TOOSMALL;
-    memset (bcnum_outstr, 0, BCNUM_OUTSTRING_SIZE);
-    bcnum_outstr_ptr = 0;
+  if (bc_ctx->out == NULL || bc_ctx->out_ptr + 1 >= bc_ctx->out_size) {
+    bc_ctx->error = BCNUM_TOOSMALL;
+    if (bc_ctx->out != NULL && bc_ctx->out_size > 0)
+      bc_ctx->out[0] = '\0';
+    bc_ctx->out_ptr = 0;
     return;
   }
-  bcnum_outstr[bcnum_outstr_ptr] = '\0';
+  bc_ctx->out[bc_ctx->out_ptr++] = (char) c;
+  bc_ctx->out[bc_ctx->out_ptr] = '\0';
 }
 
+/* Write NUM into the output buffer in base 10.  This is bc_out_num (num,
+   10, out_char_str, 0), but when the result fits it goes straight in,
+   eight digits at a time, rather than through out_char_str() a
+   character at a time. */
 void pn_str (bc_num num)
 {
-  bc_out_num (num, 10, out_char_str, 0);
+  char *p, *nptr;
+  int zero, intd;
+  size_t need;
+
+  zero = bc_is_zero (num);
+  intd = (num->n_len > 1 || *num->n_value != 0) ? num->n_len : 0;
+  need = (num->n_sign == MINUS);
+  if (zero)
+    need += 1;
+  else
+    need += (size_t) intd + (num->n_scale > 0 ? 1 + (size_t) num->n_scale : 0);
+  if (bc_ctx->out == NULL || bc_ctx->out_ptr + need >= bc_ctx->out_size) {
+    bc_out_num (num, 10, out_char_str, 0);
+    return;
+  }
+
+  p = bc_ctx->out + bc_ctx->out_ptr;
+  if (num->n_sign == MINUS)
+    *p++ = '-';
+  if (zero)
+    *p++ = '0';
+  else {
+    nptr = num->n_value + (num->n_len - intd);
+    bc_pack_digits (p, nptr, intd);
+    p += intd;
+    nptr += intd;
+    if (num->n_scale > 0) {
+      *p++ = '.';
+      bc_pack_digits (p, nptr, num->n_scale);
+      p += num->n_scale;
+    }
+  }
+  *p = '\0';
+  bc_ctx->out_ptr += need;
 }
 
 void rt_error (char *mesg, ...)
@@ -2023,19 +2997,13 @@ void rt_error (char *mesg, ...)
   size_t len;
   va_list args;
 
-#ifdef HAVE_SNPRINTF
-  (int)snprintf (bcnum_outstr, BCNUM_OUTSTRING_SIZE, "***Error: %s: ",
-            bcnumErrMsg[bcnumError]);
-#else
-  sprintf (bcnum_outstr, "***Error: %s: ", bcnumErrMsg[bcnumError]);
-#endif
+  if (bc_ctx->out == NULL || bc_ctx->out_size == 0)
+    return;
+  (int)snprintf (bc_ctx->out, bc_ctx->out_size, "***Error: %s: ",
+            bcnumErrMsg[bc_ctx->error]);
   va_start (args, mesg);
-  len = strlen (bcnum_outstr);
-#ifdef HAVE_SNPRINTF
-  (int)vsnprintf (bcnum_outstr + len, BCNUM_OUTSTRING_SIZE - 10, mesg, args);
-#else
-  sprintf (bcnum_outstr + len, mesg, args);
-#endif
+  len = strlen (bc_ctx->out);
+  (int)vsnprintf (bc_ctx->out + len, bc_ctx->out_size - len, mesg, args);
   va_end (args);
 }
 
@@ -2044,328 +3012,1013 @@ void rt_warn (char *mesg, ...)
   size_t len;
   va_list args;
 
-#ifdef HAVE_SNPRINTF
-  (int)snprintf (bcnum_outstr, BCNUM_OUTSTRING_SIZE, "***Warning: %s: ",
-            bcnumErrMsg[bcnumError]);
-#else
-  sprintf (bcnum_outstr, "***Warning: %s: ", bcnumErrMsg[bcnumError]);
-#endif
+  if (bc_ctx->out == NULL || bc_ctx->out_size == 0)
+    return;
+  (int)snprintf (bc_ctx->out, bc_ctx->out_size, "***Warning: %s: ",
+            bcnumErrMsg[bc_ctx->error]);
   va_start (args, mesg);
-  len = strlen (bcnum_outstr);
-#ifdef HAVE_SNPRINTF
-  (int)vsnprintf (bcnum_outstr + len, BCNUM_OUTSTRING_SIZE - 12, mesg, args);
-#else
-  vsprintf (bcnum_outstr + len, mesg, args);
-#endif
+  len = strlen (bc_ctx->out);
+  (int)vsnprintf (bc_ctx->out + len, bc_ctx->out_size - len, mesg, args);
   va_end (args);
 }
 
 void out_of_memory (void)
 {
-  bcnumError = BCNUM_MEMORY;
+  bc_ctx->error = BCNUM_MEMORY;
 }
 
 /*
- * High level functions.
+ * Contexts.
  */
-void bcnum_init (void)
+
+/* Make CTX the context of this thread's bc_* calls, writing results into
+   OUT, and return the context it replaces. */
+static bcnum_ctx *bc_enter (bcnum_ctx *ctx, char *out, size_t len)
 {
-  bc_init_numbers ();
-  bcnum_is_init = 1;
-  (int)atexit (my_atexit);
-  bcnum_is_atexit = 1;
+  bcnum_ctx *saved = bc_ctx;
+
+  bc_ctx = ctx;
+  ctx->error = BCNUM_NOERROR;
+  ctx->out = out;
+  ctx->out_size = len;
+  ctx->out_ptr = 0;
+  if (out != NULL && len > 0)
+    out[0] = '\0';
+  return saved;
 }
 
-char *bcnum_add (char *n1, char *n2, int scale)
+/* Go back to the SAVED context.  Returns -1 if CTX had an error. */
+static int bc_leave (bcnum_ctx *ctx, bcnum_ctx *saved)
 {
-  bc_num num1, num2, sum;
-
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  num2 = bc_copy_num (_zero_);
-  sum = bc_copy_num (_zero_);
+  bc_ctx = saved;
+  ctx->out = NULL;
+  ctx->out_size = 0;
+  return ctx->error == BCNUM_NOERROR ? 0 : -1;
+}
 
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
+int bcnum_ctx_init (bcnum_ctx *ctx)
+{
+  bcnum_ctx *saved;
 
-  bc_add (num1, num2, &sum, scale);
-  pn_str (sum);
+  memset (ctx, 0, sizeof (bcnum_ctx));
+  saved = bc_enter (ctx, NULL, 0);
+  bc_init_numbers ();
+  return bc_leave (ctx, saved);
+}
 
-  bc_free_num (&num1);
-  bc_free_num (&num2);
-  bc_free_num (&sum);
+void bcnum_ctx_uninit (bcnum_ctx *ctx)
+{
+  bc_num *cnst[3];
+  bc_num temp;
+  char *ptr;
+  int i;
 
-  if (bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+  cnst[0] = &ctx->zero;
+  cnst[1] = &ctx->one;
+  cnst[2] = &ctx->two;
+  for (i = 0; i < 3; i++) {
+    if (*cnst[i] == NULL)
+      continue;
+    if ((*cnst[i])->n_ptr)
+      free ((*cnst[i])->n_ptr);
+    free (*cnst[i]);
+    *cnst[i] = NULL;
+  }
+  while (ctx->free_list != NULL) {
+    temp = ctx->free_list;
+    ctx->free_list = temp->n_next;
+    free (temp);
+  }
+  for (i = 0; i < BC_POOL_CLASSES; i++)
+    while (ctx->pool[i] != NULL) {
+      ptr = ctx->pool[i];
+      memcpy (&ctx->pool[i], ptr, sizeof (char *));
+      free (ptr);
+    }
 }
 
-char *bcnum_sub (char *n1, char *n2, int scale)
+/* The operations bc_binary() knows. */
+typedef enum {BC_ADD, BC_SUB, BC_MUL, BC_DIV, BC_MOD, BC_RAISE} bc_op;
+
+/* Parse N1 and N2, apply OP at SCALE and write the result into OUT. */
+static int bc_binary (bcnum_ctx *ctx, bc_op op, const char *n1, const char *n2,
+                      int scale, char *out, size_t len)
 {
-  bc_num num1, num2, sum;
+  bcnum_ctx *saved;
+  bc_num num1, num2, res;
+  int status = 0;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
+  saved = bc_enter (ctx, out, len);
   num1 = bc_copy_num (_zero_);
   num2 = bc_copy_num (_zero_);
-  sum = bc_copy_num (_zero_);
-
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
-
-  bc_sub (num1, num2, &sum, scale);
-  pn_str (sum);
+  res = bc_copy_num (_zero_);
+
+  bc_str2num (&num1, (char *)n1, scale);
+  bc_str2num (&num2, (char *)n2, scale);
+
+  switch (op) {
+    case BC_ADD:
+      bc_add (num1, num2, &res, scale);
+      break;
+    case BC_SUB:
+      bc_sub (num1, num2, &res, scale);
+      break;
+    case BC_MUL:
+      bc_multiply (num1, num2, &res, scale);
+      break;
+    case BC_DIV:
+      status = bc_divide (num1, num2, &res, scale);
+      break;
+    case BC_MOD:
+      status = bc_modulo (num1, num2, &res, scale);
+      break;
+    case BC_RAISE:
+      bc_raise (num1, num2, &res, scale);
+      break;
+  }
+  pn_str (res);
 
   bc_free_num (&num1);
   bc_free_num (&num2);
-  bc_free_num (&sum);
+  bc_free_num (&res);
 
-  if (bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+  if (status == -1 && ctx->error == BCNUM_NOERROR)
+    ctx->error = BCNUM_DIVZERO;
+  return bc_leave (ctx, saved);
 }
 
-int bcnum_compare (char *n1, char *n2, int scale)
+int bcnum_ctx_add (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
 {
-  int status;
-  bc_num num1, num2;
+  return bc_binary (ctx, BC_ADD, n1, n2, scale, out, len);
+}
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  num2 = bc_copy_num (_zero_);
+int bcnum_ctx_sub (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
+{
+  return bc_binary (ctx, BC_SUB, n1, n2, scale, out, len);
+}
 
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
+int bcnum_ctx_multiply (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
+{
+  return bc_binary (ctx, BC_MUL, n1, n2, scale, out, len);
+}
 
-  status = bc_compare (num1, num2);
+int bcnum_ctx_divide (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
+{
+  return bc_binary (ctx, BC_DIV, n1, n2, scale, out, len);
+}
 
-  bc_free_num (&num1);
-  bc_free_num (&num2);
+int bcnum_ctx_modulo (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
+{
+  return bc_binary (ctx, BC_MOD, n1, n2, scale, out, len);
+}
 
-  if (status == -1)
-    return -2;
-  return status;
+int bcnum_ctx_raise (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len)
+{
+  return bc_binary (ctx, BC_RAISE, n1, n2, scale, out, len);
 }
 
-char *bcnum_multiply (char *n1, char *n2, int scale)
+int bcnum_ctx_sqrt (bcnum_ctx *ctx, const char *n1, int scale, char *out, size_t len)
 {
-  bc_num num1, num2, prod;
+  bcnum_ctx *saved;
+  bc_num sqrt;
+  int status;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  num2 = bc_copy_num (_zero_);
-  prod = bc_copy_num (_zero_);
+  saved = bc_enter (ctx, out, len);
+  sqrt = bc_copy_num (_zero_);
 
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
+  bc_str2num (&sqrt, (char *)n1, scale);
 
-  bc_multiply (num1, num2, &prod, scale);
-  pn_str (prod);
+  status = bc_sqrt (&sqrt, scale);
+  pn_str (sqrt);
 
-  bc_free_num (&num1);
-  bc_free_num (&num2);
-  bc_free_num (&prod);
+  bc_free_num (&sqrt);
 
-  if (bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+  if (status == -1 && ctx->error == BCNUM_NOERROR)
+    ctx->error = BCNUM_UNSPECIFIED;
+  return bc_leave (ctx, saved);
 }
 
-char *bcnum_divide (char *n1, char *n2, int scale)
+/* Returns -1, 0 or 1 as N1 is less than, equal to or greater than N2. */
+int bcnum_ctx_compare (bcnum_ctx *ctx, const char *n1, const char *n2, int scale)
 {
-  bc_num num1, num2, div;
+  bcnum_ctx *saved;
   int status;
+  bc_num num1, num2;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
+  saved = bc_enter (ctx, NULL, 0);
   num1 = bc_copy_num (_zero_);
   num2 = bc_copy_num (_zero_);
-  div = bc_copy_num (_zero_);
 
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
+  bc_str2num (&num1, (char *)n1, scale);
+  bc_str2num (&num2, (char *)n2, scale);
 
-  status = bc_divide (num1, num2, &div, scale);
-  pn_str (div);
+  status = bc_compare (num1, num2);
 
   bc_free_num (&num1);
   bc_free_num (&num2);
-  bc_free_num (&div);
-
-  if (status == -1 || bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+  (int)bc_leave (ctx, saved);
+  return status;
 }
 
-char *bcnum_modulo (char *n1, char *n2, int scale)
+/* The tests on one number.  WHICH is 0 for zero, 1 for near zero, 2 for negative. */
+static int bc_test (bcnum_ctx *ctx, int which, const char *n1, int scale)
 {
-  bc_num num1, num2, mod;
+  bcnum_ctx *saved;
   int status;
+  bc_num num1;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
+  saved = bc_enter (ctx, NULL, 0);
   num1 = bc_copy_num (_zero_);
-  num2 = bc_copy_num (_zero_);
-  mod = bc_copy_num (_zero_);
-
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
-
-  status = bc_modulo (num1, num2, &mod, scale);
-  pn_str (mod);
-
+  bc_str2num (&num1, (char *)n1, scale);
+  if (which == 0)
+    status = (int)bc_is_zero (num1);
+  else if (which == 1)
+    status = (int)bc_is_near_zero (num1, scale);
+  else
+    status = (int)bc_is_neg (num1);
   bc_free_num (&num1);
-  bc_free_num (&num2);
-  bc_free_num (&mod);
+  (int)bc_leave (ctx, saved);
+  return status;
+}
 
-  if (status == -1 || bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+int bcnum_ctx_iszero (bcnum_ctx *ctx, const char *n1)
+{
+  return bc_test (ctx, 0, n1, 0);
 }
 
-char *bcnum_raise (char *n1, char *n2, int scale)
+int bcnum_ctx_isnearzero (bcnum_ctx *ctx, const char *n1, int scale)
 {
-  bc_num num1, num2, npow;
+  return bc_test (ctx, 1, n1, scale);
+}
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
-  }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  num2 = bc_copy_num (_zero_);
-  npow = bc_copy_num (_zero_);
+int bcnum_ctx_isneg (bcnum_ctx *ctx, const char *n1)
+{
+  return bc_test (ctx, 2, n1, 0);
+}
 
-  bc_str2num (&num1, n1, scale);
-  bc_str2num (&num2, n2, scale);
+/*
+ * Accumulators.
+ */
 
-  bc_raise (num1, num2, &npow, scale);
-  pn_str (npow);
+/* Start ACC at zero in CTX, or in the default context if CTX is NULL.
+   Values are truncated to SCALE places as they are added. */
+int bcnum_acc_init (bcnum_acc *acc, bcnum_ctx *ctx, int scale)
+{
+  bcnum_ctx *saved;
 
-  bc_free_num (&num1);
-  bc_free_num (&num2);
-  bc_free_num (&npow);
+  if (ctx == NULL) {
+    if (bcnum_is_init == 0)
+      bcnum_init ();
+    ctx = &bc_default;
+  }
+  acc->ctx = ctx;
+  acc->scale = scale;
+  saved = bc_enter (ctx, NULL, 0);
+  acc->sum = bc_copy_num (_zero_);
+  return bc_leave (ctx, saved);
+}
 
-  if (bcnumError != BCNUM_NOERROR)
-    return 0;
-  return bcnum_outstr;
+/* Add NUM to ACC's sum, in ACC's context. */
+static void bc_acc_add_num (bcnum_acc *acc, bc_num num)
+{
+  bc_add (acc->sum, num, &acc->sum, acc->scale);
 }
 
-char *bcnum_sqrt (char *n1, int scale)
+int bcnum_acc_add_str (bcnum_acc *acc, const char *str)
 {
-  bc_num sqrt;
-  int status;
+  bcnum_ctx *saved;
+  bc_num num;
+
+  saved = bc_enter (acc->ctx, NULL, 0);
+  num = bc_copy_num (_zero_);
+  bc_str2num (&num, (char *)str, acc->scale);
+  bc_acc_add_num (acc, num);
+  bc_free_num (&num);
+  return bc_leave (acc->ctx, saved);
+}
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
+/* Add VAL / 10^SCALE, e.g. a count of cents with SCALE 2. */
+int bcnum_acc_add_fixed (bcnum_acc *acc, long long val, int scale)
+{
+  char buf[48];
+  unsigned long long mag;
+  int len, neg = (val < 0);
+
+  mag = neg ? (unsigned long long)(-(val + 1)) + 1 : (unsigned long long)val;
+  len = snprintf (buf + 1, sizeof (buf) - 2, "%0*llu", scale + 1, mag);
+  if (scale < 0 || len < 0 || len + 2 >= (int)sizeof (buf)) {
+    acc->ctx->error = BCNUM_UNSPECIFIED;
+    return -1;
   }
-  bcnum_outstr_ptr = 0;
-  sqrt = bc_copy_num (_zero_);
+  /* -123 with scale 2 is "-1.23" */
+  buf[0] = neg ? '-' : '+';
+  if (scale > 0) {
+    memmove (buf + len - scale + 2, buf + len - scale + 1, (size_t)scale + 1);
+    buf[len - scale + 1] = '.';
+  }
+  return bcnum_acc_add_str (acc, buf);
+}
 
-  bc_str2num (&sqrt, n1, scale);
+/* Add the sum in N, which may live in another context. */
+int bcnum_acc_add (bcnum_acc *acc, const bcnum_acc *n)
+{
+  bcnum_ctx *saved;
 
-  status = bc_sqrt (&sqrt, scale);
-  pn_str (sqrt);
+  saved = bc_enter (acc->ctx, NULL, 0);
+  bc_acc_add_num (acc, n->sum);
+  return bc_leave (acc->ctx, saved);
+}
 
-  bc_free_num (&sqrt);
+/* Format the sum into BUF, or return 0 if it doesn't fit. */
+char *bcnum_acc_str (bcnum_acc *acc, char *buf, size_t len)
+{
+  bcnum_ctx *saved;
 
-  if (status == -1 || bcnumError != BCNUM_NOERROR)
+  saved = bc_enter (acc->ctx, buf, len);
+  pn_str (acc->sum);
+  if (bc_leave (acc->ctx, saved) != 0)
     return 0;
-  return bcnum_outstr;
+  return buf;
 }
 
-int bcnum_iszero (char *n1)
+void bcnum_acc_free (bcnum_acc *acc)
 {
-  int status;
-  bc_num num1;
+  bcnum_ctx *saved;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
+  saved = bc_enter (acc->ctx, NULL, 0);
+  bc_free_num (&acc->sum);
+  (int)bc_leave (acc->ctx, saved);
+}
+
+/*
+ * Batch sums.
+ *
+ * A value's digits go into base 10^9 columns lined up on the sum's scale,
+ * the fraction truncated to it as bc_str2num() would.  Each column takes
+ * a signed 64 bit total; a value adds less than 10^9 to any one column, so
+ * 2^30 values can go in before the carries have to be moved up.
+ */
+#define BC_SUM_BASE 1000000000LL
+#define BC_SUM_PENDING (1 << 30)
+
+/* The value of the N (at most 9) digit characters at P. */
+static unsigned int bc_digits_value (const char *p, int n)
+{
+  unsigned int v = 0;
+
+#ifdef BC_SWAR
+  if (n == 9) {
+    v = (unsigned int) CH_VAL (*p++) * 100000000u;
+    n--;
   }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  bc_str2num (&num1, n1, 0);
-  status = (int)bc_is_zero (num1);
-  bc_free_num (&num1);
-  return status;
+  if (n == 8)
+    v += (unsigned int) bc_parse8 (bc_load8 (p, 8));
+  else if (n > 0)
+    v += (unsigned int) bc_parse8 ((bc_load8 (p, (size_t) n) << ((8 - n) * 8))
+                                   | ((0x30 * BC_ONES) >> (n * 8)));
+#else
+  while (n-- > 0)
+    v = v * 10 + (unsigned int) CH_VAL (*p++);
+#endif
+  return v;
 }
 
-int bcnum_isnearzero (char *n1, int scale)
+/* Make room for NCOLS columns in S, the new ones zero. */
+static int bc_sum_reserve (bcnum_sum *s, int ncols)
 {
-  int status;
-  bc_num num1;
+  long long *col;
+  int size;
+
+  if (ncols > s->size) {
+    size = MAX (ncols, MAX (4, 2 * s->size));
+    col = realloc (s->col, (size_t) size * sizeof (long long));
+    if (col == NULL) {
+      s->error = BCNUM_MEMORY;
+      return -1;
+    }
+    memset (col + s->size, 0, (size_t) (size - s->size) * sizeof (long long));
+    s->col = col;
+    s->size = size;
+  }
+  s->ncols = MAX (s->ncols, ncols);
+  return 0;
+}
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
+/* Carry the N columns at COL up so each is 0..10^9-1; returns the carry
+   out of the top. */
+static long long bc_sum_carry (long long *col, int n)
+{
+  long long c, carry = 0;
+  int k;
+
+  for (k = 0; k < n; k++) {
+    c = col[k] + carry;
+    carry = c / BC_SUM_BASE;
+    c %= BC_SUM_BASE;
+    if (c < 0) {
+      c += BC_SUM_BASE;
+      carry--;
+    }
+    col[k] = c;
   }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  bc_str2num (&num1, n1, scale);
-  status = (int)bc_is_near_zero (num1, scale);
-  bc_free_num (&num1);
-  return status;
+  return carry;
 }
 
-int bcnum_isneg (char *n1)
+/* Normalize S's carries.  A negative sum keeps its sign in the top column. */
+static int bc_sum_normalize (bcnum_sum *s)
 {
-  int status;
-  bc_num num1;
+  long long carry;
 
-  if (bcnum_is_init == 0) {
-    bcnum_init ();
+  carry = bc_sum_carry (s->col, s->ncols);
+  while (carry != 0 && carry != -1) {
+    if (bc_sum_reserve (s, s->ncols + 1) != 0)
+      return -1;
+    s->col[s->ncols - 1] = carry;
+    carry = bc_sum_carry (s->col + s->ncols - 1, 1);
   }
-  bcnum_outstr_ptr = 0;
-  num1 = bc_copy_num (_zero_);
-  bc_str2num (&num1, n1, 0);
-  status = (int)bc_is_neg (num1);
-  bc_free_num (&num1);
-  return status;
+  if (carry == -1)
+    s->col[s->ncols - 1] -= BC_SUM_BASE;
+  s->pending = 0;
+  return 0;
 }
 
-void bcnum_uninit (void)
+/* Add (with NEG, subtract) the N digits at P, the last of them SHIFT
+   places above the last digit of the sum. */
+static void bc_sum_span (bcnum_sum *s, const char *p, int n, int shift, int neg)
 {
-  if (bcnum_is_init == 1) {
-    if (_zero_->n_ptr)
-      free (_zero_->n_ptr);
-    free (_zero_);
-    _zero_ = 0;
-    if (_one_->n_ptr)
-      free (_one_->n_ptr);
-    free (_one_);
-    _one_ = 0;
-    if (_two_->n_ptr)
-      free (_two_->n_ptr);
-    free (_two_);
-    _two_ = 0;
-    bcnum_is_init = 0;
+  static const long long pow10[9] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000
+  };
+  long long v;
+  int take;
+
+  while (n > 0) {
+    take = MIN (n, 9 - shift % 9);
+    v = (long long) bc_digits_value (p + n - take, take) * pow10[shift % 9];
+    s->col[shift / 9] += neg ? -v : v;
+    n -= take;
+    shift += take;
   }
 }
 
-#ifdef TEST_BCNUM
+void bcnum_sum_init (bcnum_sum *s, int scale)
+{
+  s->col = NULL;
+  s->ncols = 0;
+  s->size = 0;
+  s->scale = MAX (scale, 0);
+  s->pending = 0;
+  s->error = BCNUM_NOERROR;
+}
 
-char *invals[] = {
-  "20000.00",
-  "-1847.20",                          /* 18152.80 */
-  "-911.00",                           /* 17241.80 */
-  "-335.48",                           /* 16906.32 */
-  "-2238.67",                          /* 14667.65 */
-  "-10897.60",                         /* 3770.05 */
-  0
-};
+/* Add STR to S.  Like bc_str2num(), a malformed STR counts as zero. */
+int bcnum_sum_add (bcnum_sum *s, const char *str)
+{
+  const char *ptr = str, *end = str + strlen (str), *ip, *fp;
+  int neg = 0, ni, nf;
+
+  if ((*ptr == '+') || (*ptr == '-'))
+    neg = (*ptr++ == '-');
+  while (*ptr == '0')
+    ptr++;
+  ip = ptr;
+  ni = bc_digit_run (ptr, end);
+  ptr += ni;
+  if (*ptr == '.')
+    ptr++;
+  fp = ptr;
+  nf = bc_digit_run (ptr, end);
+  ptr += nf;
+  if (*ptr != '\0')
+    return 0;
+  nf = MIN (nf, s->scale);
+
+  if (s->pending >= BC_SUM_PENDING && bc_sum_normalize (s) != 0)
+    return -1;
+  if (bc_sum_reserve (s, (s->scale + ni) / 9 + 1) != 0)
+    return -1;
+  bc_sum_span (s, ip, ni, s->scale, neg);
+  bc_sum_span (s, fp, nf, s->scale - nf, neg);
+  s->pending++;
+  return 0;
+}
+
+/* Format the total into BUF, or return 0 if it doesn't fit.  S can go on
+   taking values afterwards. */
+char *bcnum_sum_str (bcnum_sum *s, char *buf, size_t len)
+{
+  long long *mag;
+  char *digits, *d;
+  size_t need;
+  int k, j, n, neg, intd;
+
+  if (bc_sum_normalize (s) != 0)
+    return 0;
+  for (n = s->ncols; n > 0 && s->col[n - 1] == 0; n--)
+    ;
+  if (n == 0) {
+    if (len < 2) {
+      s->error = BCNUM_TOOSMALL;
+      if (len > 0)
+        buf[0] = '\0';
+      return 0;
+    }
+    strcpy (buf, "0");
+    return buf;
+  }
+
+  /* the magnitude's digits, right aligned, then past the leading zeros */
+  neg = (s->col[n - 1] < 0);
+  mag = malloc ((size_t) n * sizeof (long long));
+  digits = malloc ((size_t) n * 9 + 1);
+  if (mag == NULL || digits == NULL) {
+    free (mag);
+    free (digits);
+    s->error = BCNUM_MEMORY;
+    return 0;
+  }
+  for (k = 0; k < n; k++)
+    mag[k] = neg ? -s->col[k] : s->col[k];
+  (void) bc_sum_carry (mag, n);
+  d = digits + n * 9;
+  *d = '\0';
+  for (k = 0; k < n; k++)
+    for (j = 0; j < 9; j++, mag[k] /= 10)
+      *--d = (char) BCD_CHAR (mag[k] % 10);
+  free (mag);
+  while (*d == '0')
+    d++;
+
+  /* bc leaves out a zero integer part */
+  n = (int) strlen (d);
+  intd = MAX (n - s->scale, 0);
+  need = (size_t) neg + (size_t) intd + (s->scale > 0 ? 1 + (size_t) s->scale : 0);
+  if (need >= len) {
+    free (digits);
+    s->error = BCNUM_TOOSMALL;
+    if (len > 0)
+      buf[0] = '\0';
+    return 0;
+  }
+  k = 0;
+  if (neg)
+    buf[k++] = '-';
+  memcpy (buf + k, d, (size_t) intd);
+  k += intd;
+  if (s->scale > 0) {
+    buf[k++] = '.';
+    for (j = n - intd; j < s->scale; j++)
+      buf[k++] = '0';
+    memcpy (buf + k, d + intd, (size_t) (n - intd));
+    k += n - intd;
+  }
+  buf[k] = '\0';
+  free (digits);
+  return buf;
+}
+
+void bcnum_sum_free (bcnum_sum *s)
+{
+  free (s->col);
+  s->col = NULL;
+  s->ncols = 0;
+  s->size = 0;
+  s->pending = 0;
+}
+
+/*
+ * High level functions.
+ *
+ * These are the original interface: they run in the default context, the
+ * result is in bcnum_outstr until the next call, and an error sticks in
+ * bcnumError.
+ */
+void bcnum_init (void)
+{
+  (int)bcnum_ctx_init (&bc_default);
+  bcnum_is_init = 1;
+  (int)atexit (my_atexit);
+  bcnum_is_atexit = 1;
+}
+
+/* Finish a call in the default context that returned STATUS. */
+static char *bcnum_result (int status)
+{
+  bcnum_outstr_ptr = (int)bc_default.out_ptr;
+  /* bc never flagged a division by zero; the call just failed */
+  if (status != 0 && bc_default.error != BCNUM_DIVZERO)
+    bcnumError = bc_default.error;
+  if (status != 0 || bcnumError != BCNUM_NOERROR)
+    return 0;
+  return bcnum_outstr;
+}
+
+char *bcnum_add (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_add (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+char *bcnum_sub (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_sub (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+int bcnum_compare (char *n1, char *n2, int scale)
+{
+  int status;
+
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  status = bcnum_ctx_compare (&bc_default, n1, n2, scale);
+  if (status == -1)
+    return -2;
+  return status;
+}
+
+char *bcnum_multiply (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_multiply (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+char *bcnum_divide (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_divide (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+char *bcnum_modulo (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_modulo (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+char *bcnum_raise (char *n1, char *n2, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_raise (&bc_default, n1, n2, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+char *bcnum_sqrt (char *n1, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_result (bcnum_ctx_sqrt (&bc_default, n1, scale, bcnum_outstr, BCNUM_OUTSTRING_SIZE));
+}
+
+int bcnum_iszero (char *n1)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_ctx_iszero (&bc_default, n1);
+}
+
+int bcnum_isnearzero (char *n1, int scale)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_ctx_isnearzero (&bc_default, n1, scale);
+}
+
+int bcnum_isneg (char *n1)
+{
+  if (bcnum_is_init == 0)
+    bcnum_init ();
+  return bcnum_ctx_isneg (&bc_default, n1);
+}
+
+/* The sum of the N values in VALS, as bcnum_add() would have added them up. */
+char *bcnum_sum_many (const char **vals, size_t n, int scale)
+{
+  bcnum_sum s;
+  char *ret = 0;
+  size_t i;
+
+  bcnum_sum_init (&s, scale);
+  for (i = 0; i < n; i++)
+    if (bcnum_sum_add (&s, vals[i]) != 0)
+      break;
+  if (i == n)
+    ret = bcnum_sum_str (&s, bcnum_outstr, BCNUM_OUTSTRING_SIZE + 1);
+  if (ret == 0)
+    bcnumError = s.error;
+  bcnum_outstr_ptr = ret == 0 ? 0 : (int)strlen (bcnum_outstr);
+  bcnum_sum_free (&s);
+  return ret;
+}
+
+void bcnum_uninit (void)
+{
+  if (bcnum_is_init == 1) {
+    bcnum_ctx_uninit (&bc_default);
+    bcnum_is_init = 0;
+  }
+}
+
+/*
+ * Fixed-point money functions.
+ *
+ * These keep amounts as a count of cents so a long run of additions never
+ * touches the bc_num engine.  The rules follow bc_str2num() and bc_out_num()
+ * exactly: input is truncated to two places, a malformed string is zero, and
+ * the output is what bcnum_add(..., 2) would have produced for the same sum.
+ * When a sum no longer fits in 64 bits, the value is carried as a bc string.
+ */
+
+/* The largest whole number of dollars that still fits with its cents. */
+#define BCM_MAXINT ((unsigned long long)(LLONG_MAX - 99) / 100)
+
+/* Parse STR the way bc_str2num() does.  Returns 1 if the value doesn't fit. */
+static int bcm_parse (const char *str, long long *cents, int *neg)
+{
+  const char *ptr = str, *end = str + strlen (str);
+  unsigned long long mag = 0;
+  int digits, strscale, over = 0;
+  int d, i;
+#ifdef BC_SWAR
+  unsigned long long x;
+#endif
+
+  *cents = 0;
+  *neg = 0;
+  if ((*ptr == '+') || (*ptr == '-'))
+    *neg = (*ptr++ == '-');
+  digits = bc_digit_run (ptr, end);
+#ifdef BC_SWAR
+  if (digits <= 16) {
+    /* eight digits at a time; sixteen can't overflow */
+    i = digits % 8;
+    if (i > 0) {
+      /* the first i digits, moved to the end and led by '0's */
+      x = bc_load8 (ptr, (size_t) i) << ((8 - i) * 8);
+      mag = bc_parse8 (x | ((0x30 * BC_ONES) >> (i * 8)));
+    }
+    for (; i < digits; i += 8) {
+      memcpy (&x, ptr + i, 8);
+      mag = mag * 100000000 + bc_parse8 (x);
+    }
+  }
+  else
+#endif
+  for (i = 0; i < digits; i++) {
+    d = CH_VAL (ptr[i]);
+    if (mag > (BCM_MAXINT - (unsigned long long)d) / 10)
+      over = 1;
+    else
+      mag = mag * 10 + (unsigned long long)d;
+  }
+  ptr += digits;
+  if (*ptr == '.')
+    ptr++;
+  mag *= 100;
+  strscale = bc_digit_run (ptr, end);
+  if (strscale > 0)
+    mag += (unsigned long long)CH_VAL (ptr[0]) * 10;
+  if (strscale > 1)
+    mag += (unsigned long long)CH_VAL (ptr[1]);
+  ptr += strscale;
+  if ((*ptr != '\0') || (digits + strscale == 0)) {
+    /* bc treats this as a (positive) zero */
+    *neg = 0;
+    return 0;
+  }
+  if (over)
+    return 1;
+  *cents = *neg ? -(long long)mag : (long long)mag;
+  return 0;
+}
+
+/* Format CENTS the way bc_out_num() prints a scale 2 number. */
+static char *bcm_format (long long cents, int negzero, char *buf, size_t len)
+{
+  unsigned long long mag, dollars;
+  char tmp[32], *p = tmp + sizeof (tmp);
+  size_t n;
+  int c;
+#ifdef BC_SWAR
+  unsigned long long x;
+#endif
+
+  if (cents < 0)
+    mag = (unsigned long long)(-(cents + 1)) + 1;
+  else
+    mag = (unsigned long long)cents;
+
+  /* right to left into tmp */
+  if (mag == 0)
+    *--p = '0';
+  else {
+    c = (int)(mag % 100);
+    *--p = (char) BCD_CHAR (c % 10);
+    *--p = (char) BCD_CHAR (c / 10);
+    *--p = '.';
+    dollars = mag / 100;
+#ifdef BC_SWAR
+    if (dollars > 0) {
+      for (; dollars >= 100000000; dollars /= 100000000) {
+        x = bc_format8 ((unsigned)(dollars % 100000000));
+        p -= 8;
+        memcpy (p, &x, 8);
+      }
+      x = bc_format8 ((unsigned)dollars);
+      p -= 8;
+      memcpy (p, &x, 8);
+      while (*p == '0')
+        p++;
+    }
+#else
+    for (; dollars > 0; dollars /= 10)
+      *--p = (char) BCD_CHAR (dollars % 10);
+#endif
+  }
+  if (cents < 0 || (mag == 0 && negzero))
+    *--p = '-';
+
+  n = (size_t)(tmp + sizeof (tmp) - p);
+  if (n >= len) {
+    if (len > 0)
+      buf[0] = '\0';
+    bcnumError = BCNUM_TOOSMALL;
+    return 0;
+  }
+  memcpy (buf, p, n);
+  buf[n] = '\0';
+  return buf;
+}
+
+/* Note a failure in M's accumulator the way the rest of bcmoney does. */
+static int bcm_error (const bcmoney *m)
+{
+  bcnumError = m->big->ctx->error;
+  return -1;
+}
+
+/* Switch M over to a bc accumulator that starts out holding its value. */
+static int bcm_promote (bcmoney *m)
+{
+  char buf[32];
+  bcnum_acc *acc;
+
+  acc = malloc (sizeof (bcnum_acc));
+  if (acc == 0) {
+    bcnumError = BCNUM_MEMORY;
+    return -1;
+  }
+  if (bcnum_acc_init (acc, NULL, 2) != 0
+      || (bcm_format (m->cents, m->negzero, buf, sizeof (buf)) != 0 && bcnum_acc_add_str (acc, buf) != 0)) {
+    bcnumError = acc->ctx->error;
+    free (acc);
+    return -1;
+  }
+  m->big = acc;
+  m->cents = 0;
+  m->negzero = 0;
+  return 0;
+}
+
+/* Add two values with bc, at least one of which is (or will be) too big. */
+static int bcm_add_big (bcmoney *m, const bcmoney *n)
+{
+  char buf[32];
+
+  if (m->big == 0 && bcm_promote (m))
+    return -1;
+  if (n->big) {
+    if (bcnum_acc_add (m->big, n->big))
+      return bcm_error (m);
+    return 0;
+  }
+  if (bcm_format (n->cents, n->negzero, buf, sizeof (buf)) == 0)
+    return -1;
+  if (bcnum_acc_add_str (m->big, buf))
+    return bcm_error (m);
+  return 0;
+}
+
+int bcmoney_cents (const char *str, long long *cents)
+{
+  int neg;
+
+  if (bcm_parse (str, cents, &neg))
+    return -1;
+  return 0;
+}
+
+char *bcmoney_fmt (long long cents, char *buf, size_t len)
+{
+  return bcm_format (cents, 0, buf, len);
+}
+
+/* Returns -1, and leaves M at 0, if a value too large for cents can't be
+   carried by bc either. */
+int bcmoney_set (bcmoney *m, const char *str)
+{
+  long long cents;
+  int neg;
+  int ret;
+
+  bcmoney_free (m);
+  if (bcm_parse (str, &cents, &neg)) {
+    /* let bc carry it, so it prints the same as a bc sum would */
+    if (bcm_promote (m))
+      return -1;
+    if (bcnum_acc_add_str (m->big, str) == 0)
+      return 0;
+    ret = bcm_error (m);
+    bcmoney_free (m);
+    return ret;
+  }
+  m->cents = cents;
+  m->negzero = (neg && cents == 0);
+  return 0;
+}
+
+int bcmoney_add (bcmoney *m, const bcmoney *n)
+{
+#ifdef __SIZEOF_INT128__
+  __int128 sum;
+#endif
+
+  if (m->big || n->big)
+    return bcm_add_big (m, n);
+#ifdef __SIZEOF_INT128__
+  sum = (__int128)m->cents + n->cents;
+  if (sum > LLONG_MAX || sum < -LLONG_MAX)
+    return bcm_add_big (m, n);
+#else
+  if ((n->cents > 0 && m->cents > LLONG_MAX - n->cents)
+      || (n->cents < 0 && m->cents < -LLONG_MAX - n->cents))
+    return bcm_add_big (m, n);
+#endif
+  /* bc keeps the sign only when adding zeros that are both negative */
+  m->negzero = (m->cents == 0 && n->cents == 0 && m->negzero && n->negzero);
+  m->cents += n->cents;
+  return 0;
+}
+
+int bcmoney_add_str (bcmoney *m, const char *str)
+{
+  bcmoney n = BCMONEY_INIT;
+  int ret;
+
+  if (m->big) {
+    /* no need to go through cents; the value is parsed once, straight into the sum */
+    if (bcnum_acc_add_str (m->big, str))
+      return bcm_error (m);
+    return 0;
+  }
+  if (bcmoney_set (&n, str))
+    return -1;
+  ret = bcmoney_add (m, &n);
+  bcmoney_free (&n);
+  return ret;
+}
+
+char *bcmoney_str (const bcmoney *m, char *buf, size_t len)
+{
+  if (m->big) {
+    if (bcnum_acc_str (m->big, buf, len) == 0) {
+      (void)bcm_error (m);
+      return 0;
+    }
+    return buf;
+  }
+  return bcm_format (m->cents, m->negzero, buf, len);
+}
+
+void bcmoney_free (bcmoney *m)
+{
+  if (m->big) {
+    bcnum_acc_free (m->big);
+    free (m->big);
+  }
+  m->big = 0;
+  m->cents = 0;
+  m->negzero = 0;
+}
+
+#ifdef TEST_BCNUM
+
+#include <pthread.h>
+#include <time.h>
+
+char *invals[] = {
+  "20000.00",
+  "-1847.20",                          /* 18152.80 */
+  "-911.00",                           /* 17241.80 */
+  "-335.48",                           /* 16906.32 */
+  "-2238.67",                          /* 14667.65 */
+  "-10897.60",                         /* 3770.05 */
+  0
+};
 
 char *outvals[] = {
   "",
@@ -2377,13 +4030,383 @@ char *outvals[] = {
   0
 };
 
-int main (void)
+/* Running sums that the fixed-point money routines must print exactly as bc does. */
+char *moneyvals[] = {
+  "-0.00",
+  "-0",
+  ".25",
+  "-.5",
+  "0.25",
+  "-0.001",
+  "1.999",
+  "+3.",
+  "garbage",
+  "",
+  "92233720368547758.07",
+  "92233720368547758.07",
+  "-184467440737095516.14",
+  "-12.34",
+  "00042.10",
+  0
+};
+
+/* Check the digit kernels in use against the scalar ones over random
+   operands, with long runs of 9s and 0s so carries ripple a long way. */
+static int check_runs (void)
+{
+  char n1[300], n2[300], r1[300], r2[300];
+  bc_run_fn run;
+  int i, j, k, count, cin, c1, c2;
+
+  (int)bc_add_run_init (r1, n1, n2, 0, 0);
+  for (i = 0; i < 200000; i++) {
+    count = rand () % 260;
+    cin = rand () & 1;
+    for (j = 0; j < count; j++) {
+      n1[j] = (char)(i % 3 ? rand () % 10 : 9 * (rand () % 8 != 0));
+      n2[j] = (char)(i % 3 ? rand () % 10 : (i % 2 ? 0 : 9 - n1[j]));
+    }
+    memset (r1, 77, sizeof (r1));
+    c1 = (i % 2 ? bc_add_run_scalar : bc_sub_run_scalar) (r1 + count, n1 + count - 1, n2 + count - 1, count, cin);
+    for (k = 0; k < 2; k++) {
+      memset (r2, 77, sizeof (r2));
+      if (k == 0)
+        run = i % 2 ? bc_add_run : bc_sub_run;
+      else
+#ifdef BC_HAVE_SIMD
+        run = i % 2 ? bc_add_run_sse2 : bc_sub_run_sse2;
+#else
+        continue;
+#endif
+      c2 = run (r2 + count, n1 + count - 1, n2 + count - 1, count, cin);
+      if (c1 != c2 || memcmp (r1, r2, sizeof (r1)) != 0) {
+        printf ("\n\n***Error: the %s kernel differs from the scalar one on %d digits\n",
+                i % 2 ? "add" : "subtract", count);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/* A random number with up to LEN digits on each side of the point. */
+static void rand_num (char *buf, int len)
 {
+  int i, n;
+
+  *buf++ = rand () % 3 ? '+' : '-';
+  for (i = 0, n = rand () % len; i < n; i++)
+    *buf++ = (char) ('0' + (i == 0 ? 1 + rand () % 9 : rand () % 10));
+  *buf++ = '.';
+  for (i = 0, n = rand () % len; i < n; i++)
+    *buf++ = (char) ('0' + (rand () % 4 ? rand () % 10 : 9));
+  *buf = '\0';
+}
+
+/* Check multiply and divide on limbs against the digit loops, now and
+   then with operands long enough, and thresholds low enough, for the
+   recursive multiply and the Newton division to take over. */
+static int check_limbs (void)
+{
+  static char a[1000], b[1000], r1[4000], r2[4000];
+  bcnum_ctx ctx;
+  int i, scale, s1, s2, big;
+
+  (int)bcnum_ctx_init (&ctx);
+  for (i = 0; i < 100000; i++) {
+    big = (i % 20 == 0);
+    rand_num (a, 1 + rand () % (big ? 400 : 60));
+    rand_num (b, 1 + rand () % (i % 2 || big ? (big ? 300 : 60) : 4));
+    scale = rand () % (big ? 400 : 40);
+    mul_limb_digits = div_limb_digits = INT_MAX;
+    if (i % 2)
+      s1 = bcnum_ctx_multiply (&ctx, a, b, scale, r1, sizeof (r1));
+    else
+      s1 = bcnum_ctx_divide (&ctx, a, b, scale, r1, sizeof (r1));
+    mul_limb_digits = div_limb_digits = 0;
+    mul_karatsuba_limbs = i % 3 ? 32 : 4;
+    div_newton_limbs = i % 3 ? 1024 : 2;
+    if (i % 2)
+      s2 = bcnum_ctx_multiply (&ctx, a, b, scale, r2, sizeof (r2));
+    else
+      s2 = bcnum_ctx_divide (&ctx, a, b, scale, r2, sizeof (r2));
+    if (s1 != s2 || strcmp (r1, r2) != 0) {
+      printf ("\n\n***Error: %s %s %s scale %d: digits gave %s, limbs gave %s\n",
+              a, i % 2 ? "*" : "/", b, scale, r1, r2);
+      return -1;
+    }
+  }
+  mul_limb_digits = div_limb_digits = 10;
+  mul_karatsuba_limbs = 32;
+  div_newton_limbs = 1024;
+  bcnum_ctx_uninit (&ctx);
+  return 0;
+}
+
+/* Check the word-at-a-time conversions: bc_str2num() and pn_str() against
+   the rules they follow and the character loops, and the money parse and
+   format against bc. */
+static int check_conv (void)
+{
+  static const char junk[] = " x/:.+-\200\377";
+  char str[80], want[80], fast[BCNUM_OUTSTRING_SIZE + 1], slow[BCNUM_OUTSTRING_SIZE + 1];
+  char *p, *w, *nptr;
+  const char *ip, *fp;
+  bcmoney m = BCMONEY_INIT;
+  bc_num num;
+  int i, j, ni, nf, scale, bad, neg, nonzero;
+
+  bc_init_num (&num);
+  for (i = 0; i < 200000; i++) {
+    /* sign, leading zeros, up to 25 digits, maybe a point and up to 12 more */
+    p = str;
+    neg = (rand () % 3 == 0);
+    if (neg)
+      *p++ = '-';
+    else if (rand () % 4 == 0)
+      *p++ = '+';
+    for (j = rand () % 4; j > 0; j--)
+      *p++ = '0';
+    ip = p;
+    for (j = 0, ni = rand () % 26; j < ni; j++)
+      *p++ = (char) ('0' + (j == 0 ? 1 + rand () % 9 : rand () % 10));
+    fp = p + 1;
+    nf = 0;
+    if (rand () % 4 != 0) {
+      *p++ = '.';
+      for (j = rand () % 13; j > 0; j--, nf++)
+        *p++ = (char) ('0' + (rand () % 3 ? rand () % 10 : 0));
+    }
+    *p = '\0';
+    bad = (p > str && rand () % 8 == 0);
+    if (bad)
+      str[rand () % (p - str)] = junk[rand () % (sizeof (junk) - 1)];
+    scale = rand () % 8;
+
+    /* what bc makes of it, when it's still well formed */
+    w = want;
+    if (ni + nf == 0)
+      *w++ = '0';
+    else {
+      nonzero = (ni > 0);
+      for (j = 0; j < MIN (nf, scale); j++)
+        nonzero |= (fp[j] != '0');
+      if (neg)
+        *w++ = '-';
+      if (!nonzero)
+        *w++ = '0';
+      else {
+        memcpy (w, ip, (size_t) ni);
+        w += ni;
+        if (MIN (nf, scale) > 0) {
+          *w++ = '.';
+          memcpy (w, fp, (size_t) MIN (nf, scale));
+          w += MIN (nf, scale);
+        }
+      }
+    }
+    *w = '\0';
+
+    bc_str2num (&num, str, scale);
+    bc_ctx->out = fast;
+    bc_ctx->out_size = sizeof (fast);
+    bc_ctx->out_ptr = 0;
+    pn_str (num);
+    bc_ctx->out = slow;
+    bc_ctx->out_ptr = 0;
+    bc_out_num (num, 10, out_char_str, 0);
+    bc_ctx->out = 0;
+    if ((!bad && strcmp (fast, want) != 0) || strcmp (fast, slow) != 0) {
+      printf ("\n\n***Error: \"%s\" scale %d came out %s, not %s\n", str, scale, fast, bad ? slow : want);
+      return -1;
+    }
+
+    /* bc_num2str() has every digit */
+    w = slow;
+    if (num->n_sign == MINUS)
+      *w++ = '-';
+    for (j = 0, nptr = num->n_value; j < num->n_len + num->n_scale; j++) {
+      if (j == num->n_len)
+        *w++ = '.';
+      *w++ = (char) BCD_CHAR (*nptr++);
+    }
+    *w = '\0';
+    p = bc_num2str (num);
+    if (strcmp (p, slow) != 0) {
+      printf ("\n\n***Error: bc_num2str() gave %s, not %s\n", p, slow);
+      return -1;
+    }
+    free (p);
+
+    strcpy (want, bcnum_add ("0", str, 2));
+    if (bcmoney_add_str (&m, str) != 0 || bcmoney_str (&m, fast, sizeof (fast)) == 0
+        || strcmp (want, fast) != 0) {
+      printf ("\n\n***Error: \"%s\": bc gave %s but bcmoney gave %s\n", str, want, fast);
+      return -1;
+    }
+    bcmoney_free (&m);
+  }
+  bc_free_num (&num);
+  return 0;
+}
+
+/* Check batch sums, one shot and streamed, against chained bcnum_add(). */
+static int check_sums (void)
+{
+  static char buf[2000][140];
+  const char *vals[2000];
+  char want[BCNUM_OUTSTRING_SIZE + 1], got[BCNUM_OUTSTRING_SIZE + 1], *r;
+  bcnum_sum sum;
+  int i, j, n, scale;
+
+  for (i = 0; i < 200; i++) {
+    n = rand () % 2000;
+    scale = rand () % 12;
+    bcnum_sum_init (&sum, scale);
+    strcpy (want, "0");
+    for (j = 0; j < n; j++) {
+      rand_num (buf[j], 1 + rand () % (i % 4 ? 12 : 60));
+      if (rand () % 50 == 0)
+        strcat (buf[j], j % 2 ? "x" : "");
+      vals[j] = buf[j];
+      strcpy (want, bcnum_add (want, buf[j], scale));
+      if (bcnum_sum_add (&sum, buf[j]) != 0)
+        return -1;
+      /* reading the total mid-stream normalizes it; keep going after */
+      if (j % 97 == 0 && (bcnum_sum_str (&sum, got, sizeof (got)) == 0 || strcmp (want, got) != 0)) {
+        printf ("\n\n***Error: a streamed sum gave %s, not %s\n", got, want);
+        return -1;
+      }
+    }
+    r = bcnum_sum_many (vals, (size_t) n, scale);
+    if (r == 0 || strcmp (want, r) != 0 || bcnum_sum_str (&sum, got, sizeof (got)) == 0 || strcmp (want, got) != 0) {
+      printf ("\n\n***Error: %d values at scale %d: bc gave %s, bcnum_sum_many() %s, the stream %s\n",
+              n, scale, want, r ? r : "(error)", got);
+      return -1;
+    }
+    bcnum_sum_free (&sum);
+  }
+  return 0;
+}
+
+/* Run the invals through a context of its own; several of these run at once. */
+static void *ctx_sums (void *arg)
+{
+  bcnum_ctx ctx;
+  char val[BCNUM_OUTSTRING_SIZE + 1];
+  char sum[BCNUM_OUTSTRING_SIZE + 1];
+  int i, n;
+
+  (void)arg;
+  if (bcnum_ctx_init (&ctx) != 0)
+    return "bcnum_ctx_init() failed";
+  for (n = 0; n < 10000; n++) {
+    strcpy (val, invals[0]);
+    for (i = 1; invals[i] != 0; i++) {
+      if (bcnum_ctx_add (&ctx, val, invals[i], 2, sum, sizeof (sum)) != 0)
+        return bcnumErrMsg[ctx.error];
+      if (bcnum_ctx_compare (&ctx, sum, outvals[i], 2) != 0)
+        return "a context sum came out wrong";
+      strcpy (val, sum);
+    }
+  }
+  if (bcnum_ctx_divide (&ctx, "1", "0", 2, sum, sizeof (sum)) == 0 || ctx.error != BCNUM_DIVZERO)
+    return "division by zero wasn't caught";
+  if (bcnum_ctx_add (&ctx, "1", "2", 0, sum, 1) == 0 || ctx.error != BCNUM_TOOSMALL)
+    return "a short output buffer wasn't caught";
+  bcnum_ctx_uninit (&ctx);
+  return 0;
+}
+
+/* Seconds per call of a multiply (or divide) of the digit strings A and B. */
+static double time_op (bcnum_ctx *ctx, int divide, const char *a, const char *b, char *out, size_t len)
+{
+  struct timespec t0, t1;
+  double t;
+  long n, reps = 1;
+
+  for (;;) {
+    clock_gettime (CLOCK_MONOTONIC, &t0);
+    for (n = 0; n < reps; n++)
+      if (divide)
+        (int)bcnum_ctx_divide (ctx, a, b, 0, out, len);
+      else
+        (int)bcnum_ctx_multiply (ctx, a, b, 0, out, len);
+    clock_gettime (CLOCK_MONOTONIC, &t1);
+    t = (double) (t1.tv_sec - t0.tv_sec) + (double) (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    if (t > 0.05)
+      return t / (double) reps;
+    reps *= 2;
+  }
+}
+
+/* "number crossover" times long multiplication against one recursive
+   split, and algorithm D against the Newton division, over a range of
+   sizes, to pick mul_karatsuba_limbs and div_newton_limbs. */
+static int crossover (void)
+{
+  static const int limbs[] = {8, 16, 24, 32, 48, 64, 96, 128, 256, 512, 768, 1024, 1536, 2048, 0};
+  bcnum_ctx ctx;
+  char *a, *b, *out;
+  int i, j, n, kl, nl;
+  double t1, t2;
+
+  (int)bcnum_ctx_init (&ctx);
+  a = malloc (40000);
+  b = malloc (20000);
+  out = malloc (80000);
+  if (a == 0 || b == 0 || out == 0)
+    return -1;
+  kl = mul_karatsuba_limbs;
+  nl = div_newton_limbs;
+  printf ("%6s %8s %12s %12s %12s %12s\n", "limbs", "digits", "mul long", "mul split", "div D", "div Newton");
+  for (i = 0; limbs[i] != 0; i++) {
+    n = limbs[i] * BC_LIMB_DIGITS;
+    for (j = 0; j < 2 * n; j++)
+      a[j] = (char) ('0' + (j == 0 ? 1 + rand () % 9 : rand () % 10));
+    for (j = 0; j < n; j++)
+      b[j] = (char) ('0' + (j == 0 ? 1 + rand () % 9 : rand () % 10));
+    b[n] = '\0';
+    /* n by n products; a 2n by n division with an n digit quotient */
+    a[n] = '\0';
+    mul_karatsuba_limbs = limbs[i] + 1;
+    t1 = time_op (&ctx, 0, a, b, out, 80000);
+    mul_karatsuba_limbs = limbs[i];
+    t2 = time_op (&ctx, 0, a, b, out, 80000);
+    printf ("%6d %8d %10.1fus %10.1fus", limbs[i], n, t1 * 1e6, t2 * 1e6);
+    a[n] = (char) ('0' + rand () % 10);
+    a[2 * n] = '\0';
+    mul_karatsuba_limbs = kl;
+    div_newton_limbs = INT_MAX;
+    t1 = time_op (&ctx, 1, a, b, out, 80000);
+    div_newton_limbs = 2;
+    t2 = time_op (&ctx, 1, a, b, out, 80000);
+    div_newton_limbs = nl;
+    printf (" %10.1fus %10.1fus\n", t1 * 1e6, t2 * 1e6);
+  }
+  free (a);
+  free (b);
+  free (out);
+  bcnum_ctx_uninit (&ctx);
+  return 0;
+}
+
+int main (int argc, char **argv)
+{
+  pthread_t thr[4];
+  void *err;
+  bcnum_acc acc;
+  char sum[BCNUM_OUTSTRING_SIZE + 1];
   int status;
   char *v;
   char val[BCNUM_OUTSTRING_SIZE + 1];
+  char mval[BCNUM_OUTSTRING_SIZE + 1];
+  bcmoney m = BCMONEY_INIT;
   int i;
 
+  if (argc > 1 && strcmp (argv[1], "crossover") == 0)
+    return crossover ();
+
   strcpy (val, invals[0]);
   for (i = 1; invals[i] != 0; i++) {
     printf ("Adding %s and %s:", val, invals[i]);
@@ -2407,6 +4430,75 @@ int main (void)
     }
     printf ("result = %s\n", val);
   }
+
+  strcpy (val, "0");
+  for (i = 0; moneyvals[i] != 0; i++) {
+    v = bcnum_add (val, moneyvals[i], 2);
+    strcpy (val, v);
+    if (bcmoney_add_str (&m, moneyvals[i]) != 0 || bcmoney_str (&m, mval, sizeof (mval)) == 0) {
+      printf ("\n\n***Error: bcmoney_add_str(%s): %s\n", moneyvals[i],
+              bcnumErrMsg[bcnumError]);
+      return -1;
+    }
+    if (strcmp (val, mval) != 0) {
+      printf ("\n\n***Error: adding %s, bc gave %s but bcmoney gave %s\n",
+              moneyvals[i], val, mval);
+      return -1;
+    }
+    printf ("money result = %s\n", mval);
+  }
+  bcmoney_free (&m);
+
+  /* an accumulator must match a chain of bcnum_add() calls, values and scales mixed */
+  strcpy (val, "0");
+  (int)bcnum_acc_init (&acc, 0, 3);
+  for (i = 0; i < 20000; i++) {
+    snprintf (mval, sizeof (mval), "%s%d.%0*d", i % 3 ? "" : "-", rand () % 100000, 1 + i % 5, rand () % 10000);
+    if (i % 7 == 0)
+      snprintf (mval, sizeof (mval), "%s.%03d", i % 2 ? "-0" : "0", 0);
+    strcpy (val, bcnum_add (val, mval, 3));
+    (int)bcnum_acc_add_str (&acc, mval);
+    bcnum_acc_str (&acc, sum, sizeof (sum));
+    if (strcmp (val, sum) != 0) {
+      printf ("\n\n***Error: adding %s, bc gave %s but the accumulator gave %s\n", mval, val, sum);
+      return -1;
+    }
+  }
+  (int)bcnum_acc_add_fixed (&acc, -123456789012345LL, 2);
+  strcpy (val, bcnum_add (val, "-1234567890123.45", 3));
+  if (strcmp (val, bcnum_acc_str (&acc, sum, sizeof (sum))) != 0) {
+    printf ("\n\n***Error: bcnum_acc_add_fixed() gave %s, not %s\n", sum, val);
+    return -1;
+  }
+  bcnum_acc_free (&acc);
+  printf ("accumulator result = %s\n", sum);
+
+  if (check_runs () != 0)
+    return -1;
+  printf ("digit kernels agree with the scalar ones\n");
+  if (check_limbs () != 0)
+    return -1;
+  printf ("limb multiply and divide agree with the digit loops\n");
+  if (check_conv () != 0)
+    return -1;
+  printf ("word-at-a-time conversions agree with bc\n");
+  if (check_sums () != 0)
+    return -1;
+  printf ("batch sums agree with bcnum_add\n");
+
+  for (i = 0; i < 4; i++)
+    if (pthread_create (&thr[i], 0, ctx_sums, 0) != 0) {
+      printf ("\n\n***Error: pthread_create() failed\n");
+      return -1;
+    }
+  for (i = 0; i < 4; i++) {
+    (int)pthread_join (thr[i], &err);
+    if (err != 0) {
+      printf ("\n\n***Error: context thread %d: %s\n", i, (char *)err);
+      return -1;
+    }
+  }
+  printf ("context sums in %d threads agree\n", i);
   return 0;
 }
 
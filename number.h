@@ -62,12 +62,14 @@ typedef struct bc_struct {
   char *n_value;                  /* The number. Not zero char terminated.
                                      May not point to the same place as n_ptr as
                                      in the case of leading zeros generated. */
+  int   n_size;                   /* The number of bytes at n_ptr. */
 } bc_struct;
 
 typedef enum _bcnum_error_type {
   BCNUM_NOERROR,                  /* no problema */
   BCNUM_MEMORY,                   /* memory exhausted */
   BCNUM_TOOSMALL,                 /* output string is too small */
+  BCNUM_DIVZERO,                  /* division by zero */
   /* new ones here */
   BCNUM_UNSPECIFIED               /* unspecified error */
 } bcnumErrorType;
@@ -98,11 +100,73 @@ typedef enum _bcnum_error_type {
 
 #define BCNUM_OUTSTRING_SIZE 512
 
-/* Global variables */
-extern bc_num _zero_;
-extern bc_num _one_;
-extern bc_num _two_;
+/*
+ * A context for the arbitrary precision routines.  Everything the bc
+ * engine used to keep in globals - the recycled bc_structs, the constants
+ * zero, one and two, the error, and where the result is written - lives
+ * here, so each thread can do its arithmetic in its own context.  Results
+ * go into a buffer the caller passes in.  The old bcnum_* functions run in
+ * a default context and write into bcnum_outstr, as they always have.
+ */
+#define BC_POOL_MIN 16                /* The smallest pooled digit buffer. */
+#define BC_POOL_CLASSES 7             /* Pooled sizes are BC_POOL_MIN << 0..6. */
 
+typedef struct _bcnum_ctx {
+  bc_num free_list;               /* bc_structs ready for reuse. */
+  char *pool[BC_POOL_CLASSES];    /* Digit buffers ready for reuse, by size. */
+  bc_num zero;                    /* This context's copies of the constants. */
+  bc_num one;
+  bc_num two;
+  bcnumErrorType error;           /* The error from the last call, if any. */
+  char *out;                      /* Where the result is being written. */
+  size_t out_size;
+  size_t out_ptr;
+} bcnum_ctx;
+
+/*
+ * A running total.  The sum is kept as a live bc_num, so adding a value
+ * parses only the value, and the total is formatted only when it is asked
+ * for.  The result is the same as chaining bcnum_add (total, value, scale).
+ */
+typedef struct _bcnum_acc {
+  bcnum_ctx *ctx;                 /* The context the sum lives in. */
+  bc_num sum;
+  int scale;
+} bcnum_acc;
+
+/*
+ * A batch sum, for adding up a long column.  Each value is parsed once
+ * into base 10^9 columns and added without carrying; carries are only
+ * normalized when the total is read (or every 2^30 values, before a
+ * column could overflow).  The total is the same as chaining
+ * bcnum_add (total, value, scale) from "0".  No bc_num is involved, so a
+ * sum needs no context.
+ */
+typedef struct _bcnum_sum {
+  long long *col;                 /* Column sums, least significant first. */
+  int ncols;                      /* The columns in use. */
+  int size;                       /* The columns allocated. */
+  int scale;
+  int pending;                    /* Values added since the last normalization. */
+  bcnumErrorType error;
+} bcnum_sum;
+
+#define BCNUM_SUM_INIT(scale) {0, 0, 0, (scale), 0, BCNUM_NOERROR}
+
+/*
+ * Fixed-point money.  An amount with two decimal places is carried as a
+ * 64 bit count of cents.  A value that outgrows that is carried in big,
+ * a bc accumulator, and summed with the arbitrary precision routines.
+ */
+typedef struct _bcmoney {
+  long long cents;                /* The value in cents, while big is NULL. */
+  int negzero;                    /* bc's "-0", the sum of negative zeros. */
+  bcnum_acc *big;                 /* The value once it overflowed. */
+} bcmoney;
+
+#define BCMONEY_INIT {0, 0, 0}
+
+/* Global variables */
 extern int bcnum_outstr_ptr;
 extern char bcnum_outstr[];
 extern int bcnum_is_init;
@@ -110,6 +174,14 @@ extern int bcnum_is_init;
 extern bcnumErrorType bcnumError;
 extern char *bcnumErrMsg[];
 
+/* Tunables: the operand sizes where multiply and divide change methods.
+   INT_MAX keeps a method from ever taking over. */
+extern int mul_base_digits;
+extern int mul_limb_digits;
+extern int div_limb_digits;
+extern int mul_karatsuba_limbs;
+extern int div_newton_limbs;
+
 
 /* Function Prototypes */
 
@@ -163,5 +235,36 @@ int bcnum_iszero (char *n1);
 int bcnum_isnearzero (char *n1, int scale);
 int bcnum_isneg (char *n1);
 void bcnum_uninit (void);
+int bcnum_ctx_init (bcnum_ctx *ctx);
+void bcnum_ctx_uninit (bcnum_ctx *ctx);
+int bcnum_ctx_add (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_sub (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_compare (bcnum_ctx *ctx, const char *n1, const char *n2, int scale);
+int bcnum_ctx_multiply (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_divide (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_modulo (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_raise (bcnum_ctx *ctx, const char *n1, const char *n2, int scale, char *out, size_t len);
+int bcnum_ctx_sqrt (bcnum_ctx *ctx, const char *n1, int scale, char *out, size_t len);
+int bcnum_ctx_iszero (bcnum_ctx *ctx, const char *n1);
+int bcnum_ctx_isnearzero (bcnum_ctx *ctx, const char *n1, int scale);
+int bcnum_ctx_isneg (bcnum_ctx *ctx, const char *n1);
+int bcnum_acc_init (bcnum_acc *acc, bcnum_ctx *ctx, int scale);
+int bcnum_acc_add_str (bcnum_acc *acc, const char *str);
+int bcnum_acc_add_fixed (bcnum_acc *acc, long long val, int scale);
+int bcnum_acc_add (bcnum_acc *acc, const bcnum_acc *n);
+char *bcnum_acc_str (bcnum_acc *acc, char *buf, size_t len);
+void bcnum_acc_free (bcnum_acc *acc);
+void bcnum_sum_init (bcnum_sum *s, int scale);
+int bcnum_sum_add (bcnum_sum *s, const char *str);
+char *bcnum_sum_str (bcnum_sum *s, char *buf, size_t len);
+void bcnum_sum_free (bcnum_sum *s);
+char *bcnum_sum_many (const char **vals, size_t n, int scale);
+int bcmoney_cents (const char *str, long long *cents);
+char *bcmoney_fmt (long long cents, char *buf, size_t len);
+int bcmoney_set (bcmoney *m, const char *str);
+int bcmoney_add (bcmoney *m, const bcmoney *n);
+int bcmoney_add_str (bcmoney *m, const char *str);
+char *bcmoney_str (const bcmoney *m, char *buf, size_t len);
+void bcmoney_free (bcmoney *m);
 
 #endif /* __NUMBER_H__ */